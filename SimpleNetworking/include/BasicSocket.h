@@ -0,0 +1,805 @@
+//
+//          Created by Riki Lowe on 17/09/2024.
+//
+//              Copyright Riki Lowe 2024
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <iterator>
+#include "ISocket.h"
+#include "TCPSocket.h"
+#include "UDPSocket.h"
+#include "SerialPort.h"
+
+// Compile-time socket front end
+// BasicSocket<Transport, EventPolicy, ErrorPolicy> resolves the transport, the event hooks and the error handling at compile time,
+// so a read or write is a direct, inlinable call with no virtual dispatch, std::function or future in the way
+// It is not synchronised, one thread (or one strand) per direction. SocketAdapter wraps a transport back up as an ISocket
+// UDPClientTransport, UDPServerTransport, TCPClientTransport and SerialTransport come with it, a Transport of your own provides
+//     boost::system::error_code open();
+//     void close();
+//     bool isOpen() const;
+//     void cancel();
+//     std::string getName() const;
+//     template<typename MutableBuffers> size_t read(const MutableBuffers&, boost::system::error_code&);
+//     template<typename ConstBuffers> size_t write(const ConstBuffers&, boost::system::error_code&);
+//     template<typename MutableBuffers> boost::asio::awaitable<size_t> asyncRead(MutableBuffers, boost::system::error_code&);
+//     template<typename ConstBuffers> boost::asio::awaitable<size_t> asyncWrite(ConstBuffers, boost::system::error_code&);
+// and optionally bool setEventLoop(io_context&), which lets a SocketAdapter join a SocketGroup
+
+// Event policies
+
+// Compiles away entirely
+struct NoEvents
+{
+    void preRead() {}
+    void postRead(uint8_t*, SocketResult&) {}
+    void preWrite() {}
+    void postWrite(uint8_t*, SocketResult&) {}
+};
+
+// The same runtime callbacks ISocket has
+struct CallbackEvents
+{
+    SocketEvents read;
+    SocketEvents write;
+
+    void preRead() { read.preEvent(); }
+    void postRead(uint8_t* data, SocketResult& result) { read.postEvent(data, result); }
+    void preWrite() { write.preEvent(); }
+    void postWrite(uint8_t* data, SocketResult& result) { write.postEvent(data, result); }
+};
+
+// Error policies, check() turns an error into a success flag
+
+struct IgnoreErrors
+{
+    bool check(const boost::system::error_code& err)
+    {
+        return !err;
+    }
+};
+
+// Keeps the last error_code, the message is only formatted if somebody asks for it
+struct LastErrorPolicy
+{
+    bool check(const boost::system::error_code& err)
+    {
+        if(err && err != boost::asio::error::operation_aborted)
+        {
+            m_lastError = err;
+        }
+        return !err;
+    }
+
+    // clears and returns the last error
+    boost::system::error_code getLastError()
+    {
+        return std::exchange(m_lastError, {});
+    }
+
+    std::string getLastErrorMessage()
+    {
+        auto lastError = getLastError();
+        return lastError ? lastError.message() : "";
+    }
+
+private:
+    boost::system::error_code m_lastError;
+};
+
+// Transports
+
+// Each owns a Boost handle and as little else as it needs, no ISocket underneath, so there are no locks, callbacks, metrics or
+// error bookkeeping besides the BasicSocket's policies. Reads wait on a ReadinessWaiter for timeoutMs, 0 waits for as long as
+// the handle is open, and close() wakes them. They start on the SocketExecutor's io_context and can move while closed
+// The waiting, retrying and opening are the same code UDPSocket, TCPClient and SerialPort run, see ReadinessWaiter's transfer(),
+// waitForData() and writeAll(), TCPClient::ConnectWithin() and SerialPort::OpenDevice(). What the transports leave out is
+// everything else those have: batches, offloads, timestamps, io_uring, busy polling and serial framing
+
+// Like ISocket's own checks, more than MaxBufferCount buffers are refused with message_size rather than part of them moved
+template<typename Buffers>
+bool CheckBufferCount(const Buffers& buffers, boost::system::error_code& err)
+{
+    if(static_cast<size_t>(std::distance(boost::asio::buffer_sequence_begin(buffers), boost::asio::buffer_sequence_end(buffers))) > ISocket::MaxBufferCount)
+    {
+        err = boost::asio::error::message_size;
+        return false;
+    }
+    return true;
+}
+
+// Clients connect to address:port, servers bind to it and reply to whoever sent the last datagram
+template<SocketRole Role>
+class UDPTransport
+{
+public:
+    using BoostUDP = boost::asio::ip::udp;
+
+    UDPTransport(const std::string& address, uint16_t port, uint32_t timeoutMs = 0)
+        : m_ioContext(&SocketExecutor::instance().getContext()), m_socket(*m_ioContext), m_address(address), m_port(port), m_timeoutMs(timeoutMs)
+    {
+    }
+
+    boost::system::error_code open()
+    {
+        close();
+        boost::system::error_code err;
+        const bool isAnyAddress = Role == SocketRole::Server && m_address.empty();
+        const auto address = isAnyAddress ? boost::asio::ip::address(boost::asio::ip::address_v4::any())
+                                          : boost::asio::ip::make_address(m_address.empty() || m_address == "localhost" ? "127.0.0.1" : m_address, err);
+        if(!err)
+        {
+            m_socket.open(BoostUDP::v4(), err);
+        }
+        if(!err)
+        {
+            m_socket.non_blocking(true, err); // see ReadinessWaiter::transfer()
+        }
+        if(!err)
+        {
+            if constexpr(Role == SocketRole::Client)
+            {
+                m_socket.connect(BoostUDP::endpoint(address, m_port), err);
+            }
+            else
+            {
+                m_socket.bind(BoostUDP::endpoint(address, m_port), err);
+            }
+        }
+        if(err)
+        {
+            close();
+        }
+        return err;
+    }
+
+    void close()
+    {
+        boost::system::error_code err;
+        m_socket.close(err);
+        m_waiter.cancel();
+    }
+
+    bool isOpen() const
+    {
+        return m_socket.is_open();
+    }
+
+    void cancel()
+    {
+        boost::system::error_code err;
+        m_socket.cancel(err);
+        m_waiter.cancel();
+    }
+
+    std::string getName() const
+    {
+        return m_address + ":" + std::to_string(m_port);
+    }
+
+    bool setEventLoop(io_context& context)
+    {
+        if(isOpen())
+        {
+            return false;
+        }
+        m_ioContext = &context;
+        m_socket = BoostUDP::socket(context);
+        return true;
+    }
+
+    io_context& getEventLoop() const
+    {
+        return *m_ioContext;
+    }
+
+    template<typename MutableBuffers>
+    size_t read(const MutableBuffers& buffers, boost::system::error_code& err)
+    {
+        if(!CheckBufferCount(buffers, err))
+        {
+            return 0;
+        }
+        const auto deadline = ReadinessWaiter::DeadlineAfter(m_timeoutMs);
+        if constexpr(Role == SocketRole::Client)
+        {
+            return m_waiter.transfer(m_socket, POLLIN, deadline, [this, &buffers](boost::system::error_code& err)
+            {
+                return m_socket.receive(buffers, 0, err);
+            }, err, true);
+        }
+        BoostUDP::endpoint sender;
+        const size_t bytes = m_waiter.transfer(m_socket, POLLIN, deadline, [this, &buffers, &sender](boost::system::error_code& err)
+        {
+            return m_socket.receive_from(buffers, sender, 0, err);
+        }, err, true);
+        setPeer(sender, err);
+        return bytes;
+    }
+
+    template<typename ConstBuffers>
+    size_t write(const ConstBuffers& buffers, boost::system::error_code& err)
+    {
+        if(!CheckBufferCount(buffers, err))
+        {
+            return 0;
+        }
+        const auto deadline = ReadinessWaiter::DeadlineAfter(m_timeoutMs);
+        if constexpr(Role == SocketRole::Client)
+        {
+            return m_waiter.transfer(m_socket, POLLOUT, deadline, [this, &buffers](boost::system::error_code& err)
+            {
+                return m_socket.send(buffers, 0, err);
+            }, err);
+        }
+        const auto peer = getPeer();
+        return m_waiter.transfer(m_socket, POLLOUT, deadline, [this, &buffers, &peer](boost::system::error_code& err)
+        {
+            return m_socket.send_to(buffers, peer, 0, err);
+        }, err);
+    }
+
+    template<typename MutableBuffers>
+    boost::asio::awaitable<size_t> asyncRead(MutableBuffers buffers, boost::system::error_code& err)
+    {
+        if constexpr(Role == SocketRole::Client)
+        {
+            co_return co_await m_socket.async_receive(buffers, boost::asio::redirect_error(boost::asio::use_awaitable, err));
+        }
+        BoostUDP::endpoint sender;
+        const size_t bytes = co_await m_socket.async_receive_from(buffers, sender, boost::asio::redirect_error(boost::asio::use_awaitable, err));
+        setPeer(sender, err);
+        co_return bytes;
+    }
+
+    template<typename ConstBuffers>
+    boost::asio::awaitable<size_t> asyncWrite(ConstBuffers buffers, boost::system::error_code& err)
+    {
+        if constexpr(Role == SocketRole::Client)
+        {
+            co_return co_await m_socket.async_send(buffers, boost::asio::redirect_error(boost::asio::use_awaitable, err));
+        }
+        co_return co_await m_socket.async_send_to(buffers, getPeer(), boost::asio::redirect_error(boost::asio::use_awaitable, err));
+    }
+
+    // For socket options
+    BoostUDP::socket& getSocket()
+    {
+        return m_socket;
+    }
+
+private:
+    // Only servers have a peer to track, reads and writes may still be on different threads so it is guarded
+    void setPeer(const BoostUDP::endpoint& sender, const boost::system::error_code& err)
+    {
+        if(!err)
+        {
+            std::lock_guard lock(m_peerMutex);
+            m_peer = sender;
+        }
+    }
+
+    BoostUDP::endpoint getPeer()
+    {
+        std::lock_guard lock(m_peerMutex);
+        return m_peer;
+    }
+
+    io_context* m_ioContext;
+    BoostUDP::socket m_socket;
+    ReadinessWaiter m_waiter;
+    std::string m_address;
+    uint16_t m_port;
+    uint32_t m_timeoutMs;
+    BoostUDP::endpoint m_peer;
+    std::mutex m_peerMutex;
+};
+
+using UDPClientTransport = UDPTransport<SocketRole::Client>;
+using UDPServerTransport = UDPTransport<SocketRole::Server>;
+
+// Connects within timeoutMs as TCPClient does, a read returns whatever has arrived and a write sends all of it
+class TCPClientTransport
+{
+public:
+    using BoostTCP = boost::asio::ip::tcp;
+
+    TCPClientTransport(const std::string& address, uint16_t port, uint32_t timeoutMs = 0)
+        : m_ioContext(&SocketExecutor::instance().getContext()), m_socket(*m_ioContext), m_address(address), m_port(port), m_timeoutMs(timeoutMs)
+    {
+    }
+
+    boost::system::error_code open()
+    {
+        close();
+        boost::system::error_code err;
+        const auto address = boost::asio::ip::make_address(m_address.empty() || m_address == "localhost" ? "127.0.0.1" : m_address, err);
+        if(!err)
+        {
+            TCPClient::ConnectWithin(m_socket, BoostTCP::endpoint(address, m_port), m_waiter, m_timeoutMs, err);
+        }
+        if(!err)
+        {
+            m_socket.set_option(BoostTCP::no_delay(true), err);
+        }
+        if(err)
+        {
+            close();
+        }
+        return err;
+    }
+
+    void close()
+    {
+        boost::system::error_code err;
+        m_socket.shutdown(BoostTCP::socket::shutdown_both, err);
+        m_socket.close(err);
+        m_waiter.cancel();
+    }
+
+    bool isOpen() const
+    {
+        return m_socket.is_open();
+    }
+
+    void cancel()
+    {
+        boost::system::error_code err;
+        m_socket.cancel(err);
+        m_waiter.cancel();
+    }
+
+    std::string getName() const
+    {
+        return m_address + ":" + std::to_string(m_port);
+    }
+
+    bool setEventLoop(io_context& context)
+    {
+        if(isOpen())
+        {
+            return false;
+        }
+        m_ioContext = &context;
+        m_socket = BoostTCP::socket(context);
+        return true;
+    }
+
+    io_context& getEventLoop() const
+    {
+        return *m_ioContext;
+    }
+
+    template<typename MutableBuffers>
+    size_t read(const MutableBuffers& buffers, boost::system::error_code& err)
+    {
+        if(!CheckBufferCount(buffers, err) || (err = m_waiter.waitForData(m_socket, ReadinessWaiter::DeadlineAfter(m_timeoutMs))))
+        {
+            return 0;
+        }
+        return m_socket.receive(buffers, 0, err);
+    }
+
+    // Blocks in the kernel like TCPSocket's writes, close() shuts it down
+    template<typename ConstBuffers>
+    size_t write(const ConstBuffers& buffers, boost::system::error_code& err)
+    {
+        return CheckBufferCount(buffers, err) ? boost::asio::write(m_socket, buffers, err) : 0;
+    }
+
+    template<typename MutableBuffers>
+    boost::asio::awaitable<size_t> asyncRead(MutableBuffers buffers, boost::system::error_code& err)
+    {
+        co_return co_await m_socket.async_read_some(buffers, boost::asio::redirect_error(boost::asio::use_awaitable, err));
+    }
+
+    template<typename ConstBuffers>
+    boost::asio::awaitable<size_t> asyncWrite(ConstBuffers buffers, boost::system::error_code& err)
+    {
+        co_return co_await boost::asio::async_write(m_socket, buffers, boost::asio::redirect_error(boost::asio::use_awaitable, err));
+    }
+
+    // For socket options
+    BoostTCP::socket& getSocket()
+    {
+        return m_socket;
+    }
+
+private:
+    io_context* m_ioContext;
+    BoostTCP::socket m_socket;
+    ReadinessWaiter m_waiter;
+    std::string m_address;
+    uint16_t m_port;
+    uint32_t m_timeoutMs;
+};
+
+// A serial device opened 8N1 without flow control, as SerialPort opens it. Unlike SerialPort nothing is flushed before a read
+// Writes take as long as they take, only reads time out. Windows can't poll a serial handle, there the transfer itself waits
+class SerialTransport
+{
+public:
+    SerialTransport(const std::string& deviceName, uint32_t baudRate = 57600, uint32_t timeoutMs = 0)
+        : m_ioContext(&SocketExecutor::instance().getContext()), m_port(*m_ioContext), m_deviceName(deviceName), m_baudRate(baudRate), m_timeoutMs(timeoutMs)
+    {
+    }
+
+    boost::system::error_code open()
+    {
+        close();
+        boost::system::error_code err;
+        SerialPort::OpenDevice(m_port, m_deviceName, SerialPort::BaudRate(m_baudRate), SerialPort::Parity(SerialPort::Parity::none), SerialPort::CharSize(8),
+                               SerialPort::FlowCtrl(SerialPort::FlowCtrl::none), SerialPort::StopBits(SerialPort::StopBits::one), err);
+        if(!err)
+        {
+            SerialPort::ApplyLatencyOptions(m_port, {}, err);
+        }
+        if(err)
+        {
+            close();
+        }
+        return err;
+    }
+
+    void close()
+    {
+        boost::system::error_code err;
+        m_port.close(err);
+        m_waiter.cancel();
+    }
+
+    bool isOpen() const
+    {
+        return m_port.is_open();
+    }
+
+    void cancel()
+    {
+        boost::system::error_code err;
+        m_port.cancel(err);
+        m_waiter.cancel();
+    }
+
+    std::string getName() const
+    {
+        return m_deviceName;
+    }
+
+    bool setEventLoop(io_context& context)
+    {
+        if(isOpen())
+        {
+            return false;
+        }
+        m_ioContext = &context;
+        m_port = boost::asio::serial_port(context);
+        return true;
+    }
+
+    io_context& getEventLoop() const
+    {
+        return *m_ioContext;
+    }
+
+    template<typename MutableBuffers>
+    size_t read(const MutableBuffers& buffers, boost::system::error_code& err)
+    {
+        if(!CheckBufferCount(buffers, err))
+        {
+            return 0;
+        }
+    #ifndef _WIN32
+        if((err = m_waiter.waitUntil(m_port, POLLIN, ReadinessWaiter::DeadlineAfter(m_timeoutMs))))
+        {
+            return 0;
+        }
+    #endif
+        return m_port.read_some(buffers, err);
+    }
+
+    template<typename ConstBuffers>
+    size_t write(const ConstBuffers& buffers, boost::system::error_code& err)
+    {
+        if(!CheckBufferCount(buffers, err))
+        {
+            return 0;
+        }
+    #ifndef _WIN32
+        return m_waiter.writeAll(m_port, buffers, ReadinessWaiter::Clock::time_point::max(), err);
+    #else
+        return boost::asio::write(m_port, buffers, err);
+    #endif
+    }
+
+    template<typename MutableBuffers>
+    boost::asio::awaitable<size_t> asyncRead(MutableBuffers buffers, boost::system::error_code& err)
+    {
+        co_return co_await m_port.async_read_some(buffers, boost::asio::redirect_error(boost::asio::use_awaitable, err));
+    }
+
+    template<typename ConstBuffers>
+    boost::asio::awaitable<size_t> asyncWrite(ConstBuffers buffers, boost::system::error_code& err)
+    {
+        co_return co_await boost::asio::async_write(m_port, buffers, boost::asio::redirect_error(boost::asio::use_awaitable, err));
+    }
+
+    // For port options
+    boost::asio::serial_port& getPort()
+    {
+        return m_port;
+    }
+
+private:
+    io_context* m_ioContext;
+    boost::asio::serial_port m_port;
+    ReadinessWaiter m_waiter;
+    std::string m_deviceName;
+    uint32_t m_baudRate;
+    uint32_t m_timeoutMs;
+};
+
+template<typename Transport, typename EventPolicy = NoEvents, typename ErrorPolicy = LastErrorPolicy>
+class BasicSocket
+{
+public:
+    // Arguments go to the transport
+    template<typename... Args>
+    explicit BasicSocket(Args&&... args)
+        : m_transport(std::forward<Args>(args)...)
+    {
+    }
+
+    bool open()
+    {
+        return m_errors.check(m_transport.open());
+    }
+
+    void close()
+    {
+        m_transport.close();
+    }
+
+    bool isOpen() const
+    {
+        return m_transport.isOpen();
+    }
+
+    SocketResult readData(std::span<uint8_t> data)
+    {
+        if(auto invalid = checkIsValid(data.size()); invalid != SocketErrorReason::None)
+        {
+            return SocketResult::failed(invalid);
+        }
+        m_events.preRead();
+        boost::system::error_code err;
+        auto result = completed(m_transport.read(boost::asio::buffer(data.data(), data.size()), err), err);
+        m_events.postRead(data.data(), result);
+        return result;
+    }
+
+    SocketResult writeData(std::span<const uint8_t> data)
+    {
+        if(auto invalid = checkIsValid(data.size()); invalid != SocketErrorReason::None)
+        {
+            return SocketResult::failed(invalid);
+        }
+        m_events.preWrite();
+        boost::system::error_code err;
+        auto result = completed(m_transport.write(boost::asio::buffer(data.data(), data.size()), err), err);
+        m_events.postWrite(const_cast<uint8_t*>(data.data()), result);
+        return result;
+    }
+
+    ISocket::AwaitableSocketResult asyncRead(std::span<uint8_t> data)
+    {
+        if(auto invalid = checkIsValid(data.size()); invalid != SocketErrorReason::None)
+        {
+            co_return SocketResult::failed(invalid);
+        }
+        m_events.preRead();
+        boost::system::error_code err;
+        auto result = completed(co_await m_transport.asyncRead(boost::asio::buffer(data.data(), data.size()), err), err);
+        m_events.postRead(data.data(), result);
+        co_return result;
+    }
+
+    ISocket::AwaitableSocketResult asyncWrite(std::span<const uint8_t> data)
+    {
+        if(auto invalid = checkIsValid(data.size()); invalid != SocketErrorReason::None)
+        {
+            co_return SocketResult::failed(invalid);
+        }
+        m_events.preWrite();
+        boost::system::error_code err;
+        auto result = completed(co_await m_transport.asyncWrite(boost::asio::buffer(data.data(), data.size()), err), err);
+        m_events.postWrite(const_cast<uint8_t*>(data.data()), result);
+        co_return result;
+    }
+
+    Transport& getTransport()
+    {
+        return m_transport;
+    }
+
+    EventPolicy& getEvents()
+    {
+        return m_events;
+    }
+
+    ErrorPolicy& getErrors()
+    {
+        return m_errors;
+    }
+
+private:
+    SocketErrorReason checkIsValid(size_t bufferSize)
+    {
+        if(!m_transport.isOpen())
+        {
+            m_errors.check(boost::asio::error::not_connected);
+            return SocketErrorReason::NotInitialised;
+        }
+        if(bufferSize == 0)
+        {
+            m_errors.check(boost::asio::error::invalid_argument);
+            return SocketErrorReason::NoBufferSize;
+        }
+        return SocketErrorReason::None;
+    }
+
+    SocketResult completed(size_t bytes, const boost::system::error_code& err)
+    {
+        SocketResult result { bytes, m_errors.check(err), err == boost::asio::error::timed_out };
+        if(err)
+        {
+            result.reason = SocketErrorReason::System;
+            result.error = err;
+        }
+        return result;
+    }
+
+    Transport m_transport;
+    [[no_unique_address]] EventPolicy m_events;
+    [[no_unique_address]] ErrorPolicy m_errors;
+};
+
+// Presents a transport as an ISocket, for code that takes sockets polymorphically
+// Modes, callbacks, metrics, futures and the error message all come from ISocket as usual, only the I/O is the transport's
+template<typename Transport>
+class SocketAdapter : public ISocket
+{
+public:
+    // Arguments after the mode go to the transport
+    template<typename... Args>
+    SocketAdapter(SocketType type, SocketMode mode, Args&&... args)
+        : ISocket(type, mode, DefaultRole, "", 0), m_transport(std::forward<Args>(args)...)
+    {
+    }
+
+    ~SocketAdapter() override
+    {
+        SocketAdapter::close();
+    }
+
+    bool open() override
+    {
+        close();
+        const auto openError = m_transport.open();
+        m_initialised = CheckForError([&openError](boost::system::error_code& err)
+        {
+            err = openError;
+        });
+        return m_initialised && ISocket::open();
+    }
+
+    void close() override
+    {
+        if(m_readContinuously)
+        {
+            stopReadingContinuously();
+        }
+        if(isOpen())
+        {
+            m_transport.close();
+            ISocket::close();
+        }
+    }
+
+    bool isOpen() const override
+    {
+        return m_transport.isOpen();
+    }
+
+    void cancel() override
+    {
+        m_transport.cancel();
+    }
+
+    std::string getSocketName() const override
+    {
+        return m_transport.getName();
+    }
+
+    Transport& getTransport()
+    {
+        return m_transport;
+    }
+
+protected:
+    // Only a transport that can move, the ones here can
+    bool rebindEventLoop(io_context& context) override
+    {
+        if constexpr(requires { m_transport.setEventLoop(context); })
+        {
+            return m_transport.setEventLoop(context);
+        }
+        return false;
+    }
+
+    SocketResult internalReadData(unsigned char* data, size_t bufferSize) override
+    {
+        return readBuffers(boost::asio::buffer(data, bufferSize));
+    }
+
+    SocketResult internalWriteData(unsigned char* data, size_t bufferSize) override
+    {
+        return writeBuffers(boost::asio::buffer(data, bufferSize));
+    }
+
+    SocketResult internalReadBuffers(MutableBuffers buffers) override
+    {
+        return readBuffers(buffers);
+    }
+
+    SocketResult internalWriteBuffers(ConstBuffers buffers) override
+    {
+        return writeBuffers(buffers);
+    }
+
+    AwaitableSocketResult internalAsyncReadData(unsigned char* data, size_t bufferSize) override
+    {
+        boost::system::error_code err;
+        SocketResult result {};
+        result.bytes = co_await m_transport.asyncRead(boost::asio::buffer(data, bufferSize), err);
+        CheckAsyncResult(result, err);
+        co_return result;
+    }
+
+    AwaitableSocketResult internalAsyncWriteData(unsigned char* data, size_t bufferSize) override
+    {
+        boost::system::error_code err;
+        SocketResult result {};
+        result.bytes = co_await m_transport.asyncWrite(boost::asio::buffer(data, bufferSize), err);
+        CheckAsyncResult(result, err);
+        co_return result;
+    }
+
+    template<typename Buffers>
+    SocketResult readBuffers(const Buffers& buffers)
+    {
+        SocketResult result {};
+        CheckForError(result, [&](boost::system::error_code& err)
+        {
+            result.bytes = m_transport.read(buffers, err);
+            result.timedOut = err == boost::asio::error::timed_out;
+        });
+        return result;
+    }
+
+    template<typename Buffers>
+    SocketResult writeBuffers(const Buffers& buffers)
+    {
+        SocketResult result {};
+        CheckForError(result, [&](boost::system::error_code& err)
+        {
+            result.bytes = m_transport.write(buffers, err);
+        });
+        return result;
+    }
+
+    Transport m_transport;
+};
@@ -0,0 +1,162 @@
+//
+//          Created by Riki Lowe on 17/09/2024.
+//
+//              Copyright Riki Lowe 2024
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <span>
+#include <vector>
+#include <bit>
+#include <cstdint>
+
+// Single-producer/single-consumer ring of fixed size frames
+// The producer receives straight into a free slot and publishes it, the consumer reads it in place and releases it
+// Neither side locks, allocates or makes a syscall
+class FrameRing
+{
+public:
+    static constexpr size_t CacheLineSize = 64;
+
+    // frameCount is rounded up to a power of two, every slot starts on its own cache line
+    FrameRing(size_t frameCount, size_t frameSize)
+        : m_frameCount(std::bit_ceil(std::max<size_t>(frameCount, 2))),
+          m_frameSize(frameSize),
+          m_slotSize((frameSize + CacheLineSize - 1) / CacheLineSize * CacheLineSize),
+          m_storage(static_cast<uint8_t*>(::operator new(m_frameCount * m_slotSize, std::align_val_t(CacheLineSize)))),
+          m_lengths(m_frameCount)
+    {
+    }
+
+    FrameRing(const FrameRing&) = delete;
+    FrameRing& operator=(const FrameRing&) = delete;
+
+    // Producer side
+
+    // The next free slot, or an empty span when the consumer has fallen behind
+    std::span<uint8_t> acquire()
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if(head - m_cachedTail == m_frameCount)
+        {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if(head - m_cachedTail == m_frameCount)
+            {
+                return {};
+            }
+        }
+        return { slot(head), m_frameSize };
+    }
+
+    // Publishes the slot returned by the last acquire()
+    void commit(size_t bytes)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        m_lengths[head & (m_frameCount - 1)] = bytes;
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    void dropped()
+    {
+        m_droppedFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Consumer side
+
+    // The oldest frame, or a span with a null data() when there is nothing to read (zero length frames are valid)
+    std::span<const uint8_t> front()
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if(tail == m_cachedHead)
+        {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if(tail == m_cachedHead)
+            {
+                return {};
+            }
+        }
+        return { slot(tail), m_lengths[tail & (m_frameCount - 1)] };
+    }
+
+    // Hands the frame returned by front() back to the producer
+    void pop()
+    {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Calls function(std::span<const uint8_t>) for every frame available right now, returns how many there were
+    template<typename Function>
+    size_t drain(Function&& function)
+    {
+        size_t frames = 0;
+        for(auto frame = front(); frame.data(); frame = front())
+        {
+            function(frame);
+            pop();
+            ++frames;
+        }
+        return frames;
+    }
+
+    // Either side
+
+    size_t size() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    size_t capacity() const
+    {
+        return m_frameCount;
+    }
+
+    size_t getFrameSize() const
+    {
+        return m_frameSize;
+    }
+
+    // Frames the producer had to throw away because the ring was full
+    size_t getDroppedFrames() const
+    {
+        return m_droppedFrames.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct AlignedDelete
+    {
+        void operator()(uint8_t* storage) const
+        {
+            ::operator delete(storage, std::align_val_t(CacheLineSize));
+        }
+    };
+
+    uint8_t* slot(size_t index) const
+    {
+        return m_storage.get() + (index & (m_frameCount - 1)) * m_slotSize;
+    }
+
+    const size_t m_frameCount;
+    const size_t m_frameSize;
+    const size_t m_slotSize;
+    std::unique_ptr<uint8_t, AlignedDelete> m_storage;
+    std::vector<size_t> m_lengths;
+
+    // Each index shares a cache line only with the copy of the other index its own side keeps
+    alignas(CacheLineSize) std::atomic<size_t> m_head = 0; // written by the producer
+    size_t m_cachedTail = 0;
+    alignas(CacheLineSize) std::atomic<size_t> m_tail = 0; // written by the consumer
+    size_t m_cachedHead = 0;
+    alignas(CacheLineSize) std::atomic<size_t> m_droppedFrames = 0;
+};
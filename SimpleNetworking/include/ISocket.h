@@ -13,10 +13,31 @@
 #include <functional>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <boost/asio.hpp>
 #include <future>
 #include <map>
+#include <deque>
+#include <array>
+#include <utility>
 #include <exception>
+#include <span>
+#ifndef _WIN32
+#include <poll.h>
+#endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#endif
+
+#include "SocketExecutor.h"
+#include "FrameRing.h"
+#include "PacketPool.h"
+#include "SocketMetrics.h"
+#include "IoUring.h"
+#include "Serialization.h"
 
 using namespace boost::asio;
 
@@ -35,10 +56,29 @@ enum class SocketMode
     ReadWrite
 };
 
+// BusyPoll trades CPU for latency, reads spin on the socket for a while before they block (UDP and TCP, elsewhere it is Blocking)
+// Operations run on the calling thread like Blocking ones, and continuous reads get a dedicated thread of their own
 enum class SocketType
 {
     Blocking,
-    NonBlocking
+    NonBlocking,
+    BusyPoll
+};
+
+// Tuning for SocketType::BusyPoll, set before open()
+struct BusyPollOptions
+{
+    std::chrono::microseconds spinBudget { 200 }; // how long a read spins on an empty socket before it blocks
+    uint32_t kernelBusyPollUs = 50; // SO_BUSY_POLL, how long the kernel polls the device queue on an empty receive
+    int cpu = -1; // the continuous read thread is pinned here, -1 leaves it where the scheduler puts it
+};
+
+// How synchronous reads and writes reach the kernel
+// Reactor waits for readiness on the shared io_context then makes the call, IoUring queues the operation on the calling thread's io_uring
+enum class IOBackend
+{
+    Reactor,
+    IoUring
 };
 
 // Semantic -- Client is a writer, Server is a reader but both could implement the functions of the other?
@@ -96,27 +136,146 @@ private:
     Buffer m_recvBuffer;
 };
 
+// Why an operation failed, only System carries an error_code
+enum class SocketErrorReason : uint8_t
+{
+    None,
+    System,
+    NotInitialised,
+    WrongMode,
+    NoBuffer,
+    NoBufferSize,
+    TooManyBuffers,
+    PartialWrite,
+    AlreadyReading,
+    FramingBufferOverflow,
+    LengthPrefixOverflow,
+    SendBufferOverflow,
+    MessageTooShort,
+    SendWindowFull,
+    NoSuchChannel,
+    StillClosing
+};
+
+// A fixed description of the reason, SocketError::message() fills in the details
+inline const char* DescribeSocketError(SocketErrorReason reason)
+{
+    switch(reason)
+    {
+        case SocketErrorReason::None: return "";
+        case SocketErrorReason::System: return "System error";
+        case SocketErrorReason::NotInitialised: return "Port was not initialised";
+        case SocketErrorReason::WrongMode: return "Operation does not match the port's mode";
+        case SocketErrorReason::NoBuffer: return "No buffer provided";
+        case SocketErrorReason::NoBufferSize: return "No buffer size provided";
+        case SocketErrorReason::TooManyBuffers: return "Too many buffers";
+        case SocketErrorReason::PartialWrite: return "Write failed, not every byte was written";
+        case SocketErrorReason::AlreadyReading: return "Already reading continuously";
+        case SocketErrorReason::FramingBufferOverflow: return "Message larger than the framing buffer";
+        case SocketErrorReason::LengthPrefixOverflow: return "Message does not fit the length prefix";
+        case SocketErrorReason::SendBufferOverflow: return "Values do not fit the send buffer";
+        case SocketErrorReason::MessageTooShort: return "Message is shorter than the values read from it";
+        case SocketErrorReason::SendWindowFull: return "Send window is full";
+        case SocketErrorReason::NoSuchChannel: return "No such channel";
+        case SocketErrorReason::StillClosing: return "The previous close has not finished";
+    }
+    return "";
+}
+
+// Trivially copyable so failing never allocates, the message is only formatted when somebody asks for it
+struct SocketError
+{
+    SocketErrorReason reason = SocketErrorReason::None;
+    boost::system::error_code code {};
+    size_t expected = 0; // sizes for the reasons that have them, SocketMode values for WrongMode
+    size_t actual = 0;
+
+    explicit operator bool() const
+    {
+        return reason != SocketErrorReason::None;
+    }
+
+    std::string message() const
+    {
+        static constexpr std::array<const char*, 3> modes { "Read", "Write", "ReadWrite" };
+        switch(reason)
+        {
+            case SocketErrorReason::System:
+                return code.message();
+            case SocketErrorReason::WrongMode:
+                return std::string("Cannot ") + modes.at(expected) + " data on a " + modes.at(actual) + " port";
+            case SocketErrorReason::TooManyBuffers:
+                return "Too many buffers, at most " + std::to_string(expected) + " can be moved at once";
+            case SocketErrorReason::PartialWrite:
+                return "Write failed, wrote " + std::to_string(actual) + " bytes, expected to write " + std::to_string(expected);
+            case SocketErrorReason::FramingBufferOverflow:
+                return "Message larger than the " + std::to_string(expected) + " byte framing buffer";
+            case SocketErrorReason::LengthPrefixOverflow:
+                return "Message of " + std::to_string(actual) + " bytes does not fit a " + std::to_string(expected) + " byte length";
+            case SocketErrorReason::SendBufferOverflow:
+                return "Values need " + std::to_string(expected) + " bytes, the send buffer has " + std::to_string(actual);
+            case SocketErrorReason::MessageTooShort:
+                return "Values need " + std::to_string(expected) + " bytes, the message has " + std::to_string(actual);
+            case SocketErrorReason::SendWindowFull:
+                return "Send window is full, " + std::to_string(expected) + " messages are waiting to be acknowledged";
+            case SocketErrorReason::NoSuchChannel:
+                return "Channel " + std::to_string(actual) + " does not exist, there are " + std::to_string(expected);
+            default:
+                return DescribeSocketError(reason);
+        }
+    }
+};
+
+struct SocketResult
+{
+    size_t bytes; // Bytes read or written
+    bool success; // was it successful? we could read/write *some* bytes but not all and then fail
+    bool timedOut = false; // nothing arrived before the deadline, success is false as well
+    SocketErrorReason reason = SocketErrorReason::None; // set whenever the operation failed or came up short
+    boost::system::error_code error {}; // the system's error when reason is System
+    std::chrono::system_clock::time_point timestamp {}; // when the kernel received it, only from sockets with receive timestamps on
+
+    // An operation that failed before or instead of moving any bytes
+    static SocketResult failed(SocketErrorReason reason, boost::system::error_code error = {})
+    {
+        return { .bytes = 0, .success = false, .reason = reason, .error = error };
+    }
+
+    explicit operator bool() const
+    {
+        return success;
+    }
+
+    // The socket's getLastError() has the details, sizes and modes, this is just the reason
+    std::string errorMessage() const
+    {
+        return error ? error.message() : DescribeSocketError(reason);
+    }
+};
+
 // More general use case error handling
+// The last error is kept as a SocketError, reads and writes failing on different threads only contend for a copy
 class ErrorHandler
 {
 public:
-    void setLastErrorMessage(const std::string& errorMessage)
+    void setLastError(const SocketError& error)
+    {
+        std::lock_guard lock(m_lastErrorMutex);
+        m_lastError = error;
+    }
+    SocketError getLastError() // clears and returns the last error
     {
-        m_lastErrorMessage = errorMessage;
+        std::lock_guard lock(m_lastErrorMutex);
+        return std::exchange(m_lastError, {});
     }
     std::string getLastErrorMessage() // clears and returns the last error
     {
-        if(m_lastErrorMessage.empty())
-        {
-            return "";
-        }
-        std::string lastErrorMessage = m_lastErrorMessage;
-        m_lastErrorMessage = "";
-        return lastErrorMessage;
+        return getLastError().message();
     }
     
 protected:
-    std::string m_lastErrorMessage; // most recent error message
+    SocketError m_lastError; // most recent error
+    std::mutex m_lastErrorMutex; // reads and writes can fail at the same time on ReadWrite sockets
     std::function<void(const boost::system::error_code& error)> m_lastErrorCallback;
 };
 
@@ -131,7 +290,7 @@ public:
         Warning,
         Bad
     };
-    static Severity getErrorSeverity(const boost::system::error_code& err, bool isUDP)
+    static Severity getErrorSeverity(const boost::system::error_code& err, [[maybe_unused]] bool isUDP)
     {
         // see SocketErrorHandler.cpp
         if(err.failed())
@@ -140,34 +299,50 @@ public:
         }
         return Severity::NoError;
     }
-    virtual bool CheckForError(const std::function<void(boost::system::error_code&)>& operation, bool isUDP = false)
+    static boost::system::error_code LastSystemError()
+    {
+        return boost::system::error_code(errno, boost::asio::error::get_system_category());
+    }
+    // The operation is called with an error_code to fill in, inlined rather than wrapped in a std::function
+    template<typename Operation>
+    bool CheckForError(Operation&& operation, bool isUDP = false)
+    {
+        boost::system::error_code error; // local so reads and writes on different threads don't share it
+        operation(error);
+        return CheckError(error, isUDP);
+    }
+    // As above, also handing the error back in the result
+    template<typename Result, typename Operation> requires requires(Result& result) { result.reason; result.error; }
+    bool CheckForError(Result& result, Operation&& operation)
+    {
+        boost::system::error_code error;
+        operation(error);
+        result.success = CheckError(error);
+        if(error)
+        {
+            result.reason = SocketErrorReason::System;
+            result.error = error;
+        }
+        return result.success;
+    }
+    virtual bool CheckError(const boost::system::error_code& error, bool isUDP = false)
     {
-        m_error = boost::system::error_code(); // clear error
-        operation(m_error);
-        if(Severity::Bad == getErrorSeverity(m_error, isUDP))
+        if(Severity::Bad == getErrorSeverity(error, isUDP))
         {
+            // operation_aborted only comes from our own cancel()/close(), whoever asked for it already knows
+            if(error == boost::asio::error::operation_aborted)
+            {
+                return false;
+            }
             if(m_lastErrorCallback)
             {
-                m_lastErrorCallback(m_error);
+                m_lastErrorCallback(error);
             }
-            setLastErrorMessage(m_error.message());
+            setLastError({ SocketErrorReason::System, error });
             return false;
         }
         return true;
     }
-private:
-    boost::system::error_code m_error; // most recent error code
-};
-
-struct SocketResult
-{
-    size_t bytes; // Bytes read or written
-    bool success; // was it successful? we could read/write *some* bytes but not all and then fail
-
-    explicit operator bool() const
-    {
-        return success;
-    }
 };
 
 struct SocketEvents
@@ -196,15 +371,259 @@ struct SocketEventCallbacks
     inline void closed() const { if(closeCallback) { closeCallback(); } }
 };
 
+// Waits on the calling thread for a socket to become readable or writable by polling its descriptor
+// Nothing here goes near the reactor, a pool thread waiting on a completion from its own io_context could wait forever
+// cancel() wakes a wait in progress through an eventfd polled alongside the socket, which is how close() reaches a reader
+// whose descriptor it has just closed. One wait per direction at a time, the sockets' direction locks see to that
+// Without an eventfd (Windows, other POSIX systems, or none to be had) the wait is taken in slices so it still notices
+class ReadinessWaiter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t MaxBufferCount = 64; // asio hands the kernel at most this many iovecs per call and quietly drops the rest
+
+    ReadinessWaiter() = default;
+    ReadinessWaiter(const ReadinessWaiter&) = delete;
+    ReadinessWaiter& operator=(const ReadinessWaiter&) = delete;
+
+    ~ReadinessWaiter()
+    {
+    #ifdef __linux__
+        for(auto& wake : m_wakes)
+        {
+            if(const int handle = wake.load(); handle >= 0)
+            {
+                ::close(handle);
+            }
+        }
+    #endif
+    }
+
+    // timed_out once timeoutMs passes, a timeout of 0 waits for as long as the socket is open
+    // A datagram socket only hangs up when close() shuts it down, so it can ask for a hangup to be taken as operation_aborted
+    template<typename Socket>
+    boost::system::error_code waitReadable(Socket& socket, uint32_t timeoutMs, bool hangupAborts = false)
+    {
+        return waitUntil(socket, POLLIN, DeadlineAfter(timeoutMs), hangupAborts);
+    }
+
+    template<typename Socket>
+    boost::system::error_code waitWritable(Socket& socket, uint32_t timeoutMs)
+    {
+        return waitUntil(socket, POLLOUT, DeadlineAfter(timeoutMs));
+    }
+
+    template<typename Socket>
+    boost::system::error_code waitUntil(Socket& socket, short events, Clock::time_point deadline, bool hangupAborts = false)
+    {
+        // taken before the count, a cancel() after that is still signalled and one before it is no concern of this wait
+        const int wake = takeWake(events & POLLOUT ? 1 : 0);
+        const uint32_t cancels = m_cancels.load();
+        for(;;)
+        {
+            if(!socket.is_open() || m_cancels.load() != cancels)
+            {
+                return boost::asio::error::operation_aborted;
+            }
+            int timeoutMs = wake >= 0 ? -1 : static_cast<int>(CheckIntervalMs);
+            if(deadline != Clock::time_point::max())
+            {
+                const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now()).count();
+                if(remaining <= 0)
+                {
+                    return boost::asio::error::timed_out;
+                }
+                timeoutMs = static_cast<int>(timeoutMs < 0 ? std::min<int64_t>(remaining, std::numeric_limits<int>::max()) : std::min<int64_t>(remaining, timeoutMs));
+            }
+        #ifndef _WIN32
+            std::array<pollfd, 2> handles {{ { socket.native_handle(), events, 0 }, { wake, POLLIN, 0 } }};
+            const int ready = ::poll(handles.data(), wake >= 0 ? 2 : 1, timeoutMs);
+        #else
+            std::array<WSAPOLLFD, 1> handles {{ { socket.native_handle(), events, 0 } }};
+            const int ready = ::WSAPoll(handles.data(), 1, static_cast<INT>(timeoutMs));
+        #endif
+            if(ready < 0)
+            {
+                auto err = NetworkingErrorHandler::LastSystemError();
+                if(err != boost::asio::error::interrupted)
+                {
+                    return err;
+                }
+            }
+            // an error or hangup counts as ready, the transfer that follows reports it
+            else if(handles[0].revents != 0)
+            {
+                const bool aborted = !socket.is_open() || (hangupAborts && (handles[0].revents & POLLHUP));
+                return aborted ? boost::asio::error::operation_aborted : boost::system::error_code();
+            }
+            else if(ready > 0)
+            {
+                Drain(wake); // woken, the count at the top of the loop says whether it was for this wait
+            }
+        }
+    }
+
+    // Whether a transfer would go ahead without waiting, an error or hangup counts as ready since the transfer reports it
+    template<typename Socket>
+    static bool IsReady(Socket& socket, short events)
+    {
+    #ifndef _WIN32
+        pollfd handle { socket.native_handle(), events, 0 };
+        return ::poll(&handle, 1, 0) != 0;
+    #else
+        WSAPOLLFD handle { socket.native_handle(), events, 0 };
+        return ::WSAPoll(&handle, 1, 0) != 0;
+    #endif
+    }
+
+    // Every wait in progress gives up with operation_aborted
+    void cancel()
+    {
+        m_cancels.fetch_add(1);
+    #ifdef __linux__
+        for(auto& wake : m_wakes)
+        {
+            if(const int handle = wake.load(); handle >= 0)
+            {
+                const uint64_t signal = 1;
+                [[maybe_unused]] const auto written = ::write(handle, &signal, sizeof(signal));
+            }
+        }
+    #endif
+    }
+
+    static Clock::time_point DeadlineAfter(uint32_t timeoutMs)
+    {
+        return timeoutMs == 0 ? Clock::time_point::max() : Clock::now() + std::chrono::milliseconds(timeoutMs);
+    }
+
+    // The blocking paths the library's sockets and BasicSocket's transports share
+
+    // For a socket that never blocks in the kernel, the transfer is retried whenever the socket says it can go, until the deadline
+    template<typename Socket, typename Transfer>
+    size_t transfer(Socket& socket, short events, Clock::time_point deadline, Transfer&& transfer, boost::system::error_code& err, bool hangupAborts = false)
+    {
+        for(;;)
+        {
+            const size_t bytes = transfer(err);
+            if(err != boost::asio::error::would_block)
+            {
+                return bytes;
+            }
+            err = waitUntil(socket, events, deadline, hangupAborts);
+            if(err)
+            {
+                return 0;
+            }
+        }
+    }
+
+    // Skips the poll entirely when something is already queued
+    template<typename Socket>
+    boost::system::error_code waitForData(Socket& socket, Clock::time_point deadline, bool hangupAborts = false)
+    {
+        boost::system::error_code err;
+        if(socket.available(err) > 0 || err)
+        {
+            return err;
+        }
+        return waitUntil(socket, POLLIN, deadline, hangupAborts);
+    }
+
+    // All of it, waiting before every write_some() where cancel() can reach it, boost::asio::write() would wait inside asio instead
+    template<typename Stream, typename ConstBuffers>
+    size_t writeAll(Stream& stream, const ConstBuffers& buffers, Clock::time_point deadline, boost::system::error_code& err)
+    {
+        std::array<boost::asio::const_buffer, MaxBufferCount> remaining {};
+        size_t count = 0;
+        for(auto buffer = boost::asio::buffer_sequence_begin(buffers); buffer != boost::asio::buffer_sequence_end(buffers); ++buffer)
+        {
+            if(count == remaining.size())
+            {
+                err = boost::asio::error::message_size;
+                return 0;
+            }
+            remaining[count++] = *buffer;
+        }
+        auto pending = std::span(remaining.data(), count);
+        size_t bytes = 0;
+        while(!pending.empty() && !err)
+        {
+            err = waitUntil(stream, POLLOUT, deadline);
+            if(err)
+            {
+                break;
+            }
+            size_t written = stream.write_some(pending, err);
+            bytes += written;
+            while(!pending.empty() && written >= pending.front().size())
+            {
+                written -= pending.front().size();
+                pending = pending.subspan(1);
+            }
+            if(!pending.empty())
+            {
+                pending.front() += written;
+            }
+        }
+        return bytes;
+    }
+
+private:
+    static constexpr uint32_t CheckIntervalMs = 20;
+
+    // The direction's eventfd, made the first time it waits and emptied of whatever an earlier cancel() left in it, -1 without one
+    int takeWake([[maybe_unused]] size_t direction)
+    {
+    #ifdef __linux__
+        int handle = m_wakes[direction].load();
+        if(handle < 0)
+        {
+            handle = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            m_wakes[direction].store(handle);
+        }
+        Drain(handle);
+        return handle;
+    #else
+        return -1;
+    #endif
+    }
+
+    static void Drain([[maybe_unused]] int handle)
+    {
+    #ifdef __linux__
+        uint64_t signals = 0;
+        if(handle >= 0)
+        {
+            [[maybe_unused]] const auto read = ::read(handle, &signals, sizeof(signals));
+        }
+    #endif
+    }
+
+    std::atomic_uint32_t m_cancels = 0;
+#ifdef __linux__
+    std::array<std::atomic_int, 2> m_wakes { -1, -1 }; // reads and writes
+#endif
+};
+
 class ISocket : public NetworkingBuffer, public NetworkingErrorHandler
 {
+    friend class SocketBatch;
+
 public:
     using ReceivedCallback = std::function<bool(unsigned char*, size_t, bool)>;
     using ReceivedCallbackByte = std::function<void(unsigned char, size_t, bool)>;
     using AsyncSocketResult = std::shared_future<SocketResult>;
+    using AwaitableSocketResult = boost::asio::awaitable<SocketResult>;
+    using Deadline = std::chrono::steady_clock::time_point;
+    using ConstBuffers = std::span<const boost::asio::const_buffer>;
+    using MutableBuffers = std::span<const boost::asio::mutable_buffer>;
+
+    static constexpr size_t MaxBufferCount = ReadinessWaiter::MaxBufferCount;
 
     ISocket(SocketType socketType, SocketMode socketMode, SocketRole socketRole, const std::string address, uint16_t port, uint32_t timeoutMs, uint32_t byteIntervalMs, size_t recvBufferSize, size_t sendBufferSize) // replace with chrono
-    : NetworkingBuffer(recvBufferSize, sendBufferSize), m_address(address), m_port(port), m_timeoutMs(timeoutMs), m_byteIntervalMs(byteIntervalMs), m_mode(socketMode), m_type(socketType), m_role(socketRole)
+    : NetworkingBuffer(recvBufferSize, sendBufferSize), m_address(address), m_port(port), m_timeoutMs(timeoutMs), m_byteIntervalMs(byteIntervalMs), m_mode(socketMode), m_type(socketType), m_role(socketRole), m_ioContext(&SocketExecutor::instance().getContext())
     {
     }
 
@@ -215,7 +634,7 @@ public:
 
     virtual bool open()
     {
-        std::lock_guard lock(m_socketMutex);
+        std::scoped_lock lock(m_socketMutex, m_readMutex, m_writeMutex);
         if(isOpen())
         {
             m_socketEventCallbacks.opened();
@@ -225,6 +644,31 @@ public:
     
     virtual bool isOpen() const = 0;
 
+    // Aborts every outstanding async operation on the socket
+    virtual void cancel() = 0;
+
+    // Moves the socket onto another event loop, a SocketGroup's, which then runs its continuous reads and coroutines
+    // Only while the socket is closed, and only for transports that can rebuild their handle on it (UDP, TCP, serial)
+    bool setEventLoop(io_context& context)
+    {
+        std::scoped_lock lock(m_socketMutex, m_readMutex, m_writeMutex);
+        if(isOpen() || m_readContinuously || !rebindEventLoop(context))
+        {
+            return false;
+        }
+        m_ioContext = &context;
+        std::lock_guard waitingLock(m_waitingMutex);
+        // their timers belong to the old loop, anything still waiting there was failed as the socket closed
+        m_waitingReads.reset();
+        m_waitingWrites.reset();
+        return true;
+    }
+
+    io_context& getEventLoop() const
+    {
+        return *m_ioContext;
+    }
+
     virtual std::string getSocketName() const = 0;
     
     std::string toV4()
@@ -247,43 +691,91 @@ public:
         return m_address;
     }
 
-    virtual void setAddress(const std::string& address)
+    virtual void setAddress([[maybe_unused]] const std::string& address)
     {
         throw std::bad_exception();
     }
 
+    // Derived classes close the underlying handle first, which releases a reader blocked on it
     virtual void close()
     {
-        std::lock_guard lock(m_socketMutex);
-        m_ioService.stop();
+        std::scoped_lock lock(m_socketMutex, m_readMutex, m_writeMutex);
         m_initialised = false;
         m_socketEventCallbacks.closed();
     }
     
     AsyncSocketResult readData(unsigned char* data, size_t bufferSize)
     {
-        auto task = std::async(std::launch::async, [this, data, bufferSize]()
+        return dispatchOperation(SocketMode::Read, {}, [this, data, bufferSize](Deadline deadline, bool mayWait)
         {
-            return checkedReadData(data, bufferSize);
+            return checkedReadData(data, bufferSize, deadline, mayWait);
         });
-        if(m_type == SocketType::Blocking)
-        {
-            task.wait();
-        }
-        return task.share();
     }
 
     AsyncSocketResult writeData(unsigned char* data, size_t bufferSize)
     {
-        auto task = std::async(std::launch::async, [this, data, bufferSize]()
+        return dispatchOperation(SocketMode::Write, {}, [this, data, bufferSize](Deadline deadline, bool mayWait)
         {
-            return checkedWriteData(data, bufferSize);
+            return checkedWriteData(data, bufferSize, deadline, mayWait);
         });
-        if(m_type == SocketType::Blocking)
+    }
+
+    // An operation still waiting at the deadline gives up with a timed out result, the deadline takes the place of the socket's timeout
+    // Only this operation's own wait expires, anything else on the socket carries on. A TCP or serial write that has started runs to the end
+    AsyncSocketResult readData(unsigned char* data, size_t bufferSize, Deadline deadline)
+    {
+        return dispatchOperation(SocketMode::Read, deadline, [this, data, bufferSize](Deadline deadline, bool mayWait)
         {
-            task.wait();
-        }
-        return task.share();
+            return checkedReadData(data, bufferSize, deadline, mayWait);
+        });
+    }
+
+    AsyncSocketResult writeData(unsigned char* data, size_t bufferSize, Deadline deadline)
+    {
+        return dispatchOperation(SocketMode::Write, deadline, [this, data, bufferSize](Deadline deadline, bool mayWait)
+        {
+            return checkedWriteData(data, bufferSize, deadline, mayWait);
+        });
+    }
+
+    // Receives into a pooled packet and sets its size, the packet can then be handed downstream without copying
+    // Like the raw pointer overloads, the packet must stay alive until a non-blocking read completes
+    AsyncSocketResult readData(PacketBuffer& packet)
+    {
+        return dispatchOperation(SocketMode::Read, {}, [this, &packet](Deadline deadline, bool mayWait)
+        {
+            auto result = checkedReadData(packet.data(), packet.capacity(), deadline, mayWait);
+            packet.resize(result.success ? result.bytes : 0);
+            return result;
+        });
+    }
+
+    // Takes its own reference, so the caller can drop the packet straight away
+    AsyncSocketResult writeData(PacketBuffer packet)
+    {
+        return dispatchOperation(SocketMode::Write, {}, [this, packet = std::move(packet)](Deadline deadline, bool mayWait)
+        {
+            return checkedWriteData(packet.data(), packet.size(), deadline, mayWait);
+        });
+    }
+
+    // Scatter read, fills each buffer in turn so a fixed size header and its payload can land in separate places
+    // The span and the memory it points at must stay alive until a non-blocking read completes
+    AsyncSocketResult readData(MutableBuffers buffers)
+    {
+        return dispatchOperation(SocketMode::Read, {}, [this, buffers](Deadline deadline, bool mayWait)
+        {
+            return checkedReadBuffers(buffers, deadline, mayWait);
+        });
+    }
+
+    // Gather write, the buffers go out in order as one datagram or one stretch of the stream without being copied together first
+    AsyncSocketResult writeData(ConstBuffers buffers)
+    {
+        return dispatchOperation(SocketMode::Write, {}, [this, buffers](Deadline deadline, bool mayWait)
+        {
+            return checkedWriteBuffers(buffers, deadline, mayWait);
+        });
     }
 
     AsyncSocketResult readData()
@@ -298,96 +790,981 @@ public:
         return writeData(sendBuffer.data(), sendBuffer.size());
     }
 
-    template<typename T, std::conditional_t<std::is_integral_v<std::remove_cv_t<T>> && !std::is_pointer_v<std::remove_cv_t<T>>, std::remove_cv_t<T>, void> = 0>
-    AsyncSocketResult send(T value)
+    // Coroutine API, completes on the socket's event loop without blocking a thread per operation
+    // Coroutines driving the same socket concurrently should be spawned on a single strand
+    AwaitableSocketResult asyncRead(std::span<uint8_t> data)
     {
-        return writeData((unsigned char*)&value, sizeof(T));
+        const auto started = metricsClock();
+        auto result = co_await checkedAsyncRead(data);
+        recordMetrics(SocketMode::Read, result, 0, started);
+        co_return result;
     }
 
-    SocketEventCallbacks& getSocketEventCallbacks()
+    AwaitableSocketResult asyncWrite(std::span<uint8_t> data)
     {
-        return m_socketEventCallbacks;
+        const auto started = metricsClock();
+        auto result = co_await checkedAsyncWrite(data);
+        recordMetrics(SocketMode::Write, result, data.size(), started);
+        co_return result;
     }
-    
-protected:
-    // Implement an internal blocking function for both modes
-    virtual SocketResult internalReadData(unsigned char* data, size_t bufferSize) = 0;
-    virtual SocketResult internalWriteData(unsigned char* data, size_t bufferSize) = 0;
 
-    SocketResult checkedReadData(unsigned char* data, size_t bufferSize)
+    AwaitableSocketResult asyncRead(PacketBuffer& packet)
     {
-        std::lock_guard lock(m_socketMutex);
-        if(CheckIsValid(SocketMode::Read, data, bufferSize) == false)
-        {
-            return {};
-        }
-        m_socketEventCallbacks.read.preEvent();
-        auto result = internalReadData(data, bufferSize);
-        m_socketEventCallbacks.read.postEvent(data, result);
-        return result;
+        auto result = co_await asyncRead(std::span(packet.data(), packet.capacity()));
+        packet.resize(result.success ? result.bytes : 0);
+        co_return result;
     }
-    SocketResult checkedWriteData(unsigned char* data, size_t bufferSize)
+
+    AwaitableSocketResult asyncRead()
     {
-        std::lock_guard lock(m_socketMutex);
-        if(CheckIsValid(SocketMode::Write, data, bufferSize) == false)
-        {
-            return {};
-        }
-        m_socketEventCallbacks.write.preEvent();
-        SocketResult result = internalWriteData(data, bufferSize);
-        if (result.bytes != bufferSize)
-        {
-            setLastErrorMessage("Write failed, wrote " + std::to_string(result.bytes) + " bytes, expected to write " + std::to_string(bufferSize));
-        }
-        m_socketEventCallbacks.write.postEvent(data, result);
-        return result;
+        return asyncRead(getRecvBuffer());
     }
-    
-    bool CheckIsValid(SocketMode expectedMode, unsigned char* data, size_t bufferSize)
+
+    AwaitableSocketResult asyncWrite()
     {
-        if (!m_initialised)
+        return asyncWrite(getSendBuffer());
+    }
+
+    static constexpr size_t DefaultReceivedFrameCount = 256;
+
+    // Keeps one read outstanding on the shared io_context and receives straight into a FrameRing the application drains
+    // frameSize defaults to the receive buffer size, frames that arrive while the ring is full are dropped and counted
+    // Received frames bypass the read callbacks
+    bool startReadingContinuously(size_t frameCount = DefaultReceivedFrameCount, size_t frameSize = 0)
+    {
+        std::lock_guard lock(m_readMutex);
+        if(CheckIsValid(SocketMode::Read, getRecvBuffer().data(), getRecvBuffer().size()) != SocketErrorReason::None)
         {
-            setLastErrorMessage("Port was not initialised");
             return false;
         }
-        if(m_mode != SocketMode::ReadWrite && expectedMode != m_mode)
+        if(m_readContinuously.exchange(true))
         {
-            static const std::map<SocketMode, std::string> modes
-            {
-                { SocketMode::Read, "Read" },
-                { SocketMode::Write, "Write" }
-            };
-            std::stringstream modeStream;
-            modeStream << "Cannot " << modes.at(expectedMode) << " data on a " << modes.at(m_mode) << " port";
-            setLastErrorMessage(modeStream.str());
+            setLastError({ SocketErrorReason::AlreadyReading });
             return false;
         }
-        if(!data)
+        if(m_continuousRead.valid())
         {
-            setLastErrorMessage("No buffer provided");
-            return false;
+            m_continuousRead.wait(); // a previous loop that stopped on an error
         }
-        if(!bufferSize)
+        m_receivedFrames = std::make_unique<FrameRing>(frameCount, frameSize ? frameSize : getRecvBuffer().size());
+        if(m_type == SocketType::BusyPoll)
         {
-            setLastErrorMessage("No buffer size provided");
-            return false;
+            std::promise<void> finished;
+            m_continuousRead = finished.get_future();
+            std::thread([this, finished = std::move(finished)]() mutable
+            {
+                busyPollContinuously();
+                finished.set_value(); // the last this thread does, stopReadingContinuously() may destroy the socket straight after
+            }).detach();
+            return true;
         }
+        m_continuousRead = boost::asio::co_spawn(*m_ioContext, readContinuously(), boost::asio::use_future);
         return true;
     }
-    bool m_initialised = false;
+
+    void stopReadingContinuously()
+    {
+        if(!m_readContinuously.exchange(false))
+        {
+            return;
+        }
+        cancel();
+        // From inside the reader, one of its callbacks, it can't wait for a reader that only finishes once the callback returns
+        if(isInContinuousReader())
+        {
+            return;
+        }
+        // a reader between checking the flag and starting its next read misses the cancel, so keep at it until the loop has gone
+        while(m_continuousRead.valid() && m_continuousRead.wait_for(std::chrono::milliseconds(1)) != std::future_status::ready)
+        {
+            cancel();
+        }
+    }
+
+    bool isReadingContinuously() const
+    {
+        return m_readContinuously;
+    }
+
+    // Consumer side of the continuous read, stays valid until the next startReadingContinuously()
+    FrameRing* getReceivedFrames()
+    {
+        return m_receivedFrames.get();
+    }
+
+    // Encodes the values straight into the send buffer and writes them as one message, see MessageWriter for what can be sent
+    // Like writeData(), a non-blocking send has the send buffer until it completes
+    // Values go out in host order as they always have, send<std::endian::big>(...) puts them in network order
+    template<std::endian Order = std::endian::native, LengthPrefix Prefix = LengthPrefix::UInt16, typename... Values>
+    AsyncSocketResult send(const Values&... values)
+    {
+        auto& sendBuffer = getSendBuffer();
+        MessageWriter<Order, Prefix> writer(sendBuffer);
+        if(!writer.write(values...))
+        {
+            return failedOperation(writer.getError() == SerializationError::LengthPrefixOverflow
+                ? SocketError { SocketErrorReason::LengthPrefixOverflow, {}, static_cast<size_t>(Prefix), writer.getOversizedLength() }
+                : SocketError { SocketErrorReason::SendBufferOverflow, {}, writer.getRequiredBytes(), sendBuffer.size() });
+        }
+        return writeData(sendBuffer.data(), writer.size());
+    }
+
+    // send<T>(value) sends the value as a T
+    template<typename T>
+    AsyncSocketResult send(const std::type_identity_t<T>& value)
+    {
+        return send<std::endian::native>(value);
+    }
+
+    // Reads into the receive buffer and decodes the values from it, one datagram or whatever one read returns on a stream (MessageFramer reassembles those)
+    // It waits whatever the SocketType
+    // Views (std::string_view, byte spans) point into the receive buffer and are only valid until the next read
+    template<std::endian Order = std::endian::native, LengthPrefix Prefix = LengthPrefix::UInt16, typename... Values>
+    SocketResult receive(Values&&... values)
+    {
+        auto& recvBuffer = getRecvBuffer();
+        auto result = readData(recvBuffer.data(), recvBuffer.size()).get();
+        if(!result)
+        {
+            return result;
+        }
+        MessageReader<Order, Prefix> reader(std::span<const uint8_t>(recvBuffer.data(), result.bytes));
+        if(!reader.read(std::forward<Values>(values)...))
+        {
+            setLastError({ SocketErrorReason::MessageTooShort, {}, reader.getRequiredBytes(), result.bytes });
+            result.success = false;
+            result.reason = SocketErrorReason::MessageTooShort;
+        }
+        return result;
+    }
+
+    SocketEventCallbacks& getSocketEventCallbacks()
+    {
+        return m_socketEventCallbacks;
+    }
+
+    // Safe from any thread, it only reads atomics. Operations that fail validation never reach the transport and aren't counted
+    // Empty until enableMetrics(), the counts stay readable after metrics are turned off again
+    SocketMetricsSnapshot getMetrics() const
+    {
+        const auto* metrics = m_metrics.load(std::memory_order_acquire);
+        return metrics ? metrics->snapshot() : SocketMetricsSnapshot {};
+    }
+
+    void resetMetrics()
+    {
+        if(auto* metrics = m_metrics.load(std::memory_order_acquire))
+        {
+            metrics->reset();
+        }
+    }
+
+    // Metrics are off by default, the histograms take a few KB so they are only allocated the first time they're enabled
+    // Once on they cost two clock reads and a handful of relaxed atomic adds per operation
+    void enableMetrics()
+    {
+        std::call_once(m_metricsAllocated, [this]()
+        {
+            m_metricsStorage = std::make_unique<SocketMetrics>();
+            m_metrics.store(m_metricsStorage.get(), std::memory_order_release);
+        });
+        m_metricsEnabled.store(true, std::memory_order_release);
+    }
+
+    void setMetricsEnabled(bool enabled)
+    {
+        if(enabled)
+        {
+            enableMetrics();
+            return;
+        }
+        m_metricsEnabled.store(false, std::memory_order_relaxed);
+    }
+
+    bool isMetricsEnabled() const
+    {
+        return m_metricsEnabled.load(std::memory_order_relaxed);
+    }
+
+    // Synchronous reads and writes go through the calling thread's io_uring rather than the reactor, one io_uring_enter each
+    // Returns false and stays on the reactor where the kernel doesn't support it (Linux 5.6+). Async and continuous reads always use the reactor
+    bool setIOBackend(IOBackend backend)
+    {
+    #ifdef HAS_IO_URING
+        const bool supported = backend == IOBackend::Reactor || IoUring::isSupported();
+    #else
+        const bool supported = backend == IOBackend::Reactor;
+    #endif
+        m_ioBackend.store(supported ? backend : IOBackend::Reactor, std::memory_order_relaxed);
+        return supported;
+    }
+
+    IOBackend getIOBackend() const
+    {
+        return m_ioBackend.load(std::memory_order_relaxed);
+    }
+
+    void setBusyPollOptions(const BusyPollOptions& busyPollOptions)
+    {
+        std::lock_guard lock(m_socketMutex);
+        m_busyPollOptions = busyPollOptions;
+    }
+
+    BusyPollOptions getBusyPollOptions() const
+    {
+        return m_busyPollOptions;
+    }
+
+    // Whether the kernel took SO_BUSY_POLL on open(), raising it above net.core.busy_poll needs CAP_NET_ADMIN
+    bool isKernelBusyPollEnabled() const
+    {
+        return m_kernelBusyPoll;
+    }
+    
+protected:
+    // Recreates the transport's closed handle on the new event loop, false for transports that can't move
+    virtual bool rebindEventLoop([[maybe_unused]] io_context& context)
+    {
+        return false;
+    }
+
+    // Whether the calling thread is running the continuous reader's own handlers, see stopReadingContinuously()
+    virtual bool isInContinuousReader() const
+    {
+        return false;
+    }
+
+    // An operation that failed before reaching the transport, so it isn't counted in the metrics
+    AsyncSocketResult failedOperation(const SocketError& error)
+    {
+        setLastError(error);
+        std::promise<SocketResult> promise;
+        promise.set_value(SocketResult::failed(error.reason));
+        return promise.get_future().share();
+    }
+
+    // Blocking and busy-polling operations run on the calling thread, non-blocking operations are posted to the socket's event loop,
+    // the shared SocketExecutor unless a SocketGroup has it. One that finds its socket not ready waits for readiness there, so an idle socket holds no thread at all
+    // The operation is called with the deadline it runs to and whether it may wait, the deadline is {} for the socket's timeout
+    template<typename Operation>
+    AsyncSocketResult dispatchOperation(SocketMode mode, Deadline deadline, Operation&& operation)
+    {
+        if(m_type != SocketType::NonBlocking)
+        {
+            std::promise<SocketResult> promise;
+            promise.set_value(operation(deadline, true));
+            return promise.get_future().share();
+        }
+        auto promise = std::make_shared<std::promise<SocketResult>>();
+        AsyncSocketResult result = promise->get_future().share();
+        boost::asio::post(*m_ioContext, [this, mode, deadline, promise, operation = std::forward<Operation>(operation)]() mutable
+        {
+            if(!RunOperation(*promise, operation, deadline, false))
+            {
+                waitForOperation(mode, deadline, promise, [promise, operation = std::move(operation)](Deadline deadline, bool mayWait) mutable
+                {
+                    return RunOperation(*promise, operation, deadline, mayWait);
+                });
+            }
+        });
+        return result;
+    }
+
+    // False, with the promise left unset, when an operation that may not wait found its socket not ready
+    template<typename Operation>
+    static bool RunOperation(std::promise<SocketResult>& promise, Operation& operation, Deadline deadline, bool mayWait)
+    {
+        try
+        {
+            auto result = operation(deadline, mayWait);
+            if(!mayWait && IsNotReady(result))
+            {
+                return false;
+            }
+            promise.set_value(result);
+        }
+        catch(...)
+        {
+            promise.set_exception(std::current_exception());
+        }
+        return true;
+    }
+
+    // A non-blocking operation waiting for its socket, attempt() runs it and is false while it still isn't ready
+    // Once due it runs one last time with due as its deadline, which has passed, so the transport times it out without waiting
+    struct WaitingOperation
+    {
+        std::function<bool(Deadline, bool)> attempt;
+        std::shared_ptr<std::promise<SocketResult>> promise;
+        Deadline deadline; // the operation's own, {} for the socket's timeout
+        Deadline due;
+    };
+
+    // The waiting operations of one direction, whatever their number there is at most one readiness wait and one timer outstanding
+    // Their handlers hold the queue rather than the socket, they only touch the socket while it still has operations waiting
+    struct WaitingOperations
+    {
+        explicit WaitingOperations(io_context& context)
+            : timer(context)
+        {
+        }
+
+        std::mutex mutex;
+        std::deque<WaitingOperation> operations;
+        boost::asio::steady_timer timer;
+        Deadline timerDue = Deadline::max();
+        bool isWaiting = false; // for readiness
+        bool isDraining = false;
+    };
+
+    // Made the first time an operation in that direction has to wait, most sockets never do
+    std::shared_ptr<WaitingOperations> getWaitingOperations(SocketMode mode)
+    {
+        std::lock_guard lock(m_waitingMutex);
+        auto& waiting = mode == SocketMode::Read ? m_waitingReads : m_waitingWrites;
+        if(!waiting)
+        {
+            waiting = std::make_shared<WaitingOperations>(*m_ioContext);
+        }
+        return waiting;
+    }
+
+    void waitForOperation(SocketMode mode, Deadline deadline, std::shared_ptr<std::promise<SocketResult>> promise, std::function<bool(Deadline, bool)> attempt)
+    {
+        const auto waiting = getWaitingOperations(mode);
+        const auto due = deadline != Deadline {} ? deadline : ReadinessWaiter::DeadlineAfter(getWaitTimeoutMs(mode));
+        std::lock_guard lock(waiting->mutex);
+        waiting->operations.push_back({ std::move(attempt), std::move(promise), deadline, due });
+        ArmWaiting(this, mode, waiting);
+    }
+
+    // With the queue's lock held, waits for readiness and for the earliest operation to fall due, or stops the timer once nothing is left
+    static void ArmWaiting(ISocket* socket, SocketMode mode, const std::shared_ptr<WaitingOperations>& waiting)
+    {
+        if(waiting->operations.empty())
+        {
+            waiting->timer.cancel();
+            waiting->timerDue = Deadline::max();
+            return;
+        }
+        if(!waiting->isWaiting)
+        {
+            waiting->isWaiting = true;
+            socket->asyncWaitReady(mode, [socket, mode, waiting](const boost::system::error_code& err)
+            {
+                OnReady(socket, mode, waiting, err);
+            });
+        }
+        const auto due = std::min_element(waiting->operations.begin(), waiting->operations.end(), [](const auto& first, const auto& second)
+        {
+            return first.due < second.due;
+        })->due;
+        if(due < waiting->timerDue)
+        {
+            waiting->timerDue = due;
+            waiting->timer.expires_at(due);
+            waiting->timer.async_wait([socket, mode, waiting](const boost::system::error_code& err)
+            {
+                // a timer moved to an earlier operation, or stopped, has nothing to do
+                if(!err)
+                {
+                    OnDue(socket, mode, waiting);
+                }
+            });
+        }
+    }
+
+    // Runs the waiting operations in turn until one finds the socket not ready again
+    // An error means the socket closed, perhaps as it was destroyed, so the operations are failed without touching it
+    static void OnReady(ISocket* socket, SocketMode mode, const std::shared_ptr<WaitingOperations>& waiting, const boost::system::error_code& err)
+    {
+        std::unique_lock lock(waiting->mutex);
+        waiting->isWaiting = false;
+        if(err)
+        {
+            auto operations = std::exchange(waiting->operations, {});
+            ArmWaiting(socket, mode, waiting);
+            lock.unlock();
+            for(auto& operation : operations)
+            {
+                operation.promise->set_value(SocketResult::failed(SocketErrorReason::System, err));
+            }
+            return;
+        }
+        if(waiting->isDraining)
+        {
+            return; // whoever is draining arms the next wait
+        }
+        waiting->isDraining = true;
+        while(!waiting->operations.empty())
+        {
+            auto operation = std::move(waiting->operations.front());
+            waiting->operations.pop_front();
+            lock.unlock();
+            const bool completed = operation.attempt(operation.deadline, false);
+            lock.lock();
+            if(!completed)
+            {
+                waiting->operations.push_front(std::move(operation));
+                break;
+            }
+        }
+        waiting->isDraining = false;
+        ArmWaiting(socket, mode, waiting);
+    }
+
+    static void OnDue(ISocket* socket, SocketMode mode, const std::shared_ptr<WaitingOperations>& waiting)
+    {
+        std::unique_lock lock(waiting->mutex);
+        waiting->timerDue = Deadline::max();
+        const auto now = Deadline::clock::now();
+        std::vector<WaitingOperation> expired;
+        for(auto operation = waiting->operations.begin(); operation != waiting->operations.end();)
+        {
+            if(operation->due <= now)
+            {
+                expired.push_back(std::move(*operation));
+                operation = waiting->operations.erase(operation);
+            }
+            else
+            {
+                ++operation;
+            }
+        }
+        lock.unlock();
+        for(auto& operation : expired)
+        {
+            operation.attempt(operation.due, true);
+        }
+        lock.lock();
+        ArmWaiting(socket, mode, waiting);
+    }
+
+    // Only ever seen by dispatchOperation, which then waits for the socket to become ready
+    static SocketResult NotReady()
+    {
+        return SocketResult::failed(SocketErrorReason::System, boost::asio::error::would_block);
+    }
+
+    static bool IsNotReady(const SocketResult& result)
+    {
+        return !result.success && result.reason == SocketErrorReason::System && result.error == boost::asio::error::would_block;
+    }
+
+    // Whether an operation in this direction could go ahead without waiting
+    // A transport that can't tell runs its non-blocking operations straight through on the pool
+    virtual bool isReady([[maybe_unused]] SocketMode mode)
+    {
+        return true;
+    }
+
+    // Overridden along with isReady(), calls the handler on the socket's event loop once the direction is ready or the socket closes
+    virtual void asyncWaitReady([[maybe_unused]] SocketMode mode, std::function<void(const boost::system::error_code&)> handler)
+    {
+        boost::asio::post(*m_ioContext, [handler = std::move(handler)]()
+        {
+            handler({});
+        });
+    }
+
+    // How long a non-blocking operation without a deadline waits for readiness, 0 for as long as it takes
+    // The same timeout its transport's synchronous path keeps to
+    virtual uint32_t getWaitTimeoutMs([[maybe_unused]] SocketMode mode) const
+    {
+        return m_timeoutMs;
+    }
+
+    boost::asio::awaitable<void> readContinuously()
+    {
+        auto& frames = *m_receivedFrames;
+        auto& overflowBuffer = getRecvBuffer();
+        while(m_readContinuously)
+        {
+            auto frame = frames.acquire();
+            const bool isDropped = frame.data() == nullptr;
+            if(isDropped)
+            {
+                // still have to take it off the socket or the kernel buffer fills instead
+                frame = std::span(overflowBuffer.data(), std::min(overflowBuffer.size(), frames.getFrameSize()));
+            }
+            const auto started = metricsClock();
+            auto result = co_await internalAsyncReadData(frame.data(), frame.size());
+            recordMetrics(SocketMode::Read, result, 0, started);
+            if(!result)
+            {
+                // cancelled by stopReadingContinuously() or the socket failed, either way the error has been recorded
+                m_readContinuously = false;
+                break;
+            }
+            if(isDropped)
+            {
+                frames.dropped();
+            }
+            else
+            {
+                frames.commit(result.bytes);
+            }
+        }
+    }
+
+    // The SocketType::BusyPoll continuous read, a thread of its own receiving straight into the ring with no lock between the socket and the consumer
+    // Only the fallback once the spin budget is spent waits in poll()
+    void busyPollContinuously()
+    {
+    #ifdef __linux__
+        if(m_busyPollOptions.cpu >= 0)
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(m_busyPollOptions.cpu, &cpus);
+            ::pthread_setaffinity_np(::pthread_self(), sizeof(cpus), &cpus);
+        }
+    #endif
+        auto& frames = *m_receivedFrames;
+        auto& overflowBuffer = getRecvBuffer();
+        while(m_readContinuously.load(std::memory_order_relaxed))
+        {
+            auto frame = frames.acquire();
+            const bool isDropped = frame.data() == nullptr;
+            if(isDropped)
+            {
+                frame = std::span(overflowBuffer.data(), std::min(overflowBuffer.size(), frames.getFrameSize()));
+            }
+            const auto started = metricsClock();
+            auto result = internalReadData(frame.data(), frame.size());
+            recordMetrics(SocketMode::Read, result, 0, started);
+            if(!result)
+            {
+                if(result.timedOut)
+                {
+                    continue; // back round to check whether it should stop
+                }
+                m_readContinuously = false;
+                break;
+            }
+            if(isDropped)
+            {
+                frames.dropped();
+            }
+            else
+            {
+                frames.commit(result.bytes);
+            }
+        }
+    }
+
+#ifndef _WIN32
+    // recvmsg that never blocks, on a SocketType::BusyPoll socket it spins on an empty socket until the spin budget is spent
+    // -1 with errno EAGAIN means nothing arrived and the caller should wait for readiness
+    ssize_t busyPollReceive(int handle, msghdr& message)
+    {
+        const bool spin = m_type == SocketType::BusyPoll;
+        const auto spinUntil = spin ? std::chrono::steady_clock::now() + m_busyPollOptions.spinBudget : std::chrono::steady_clock::time_point {};
+        const msghdr request = message; // the kernel writes back the lengths, every attempt starts from the caller's
+        for(;;)
+        {
+            const ssize_t bytes = ::recvmsg(handle, &message, MSG_DONTWAIT);
+            if(bytes >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK) || !spin || std::chrono::steady_clock::now() >= spinUntil)
+            {
+                return bytes;
+            }
+            message = request;
+        }
+    }
+
+    // SO_BUSY_POLL and SO_PREFER_BUSY_POLL (Linux 5.11+) for SocketType::BusyPoll, neither is fatal, the spinning works without them
+    void applyBusyPoll(int handle)
+    {
+        m_kernelBusyPoll = false;
+    #if defined(__linux__) && defined(SO_BUSY_POLL)
+        if(m_type != SocketType::BusyPoll)
+        {
+            return;
+        }
+        const int busyPollUs = static_cast<int>(m_busyPollOptions.kernelBusyPollUs);
+        m_kernelBusyPoll = ::setsockopt(handle, SOL_SOCKET, SO_BUSY_POLL, &busyPollUs, sizeof(busyPollUs)) == 0;
+    #ifdef SO_PREFER_BUSY_POLL
+        const int preferBusyPoll = 1;
+        ::setsockopt(handle, SOL_SOCKET, SO_PREFER_BUSY_POLL, &preferBusyPoll, sizeof(preferBusyPoll));
+    #endif
+    #endif
+    }
+#endif
+
+    // Implement an internal blocking function for both modes
+    virtual SocketResult internalReadData(unsigned char* data, size_t bufferSize) = 0;
+    virtual SocketResult internalWriteData(unsigned char* data, size_t bufferSize) = 0;
+    virtual AwaitableSocketResult internalAsyncReadData(unsigned char* data, size_t bufferSize) = 0;
+    virtual AwaitableSocketResult internalAsyncWriteData(unsigned char* data, size_t bufferSize) = 0;
+    virtual SocketResult internalReadBuffers(MutableBuffers buffers) = 0;
+    virtual SocketResult internalWriteBuffers(ConstBuffers buffers) = 0;
+
+    AwaitableSocketResult checkedAsyncRead(std::span<uint8_t> data)
+    {
+        if(auto invalid = CheckIsValid(SocketMode::Read, data.data(), data.size()); invalid != SocketErrorReason::None)
+        {
+            co_return SocketResult::failed(invalid);
+        }
+        m_socketEventCallbacks.read.preEvent();
+        auto result = co_await internalAsyncReadData(data.data(), data.size());
+        m_socketEventCallbacks.read.postEvent(data.data(), result);
+        co_return result;
+    }
+
+    AwaitableSocketResult checkedAsyncWrite(std::span<uint8_t> data)
+    {
+        if(auto invalid = CheckIsValid(SocketMode::Write, data.data(), data.size()); invalid != SocketErrorReason::None)
+        {
+            co_return SocketResult::failed(invalid);
+        }
+        m_socketEventCallbacks.write.preEvent();
+        auto result = co_await internalAsyncWriteData(data.data(), data.size());
+        CheckIsComplete(result, data.size());
+        m_socketEventCallbacks.write.postEvent(data.data(), result);
+        co_return result;
+    }
+
+    // A default time point when metrics are off, which recordMetrics() then skips
+    SocketMetrics::Clock::time_point metricsClock() const
+    {
+        return m_metricsEnabled.load(std::memory_order_acquire) ? SocketMetrics::Clock::now() : SocketMetrics::Clock::time_point {};
+    }
+
+    // Only called with a time from metricsClock(), by then the metrics are allocated and stay so for the socket's lifetime
+    SocketMetrics::Direction& metricsDirection(SocketMode mode)
+    {
+        auto& metrics = *m_metrics.load(std::memory_order_acquire);
+        return mode == SocketMode::Write ? metrics.write : metrics.read;
+    }
+
+    // expectedBytes is what a write asked for, 0 for reads
+    void recordMetrics(SocketMode mode, const SocketResult& result, size_t expectedBytes, SocketMetrics::Clock::time_point started)
+    {
+        if(started != SocketMetrics::Clock::time_point {})
+        {
+            metricsDirection(mode).record(result.success, result.timedOut, result.bytes, expectedBytes, SocketMetrics::Clock::now() - started);
+        }
+    }
+
+    // Turns the error from a completed async operation into a success flag
+    bool CheckAsyncResult(const boost::system::error_code& asyncError)
+    {
+        return CheckError(asyncError);
+    }
+
+    // As above, also handing the error back in the result
+    bool CheckAsyncResult(SocketResult& result, const boost::system::error_code& asyncError)
+    {
+        return CheckForError(result, [&asyncError](boost::system::error_code& err)
+        {
+            err = asyncError;
+        });
+    }
+
+    // A short write the transport didn't report as an error, success is left as the transport set it
+    void CheckIsComplete(SocketResult& result, size_t expectedBytes)
+    {
+        if(result.bytes != expectedBytes && result.reason == SocketErrorReason::None)
+        {
+            result.reason = SocketErrorReason::PartialWrite;
+            setLastError({ SocketErrorReason::PartialWrite, {}, expectedBytes, result.bytes });
+        }
+    }
+
+    // A deadline keeps the operation off the ring, whose timeouts are per socket
+    // An operation that may not wait returns NotReady() before anything happens rather than wait for the socket
+    SocketResult checkedReadData(unsigned char* data, size_t bufferSize, Deadline deadline = {}, bool mayWait = true)
+    {
+        std::lock_guard lock(m_readMutex);
+        if(auto invalid = CheckIsValid(SocketMode::Read, data, bufferSize); invalid != SocketErrorReason::None)
+        {
+            return SocketResult::failed(invalid);
+        }
+        if(!mayWait && !isReady(SocketMode::Read))
+        {
+            return NotReady();
+        }
+        m_socketEventCallbacks.read.preEvent();
+        const auto started = metricsClock();
+        m_readDeadline = deadline;
+        auto result = useRing() && deadline == Deadline {} ? ringTransfer(SocketMode::Read, boost::asio::buffer(data, bufferSize)) : internalReadData(data, bufferSize);
+        m_readDeadline = {};
+        recordMetrics(SocketMode::Read, result, 0, started);
+        m_socketEventCallbacks.read.postEvent(data, result);
+        return result;
+    }
+    SocketResult checkedWriteData(unsigned char* data, size_t bufferSize, Deadline deadline = {}, bool mayWait = true)
+    {
+        std::lock_guard lock(m_writeMutex);
+        if(auto invalid = CheckIsValid(SocketMode::Write, data, bufferSize); invalid != SocketErrorReason::None)
+        {
+            return SocketResult::failed(invalid);
+        }
+        if(!mayWait && !isReady(SocketMode::Write))
+        {
+            return NotReady();
+        }
+        m_socketEventCallbacks.write.preEvent();
+        const auto started = metricsClock();
+        m_writeDeadline = deadline;
+        SocketResult result = useRing() && deadline == Deadline {} ? ringTransfer(SocketMode::Write, boost::asio::buffer(data, bufferSize)) : internalWriteData(data, bufferSize);
+        m_writeDeadline = {};
+        recordMetrics(SocketMode::Write, result, bufferSize, started);
+        CheckIsComplete(result, bufferSize);
+        m_socketEventCallbacks.write.postEvent(data, result);
+        return result;
+    }
+    SocketResult checkedReadBuffers(MutableBuffers buffers, Deadline deadline = {}, bool mayWait = true)
+    {
+        std::lock_guard lock(m_readMutex);
+        if(auto invalid = CheckIsValid(SocketMode::Read, buffers); invalid != SocketErrorReason::None)
+        {
+            return SocketResult::failed(invalid);
+        }
+        if(!mayWait && !isReady(SocketMode::Read))
+        {
+            return NotReady();
+        }
+        auto* data = static_cast<unsigned char*>(buffers.front().data());
+        m_socketEventCallbacks.read.preEvent();
+        const auto started = metricsClock();
+        m_readDeadline = deadline;
+        auto result = useRing() && deadline == Deadline {} ? ringTransfer(SocketMode::Read, buffers) : internalReadBuffers(buffers);
+        m_readDeadline = {};
+        recordMetrics(SocketMode::Read, result, 0, started);
+        m_socketEventCallbacks.read.postEvent(data, result);
+        return result;
+    }
+    SocketResult checkedWriteBuffers(ConstBuffers buffers, Deadline deadline = {}, bool mayWait = true)
+    {
+        std::lock_guard lock(m_writeMutex);
+        if(auto invalid = CheckIsValid(SocketMode::Write, buffers); invalid != SocketErrorReason::None)
+        {
+            return SocketResult::failed(invalid);
+        }
+        if(!mayWait && !isReady(SocketMode::Write))
+        {
+            return NotReady();
+        }
+        auto* data = static_cast<unsigned char*>(const_cast<void*>(buffers.front().data()));
+        const size_t bufferSize = boost::asio::buffer_size(buffers);
+        m_socketEventCallbacks.write.preEvent();
+        const auto started = metricsClock();
+        m_writeDeadline = deadline;
+        SocketResult result = useRing() && deadline == Deadline {} ? ringTransfer(SocketMode::Write, buffers) : internalWriteBuffers(buffers);
+        m_writeDeadline = {};
+        recordMetrics(SocketMode::Write, result, bufferSize, started);
+        CheckIsComplete(result, bufferSize);
+        m_socketEventCallbacks.write.postEvent(data, result);
+        return result;
+    }
+
+    // What a synchronous wait is bounded by, the deadline of a deadline overload while one runs in that direction, otherwise m_timeoutMs from now
+    Deadline operationDeadline(SocketMode mode) const
+    {
+        return hasOperationDeadline(mode) ? getOperationDeadline(mode) : ReadinessWaiter::DeadlineAfter(m_timeoutMs);
+    }
+
+    bool hasOperationDeadline(SocketMode mode) const
+    {
+        return getOperationDeadline(mode) != Deadline {};
+    }
+
+    Deadline getOperationDeadline(SocketMode mode) const
+    {
+        return mode == SocketMode::Read ? m_readDeadline : m_writeDeadline;
+    }
+
+    bool useRing()
+    {
+    #ifdef HAS_IO_URING
+        return m_ioBackend.load(std::memory_order_relaxed) == IOBackend::IoUring && getRingHandle() >= 0 && IoUring::threadRing().isOpen();
+    #else
+        return false;
+    #endif
+    }
+
+    // One read or write through the calling thread's io_uring, a write carries on until every byte has gone
+    template<typename Buffers>
+    SocketResult ringTransfer(SocketMode mode, const Buffers& buffers)
+    {
+        SocketResult result {};
+    #ifdef HAS_IO_URING
+        std::array<iovec, MaxBufferCount> vectors;
+        size_t count = 0;
+        size_t expectedBytes = 0;
+        for(auto buffer = boost::asio::buffer_sequence_begin(buffers); buffer != boost::asio::buffer_sequence_end(buffers); ++buffer)
+        {
+            vectors[count++] = { const_cast<void*>(static_cast<const void*>(buffer->data())), buffer->size() };
+            expectedBytes += buffer->size();
+        }
+        IoUringOperation operation;
+        operation.message.msg_iov = vectors.data();
+        operation.message.msg_iovlen = count;
+        beginRingOperation(mode, operation);
+        const bool read = mode == SocketMode::Read;
+        const uint32_t timeoutMs = read ? getRingTimeoutMs() : 0;
+        auto& ring = IoUring::threadRing();
+        int transferred = 0;
+        for(;;)
+        {
+            // a read without a timeout still wakes now and then, closing the socket doesn't cancel what the ring holds
+            transferred = ring.transfer(read, getRingHandle(), operation, read && timeoutMs == 0 ? RingCloseCheckMs : timeoutMs);
+            if(transferred == -ECANCELED && read && timeoutMs == 0 && isOpen())
+            {
+                continue;
+            }
+            if(transferred <= 0 || read || result.bytes + transferred == expectedBytes)
+            {
+                break;
+            }
+            // a stream took part of the write, carry on from where it stopped
+            result.bytes += transferred;
+            AdvanceVectors(operation.message, static_cast<size_t>(transferred));
+        }
+        ringCompleted(mode, operation, transferred, result);
+    #endif
+        return result;
+    }
+
+#ifdef HAS_IO_URING
+    static constexpr uint32_t RingCloseCheckMs = 100;
+
+    // Turns a ring completion into the result, transferred is bytes or -errno and adds to whatever result already holds
+    void ringCompleted(SocketMode mode, IoUringOperation& operation, int transferred, SocketResult& result)
+    {
+        CheckForError(result, [&](boost::system::error_code& err)
+        {
+            if(transferred == -ECANCELED)
+            {
+                // reads are cancelled by their timeout or by close(), writes when an earlier one linked to them came up short
+                result.timedOut = mode == SocketMode::Read && isOpen();
+                err = result.timedOut ? boost::asio::error::timed_out : boost::asio::error::operation_aborted;
+                return;
+            }
+            if(transferred < 0)
+            {
+                err = boost::system::error_code(-transferred, boost::asio::error::get_system_category());
+                return;
+            }
+            result.bytes += static_cast<size_t>(transferred);
+            endRingOperation(mode, operation, result, err);
+        });
+    }
+
+    static void AdvanceVectors(msghdr& message, size_t bytes)
+    {
+        while(bytes > 0 && message.msg_iovlen > 0)
+        {
+            auto& vector = message.msg_iov[0];
+            const size_t taken = std::min(bytes, vector.iov_len);
+            vector.iov_base = static_cast<char*>(vector.iov_base) + taken;
+            vector.iov_len -= taken;
+            bytes -= taken;
+            if(vector.iov_len == 0)
+            {
+                ++message.msg_iov;
+                --message.msg_iovlen;
+            }
+        }
+    }
+
+    // io_uring backend hooks, a transport that can't go through the ring keeps the default handle of -1 and stays on the reactor
+    virtual int getRingHandle()
+    {
+        return -1;
+    }
+
+    // Called with the direction's lock held before the operation is queued, msg_iov already holds the buffers
+    virtual void beginRingOperation([[maybe_unused]] SocketMode mode, [[maybe_unused]] IoUringOperation& operation)
+    {
+    }
+
+    // Called once the operation has completed without an error, err fails it
+    virtual void endRingOperation([[maybe_unused]] SocketMode mode, [[maybe_unused]] IoUringOperation& operation, [[maybe_unused]] SocketResult& result, [[maybe_unused]] boost::system::error_code& err)
+    {
+    }
+
+    // 0 waits for as long as it takes
+    virtual uint32_t getRingTimeoutMs() const
+    {
+        return m_timeoutMs;
+    }
+#endif
+
+    // SocketErrorReason::None when the operation can go ahead, otherwise the reason is also the last error
+    template<typename Buffers>
+    SocketErrorReason CheckIsValid(SocketMode expectedMode, Buffers buffers)
+    {
+        auto* data = buffers.empty() ? nullptr : static_cast<unsigned char*>(const_cast<void*>(buffers.front().data()));
+        if(auto invalid = CheckIsValid(expectedMode, data, boost::asio::buffer_size(buffers)); invalid != SocketErrorReason::None)
+        {
+            return invalid;
+        }
+        if(buffers.size() > MaxBufferCount)
+        {
+            setLastError({ SocketErrorReason::TooManyBuffers, {}, MaxBufferCount, buffers.size() });
+            return SocketErrorReason::TooManyBuffers;
+        }
+        return SocketErrorReason::None;
+    }
+
+    SocketErrorReason CheckIsValid(SocketMode expectedMode, unsigned char* data, size_t bufferSize)
+    {
+        SocketError invalid;
+        if (!m_initialised)
+        {
+            invalid = { SocketErrorReason::NotInitialised };
+        }
+        else if(m_mode != SocketMode::ReadWrite && expectedMode != m_mode)
+        {
+            invalid = { SocketErrorReason::WrongMode, {}, static_cast<size_t>(expectedMode), static_cast<size_t>(m_mode) };
+        }
+        else if(!data)
+        {
+            invalid = { SocketErrorReason::NoBuffer };
+        }
+        else if(!bufferSize)
+        {
+            invalid = { SocketErrorReason::NoBufferSize };
+        }
+        if(invalid)
+        {
+            setLastError(invalid);
+        }
+        return invalid.reason;
+    }
+    std::atomic_bool m_initialised = false;
     std::string m_address;
     uint16_t m_port;
     uint32_t m_timeoutMs;
     uint32_t m_byteIntervalMs;
     std::future<void> m_socketFuture;
-    std::mutex m_socketMutex;
+    std::mutex m_socketMutex; // open/close, which also take both direction mutexes
+    std::mutex m_readMutex; // reads and writes are serialised independently so ReadWrite sockets are full-duplex
+    std::mutex m_writeMutex;
+    std::mutex m_waitingMutex;
+    std::shared_ptr<WaitingOperations> m_waitingReads; // non-blocking operations waiting for readiness on the event loop, see getWaitingOperations()
+    std::shared_ptr<WaitingOperations> m_waitingWrites;
+    Deadline m_readDeadline {}; // set by a deadline overload for the length of its operation, under the direction's mutex
+    Deadline m_writeDeadline {};
     std::atomic_bool m_readContinuously = false;
+    std::unique_ptr<FrameRing> m_receivedFrames;
+    std::future<void> m_continuousRead;
     SocketMode m_mode = SocketMode::Read;
     SocketType m_type = SocketType::Blocking;
     SocketRole m_role = SocketRole::Client;
     SocketEventCallbacks m_socketEventCallbacks {};
+    std::unique_ptr<SocketMetrics> m_metricsStorage; // allocated by the first enableMetrics() and kept until the socket goes
+    std::atomic<SocketMetrics*> m_metrics = nullptr; // m_metricsStorage once allocated, what operations and snapshots read
+    std::once_flag m_metricsAllocated;
+    std::atomic_bool m_metricsEnabled = false;
+    std::atomic<IOBackend> m_ioBackend = IOBackend::Reactor;
+    BusyPollOptions m_busyPollOptions {};
+    std::atomic_bool m_kernelBusyPoll = false;
     
     // Boost - general
     // sockets and endpoints should be per-type udp::socket for UDPSocket type
-    io_service m_ioService;
+    // the event loop the socket's asio objects live on, the SocketExecutor's shared io_context unless a SocketGroup moved it
+    io_context* m_ioContext;
 };
@@ -0,0 +1,315 @@
+//
+//          Created by Riki Lowe on 17/09/2024.
+//
+//              Copyright Riki Lowe 2024
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+// The header alone isn't enough, the ring uses io_uring_probe and IORING_REGISTER_PROBE from Linux 5.6
+// IORING_OP_* and IORING_REGISTER_* are enumerators, so the check is on IO_URING_OP_SUPPORTED, a macro that came with them
+// Older headers leave the sockets on the reactor
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#ifdef IO_URING_OP_SUPPORTED
+#define HAS_IO_URING 1
+#endif
+#endif
+
+#ifdef HAS_IO_URING
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// One read or write queued on an IoUring, it must stay where it is until the operation completes
+// message.msg_iov always describes the buffers, msg_name and msg_control are only used by recvmsg/sendmsg
+struct IoUringOperation
+{
+    msghdr message {};
+    sockaddr_storage address {};
+    alignas(cmsghdr) std::array<char, 64> control {};
+    bool useMessage = false; // recvmsg/sendmsg rather than readv/writev, sockets always want this for MSG_NOSIGNAL
+    __kernel_timespec timeout {};
+};
+
+// Submission and completion rings driven straight through the io_uring syscalls, asio only gained an io_uring backend in boost 1.78
+// Everything queued goes to the kernel in one io_uring_enter, which also waits for the completions
+// Not thread-safe, every thread that wants one has its own (threadRing())
+class IoUring
+{
+public:
+    static constexpr unsigned DefaultEntries = 256;
+
+    explicit IoUring(unsigned entries = DefaultEntries)
+    {
+        io_uring_params params {};
+        m_handle = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if(m_handle < 0)
+        {
+            return;
+        }
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if(singleMap)
+        {
+            m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        }
+        m_sqRing = MapRing(m_handle, m_sqRingSize, IORING_OFF_SQ_RING);
+        m_cqRing = singleMap ? m_sqRing : MapRing(m_handle, m_cqRingSize, IORING_OFF_CQ_RING);
+        m_sqeSize = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = static_cast<io_uring_sqe*>(MapRing(m_handle, m_sqeSize, IORING_OFF_SQES));
+        if(!m_sqRing || !m_cqRing || !m_sqes)
+        {
+            release();
+            return;
+        }
+        auto* sq = static_cast<char*>(m_sqRing);
+        auto* cq = static_cast<char*>(m_cqRing);
+        m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        m_entries = params.sq_entries;
+        m_queuedTail = *m_sqTail;
+        m_submittedTail = m_queuedTail;
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    ~IoUring()
+    {
+        release();
+    }
+
+    // Whether this kernel has every operation the sockets need (Linux 5.6+), and nothing like seccomp is in the way
+    static bool isSupported()
+    {
+        static const bool supported = []()
+        {
+            IoUring ring(8);
+            if(!ring.isOpen())
+            {
+                return false;
+            }
+            alignas(io_uring_probe) std::array<uint8_t, sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op)> storage {};
+            auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+            if(::syscall(__NR_io_uring_register, ring.m_handle, IORING_REGISTER_PROBE, probe, 256) < 0)
+            {
+                return false;
+            }
+            for(uint8_t opcode : { IORING_OP_READV, IORING_OP_WRITEV, IORING_OP_RECVMSG, IORING_OP_SENDMSG, IORING_OP_LINK_TIMEOUT })
+            {
+                if(opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }();
+        return supported;
+    }
+
+    // The calling thread's ring, created the first time it is asked for. Check isOpen(), creating it can fail (RLIMIT_MEMLOCK on older kernels)
+    static IoUring& threadRing()
+    {
+        thread_local IoUring ring;
+        return ring;
+    }
+
+    bool isOpen() const
+    {
+        return m_handle >= 0;
+    }
+
+    unsigned getEntries() const
+    {
+        return m_entries;
+    }
+
+    // Submission queue entries not yet queued on
+    unsigned getFreeEntries() const
+    {
+        return isOpen() ? m_entries - (m_queuedTail - std::atomic_ref(*m_sqHead).load(std::memory_order_acquire)) : 0;
+    }
+
+    // A read or write, followed by a linked timeout when timeoutMs isn't 0, which cancels it with -ECANCELED
+    // linkNext holds the next operation queued back until this one completes in full, otherwise it is cancelled
+    // False when the submission queue is full, submitAndWait() empties it
+    bool queue(bool read, int handle, IoUringOperation& operation, uint64_t userData, uint32_t timeoutMs = 0, bool linkNext = false)
+    {
+        if(!isOpen() || getFreeEntries() < (timeoutMs ? 2u : 1u))
+        {
+            return false;
+        }
+        io_uring_sqe* sqe = nextSqe();
+        sqe->fd = handle;
+        sqe->user_data = userData;
+        if(operation.useMessage)
+        {
+            sqe->opcode = read ? IORING_OP_RECVMSG : IORING_OP_SENDMSG;
+            sqe->addr = reinterpret_cast<uint64_t>(&operation.message);
+            sqe->len = 1;
+            sqe->msg_flags = read ? 0 : MSG_NOSIGNAL;
+        }
+        else
+        {
+            sqe->opcode = read ? IORING_OP_READV : IORING_OP_WRITEV;
+            sqe->addr = reinterpret_cast<uint64_t>(operation.message.msg_iov);
+            sqe->len = static_cast<uint32_t>(operation.message.msg_iovlen);
+            sqe->off = std::numeric_limits<uint64_t>::max(); // the current position, all there is on sockets and ttys
+        }
+        sqe->flags = timeoutMs || linkNext ? IOSQE_IO_LINK : 0;
+        ++m_pendingCompletions;
+        if(timeoutMs)
+        {
+            operation.timeout.tv_sec = timeoutMs / 1000;
+            operation.timeout.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+            io_uring_sqe* timeout = nextSqe();
+            timeout->opcode = IORING_OP_LINK_TIMEOUT;
+            timeout->fd = -1;
+            timeout->addr = reinterpret_cast<uint64_t>(&operation.timeout);
+            timeout->len = 1;
+            timeout->user_data = TimeoutTag;
+            ++m_pendingCompletions;
+        }
+        return true;
+    }
+
+    // Hands everything queued to the kernel and waits until all of it has completed, one io_uring_enter when it all completes inline
+    // onCompletion(userData, result) is called for every operation, the result is bytes transferred or -errno
+    // Returns 0, or -errno when the ring itself failed. It is closed then, whatever was still queued on it is dropped
+    // and isOpen() sends callers back to the reactor
+    template<typename Handler>
+    int submitAndWait(Handler&& onCompletion)
+    {
+        if(!isOpen())
+        {
+            return -EBADF;
+        }
+        std::atomic_ref(*m_sqTail).store(m_queuedTail, std::memory_order_release);
+        while(m_pendingCompletions > 0)
+        {
+            const unsigned toSubmit = m_queuedTail - m_submittedTail;
+            const long submitted = ::syscall(__NR_io_uring_enter, m_handle, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if(submitted < 0 && errno != EINTR && errno != EBUSY) // EBUSY is a full completion queue, which the drain below empties
+            {
+                const int error = errno;
+                // closing the ring cancels whatever the kernel still has, the counts would otherwise wait on it forever
+                release();
+                m_queuedTail = m_submittedTail = 0;
+                m_pendingCompletions = 0;
+                return -error;
+            }
+            m_submittedTail += submitted > 0 ? static_cast<unsigned>(submitted) : 0;
+            unsigned head = *m_cqHead;
+            const unsigned tail = std::atomic_ref(*m_cqTail).load(std::memory_order_acquire);
+            for(; head != tail; ++head)
+            {
+                const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+                --m_pendingCompletions;
+                if(cqe.user_data != TimeoutTag)
+                {
+                    onCompletion(cqe.user_data, cqe.res);
+                }
+            }
+            std::atomic_ref(*m_cqHead).store(head, std::memory_order_release);
+        }
+        return 0;
+    }
+
+    // One operation start to finish, bytes transferred or -errno
+    int transfer(bool read, int handle, IoUringOperation& operation, uint32_t timeoutMs)
+    {
+        int transferred = -EBUSY;
+        if(!queue(read, handle, operation, 0, timeoutMs))
+        {
+            return transferred;
+        }
+        const int failed = submitAndWait([&transferred](uint64_t, int result)
+        {
+            transferred = result;
+        });
+        return failed ? failed : transferred;
+    }
+
+private:
+    static constexpr uint64_t TimeoutTag = std::numeric_limits<uint64_t>::max();
+
+    static void* MapRing(int handle, size_t size, off_t offset)
+    {
+        void* mapped = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, handle, offset);
+        return mapped == MAP_FAILED ? nullptr : mapped;
+    }
+
+    io_uring_sqe* nextSqe()
+    {
+        const unsigned index = m_queuedTail & m_sqMask;
+        io_uring_sqe* sqe = &m_sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        m_sqArray[index] = index;
+        ++m_queuedTail;
+        return sqe;
+    }
+
+    void release()
+    {
+        if(m_sqes)
+        {
+            ::munmap(m_sqes, m_sqeSize);
+        }
+        if(m_cqRing && m_cqRing != m_sqRing)
+        {
+            ::munmap(m_cqRing, m_cqRingSize);
+        }
+        if(m_sqRing)
+        {
+            ::munmap(m_sqRing, m_sqRingSize);
+        }
+        m_sqes = nullptr;
+        m_sqRing = m_cqRing = nullptr;
+        if(m_handle >= 0)
+        {
+            ::close(m_handle);
+            m_handle = -1;
+        }
+    }
+
+    int m_handle = -1;
+    unsigned m_entries = 0;
+    void* m_sqRing = nullptr;
+    void* m_cqRing = nullptr;
+    size_t m_sqRingSize = 0;
+    size_t m_cqRingSize = 0;
+    size_t m_sqeSize = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned* m_sqArray = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+    unsigned m_queuedTail = 0; // entries written but not yet published to the kernel
+    unsigned m_submittedTail = 0;
+    size_t m_pendingCompletions = 0;
+};
+
+#endif
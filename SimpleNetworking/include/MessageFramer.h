@@ -0,0 +1,219 @@
+//
+//          Created by Riki Lowe on 17/09/2024.
+//
+//              Copyright Riki Lowe 2024
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include "ISocket.h"
+#include "Serialization.h"
+
+#include <string_view>
+#include <array>
+#include <algorithm>
+#include <cstring>
+
+// Reassembles whole messages from the arbitrary fragments a stream transport (TCP, serial) hands back
+// Every message is preceded by its big-endian length (LengthPrefix), or followed by a delimiter
+// The socket reads straight into the framer's buffer and complete messages are delivered as views into it, so nothing is copied
+// One read can carry any number of small messages, they are all delivered before the next read
+// Only the tail of a partial message is ever moved, back to the front of the buffer when the free space runs low
+class MessageFramer : public ErrorHandler
+{
+public:
+    enum class Mode
+    {
+        LengthPrefixed,
+        Delimited
+    };
+
+    static constexpr size_t DefaultCapacity = 64 * 1024;
+
+    explicit MessageFramer(LengthPrefix prefix, size_t capacity = DefaultCapacity)
+        : m_mode(Mode::LengthPrefixed), m_prefixBytes(static_cast<size_t>(prefix)), m_buffer(capacity)
+    {
+    }
+
+    // The delimiter ends every message and is not part of the delivered view
+    explicit MessageFramer(std::string_view delimiter, size_t capacity = DefaultCapacity)
+        : m_mode(Mode::Delimited), m_delimiter(delimiter.begin(), delimiter.end()), m_buffer(capacity)
+    {
+        assert(!m_delimiter.empty());
+    }
+
+    MessageFramer(const MessageFramer&) = delete;
+    MessageFramer& operator=(const MessageFramer&) = delete;
+
+    // Free space to read into, never empty since commit() drops a message that has outgrown the buffer
+    std::span<uint8_t> prepare()
+    {
+        if(m_begin == m_end)
+        {
+            reset();
+        }
+        // leave room for a decent sized read rather than trickling into the last few bytes
+        else if(m_begin > 0 && m_buffer.size() - m_end < m_buffer.size() / 4)
+        {
+            std::memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+            m_scanned -= m_begin;
+            m_end -= m_begin;
+            m_begin = 0;
+        }
+        return std::span(m_buffer).subspan(m_end);
+    }
+
+    // Takes bytes read into prepare() and calls onMessage(std::span<const uint8_t>) for every message they complete
+    // The views are only valid until the next prepare(), returns how many messages were delivered
+    template<typename Handler>
+    size_t commit(size_t bytes, Handler&& onMessage)
+    {
+        assert(m_end + bytes <= m_buffer.size());
+        m_end += bytes;
+        size_t messages = 0;
+        for(auto message = nextMessage(); message.data(); message = nextMessage())
+        {
+            onMessage(std::span<const uint8_t>(message));
+            ++messages;
+        }
+        if(m_oversized || (m_begin == 0 && m_end == m_buffer.size()))
+        {
+            setLastError({ SocketErrorReason::FramingBufferOverflow, {}, m_buffer.size() });
+            reset(); // the stream can't be resynchronised from here, whoever owns it should close it
+        }
+        return messages;
+    }
+
+    // One read from the socket, followed by every message it completed
+    template<typename Handler>
+    SocketResult receive(ISocket& socket, Handler&& onMessage)
+    {
+        auto space = prepare();
+        auto result = socket.readData(space.data(), space.size()).get();
+        if(result)
+        {
+            commit(result.bytes, std::forward<Handler>(onMessage));
+        }
+        return result;
+    }
+
+    template<typename Handler>
+    ISocket::AwaitableSocketResult asyncReceive(ISocket& socket, Handler onMessage)
+    {
+        auto result = co_await socket.asyncRead(prepare());
+        if(result)
+        {
+            commit(result.bytes, onMessage);
+        }
+        co_return result;
+    }
+
+    // Frames and writes one message as a gather write, the payload isn't copied
+    // Waits for the write to finish since the framing bytes live on this stack frame
+    SocketResult writeMessage(ISocket& socket, std::span<const uint8_t> message)
+    {
+        std::array<uint8_t, sizeof(uint64_t)> prefix {};
+        std::array<boost::asio::const_buffer, 2> buffers;
+        if(m_mode == Mode::LengthPrefixed)
+        {
+            if(m_prefixBytes < sizeof(uint64_t) && message.size() >> (m_prefixBytes * 8) != 0)
+            {
+                setLastError({ SocketErrorReason::LengthPrefixOverflow, {}, m_prefixBytes, message.size() });
+                return SocketResult::failed(SocketErrorReason::LengthPrefixOverflow);
+            }
+            for(size_t i = 0; i < m_prefixBytes; ++i)
+            {
+                prefix[i] = static_cast<uint8_t>(message.size() >> ((m_prefixBytes - i - 1) * 8));
+            }
+            buffers = { boost::asio::buffer(prefix.data(), m_prefixBytes), boost::asio::buffer(message.data(), message.size()) };
+        }
+        else
+        {
+            buffers = { boost::asio::buffer(message.data(), message.size()), boost::asio::buffer(m_delimiter) };
+        }
+        // an empty message still has its framing bytes to send
+        auto bufferSpan = std::span<const boost::asio::const_buffer>(buffers);
+        return socket.writeData(message.empty() ? bufferSpan.subspan(m_mode == Mode::LengthPrefixed ? 0 : 1, 1) : bufferSpan).get();
+    }
+
+    // Drops any partial message, for when the stream is reconnected
+    void reset()
+    {
+        m_begin = 0;
+        m_end = 0;
+        m_scanned = 0;
+        m_oversized = false;
+    }
+
+    // Bytes of the next, still incomplete, message
+    size_t getPendingBytes() const
+    {
+        return m_end - m_begin;
+    }
+
+    size_t getCapacity() const
+    {
+        return m_buffer.size();
+    }
+
+    Mode getMode() const
+    {
+        return m_mode;
+    }
+
+private:
+    // A view of the next complete message, or one with a null data() when there isn't one yet
+    std::span<uint8_t> nextMessage()
+    {
+        const size_t available = m_end - m_begin;
+        if(m_mode == Mode::LengthPrefixed)
+        {
+            if(available < m_prefixBytes)
+            {
+                return {};
+            }
+            uint64_t length = 0;
+            for(size_t i = 0; i < m_prefixBytes; ++i)
+            {
+                length = length << 8 | m_buffer[m_begin + i];
+            }
+            if(length > m_buffer.size() - m_prefixBytes)
+            {
+                m_oversized = true;
+                return {};
+            }
+            if(available - m_prefixBytes < length)
+            {
+                return {};
+            }
+            auto message = std::span(m_buffer).subspan(m_begin + m_prefixBytes, length);
+            m_begin += m_prefixBytes + length;
+            m_scanned = m_begin;
+            return message;
+        }
+        // resume the search where the last one gave up, less a delimiter that may have been split across reads
+        const size_t searchFrom = std::max(m_begin, m_scanned >= m_delimiter.size() ? m_scanned - (m_delimiter.size() - 1) : 0);
+        auto found = std::search(m_buffer.begin() + searchFrom, m_buffer.begin() + m_end, m_delimiter.begin(), m_delimiter.end());
+        if(found == m_buffer.begin() + m_end)
+        {
+            m_scanned = m_end;
+            return {};
+        }
+        const size_t delimiterAt = found - m_buffer.begin();
+        auto message = std::span(m_buffer).subspan(m_begin, delimiterAt - m_begin);
+        m_begin = delimiterAt + m_delimiter.size();
+        m_scanned = m_begin;
+        return message;
+    }
+
+    Mode m_mode;
+    size_t m_prefixBytes = 0;
+    std::vector<uint8_t> m_delimiter;
+    std::vector<uint8_t> m_buffer;
+    size_t m_begin = 0; // start of the first unparsed byte
+    size_t m_end = 0; // end of the bytes read so far
+    size_t m_scanned = 0; // delimited mode, how far the search for the next delimiter got
+    bool m_oversized = false; // length-prefixed mode, the next message can never fit
+};
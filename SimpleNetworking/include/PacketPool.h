@@ -0,0 +1,330 @@
+//
+//          Created by Riki Lowe on 17/09/2024.
+//
+//              Copyright Riki Lowe 2024
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <vector>
+
+class PacketPool;
+
+// Lives at the start of every slot, ahead of the packet bytes
+struct PacketHeader
+{
+    std::atomic<uint32_t> refCount = 0;
+    std::atomic<uint32_t> nextFree = 0; // index of the next slot on the free list
+    uint32_t index = 0;
+    size_t size = 0; // bytes in use, at most the pool's packet size
+    PacketPool* pool = nullptr;
+};
+
+// Intrusive reference counted handle to a pooled packet
+// Copies share the packet, it goes back to its pool when the last handle is released
+class PacketBuffer
+{
+public:
+    PacketBuffer() = default;
+
+    PacketBuffer(const PacketBuffer& other)
+        : m_header(other.m_header)
+    {
+        if(m_header)
+        {
+            m_header->refCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    PacketBuffer(PacketBuffer&& other) noexcept
+        : m_header(other.m_header)
+    {
+        other.m_header = nullptr;
+    }
+
+    PacketBuffer& operator=(PacketBuffer other) noexcept
+    {
+        std::swap(m_header, other.m_header);
+        return *this;
+    }
+
+    ~PacketBuffer()
+    {
+        reset();
+    }
+
+    inline void reset();
+
+    explicit operator bool() const
+    {
+        return m_header != nullptr;
+    }
+
+    uint8_t* data() const
+    {
+        return m_header ? reinterpret_cast<uint8_t*>(m_header + 1) : nullptr;
+    }
+
+    size_t size() const
+    {
+        return m_header ? m_header->size : 0;
+    }
+
+    inline size_t capacity() const;
+
+    void resize(size_t size)
+    {
+        assert(size <= capacity());
+        if(m_header)
+        {
+            m_header->size = size;
+        }
+    }
+
+    std::span<uint8_t> span() const
+    {
+        return { data(), size() };
+    }
+
+    uint32_t useCount() const
+    {
+        return m_header ? m_header->refCount.load(std::memory_order_relaxed) : 0;
+    }
+
+private:
+    friend class PacketPool;
+
+    explicit PacketBuffer(PacketHeader* header)
+        : m_header(header)
+    {
+    }
+
+    PacketHeader* m_header = nullptr;
+};
+
+struct PacketPoolStats
+{
+    size_t packetSize;
+    size_t capacity; // packets across every slab allocated so far
+    size_t inUse;
+    size_t highWaterMark; // most packets in use at once
+    size_t allocations;
+    size_t failedAllocations; // the pool was at maxSlabs and nothing was free
+    size_t slabs;
+};
+
+// Slab allocator for fixed size packets
+// Slabs are only allocated when the free list runs dry and are kept until the pool goes, so steady state allocate/release never touches malloc
+// The free list is a lock-free stack, packets can be released on any thread
+// The pool must outlive every packet taken from it
+class PacketPool
+{
+public:
+    static constexpr size_t DefaultPacketsPerSlab = 256;
+    static constexpr size_t DefaultMaxSlabs = 64;
+    static constexpr size_t SlotAlignment = 64;
+
+    PacketPool(size_t packetSize, size_t packetsPerSlab = DefaultPacketsPerSlab, size_t maxSlabs = DefaultMaxSlabs)
+        : m_packetSize(packetSize),
+          m_packetsPerSlab(std::max<size_t>(packetsPerSlab, 1)),
+          m_slotSize((sizeof(PacketHeader) + packetSize + SlotAlignment - 1) / SlotAlignment * SlotAlignment),
+          m_maxSlabs(std::max<size_t>(maxSlabs, 1))
+    {
+        m_slabs.resize(m_maxSlabs); // never reallocates, so slot() can read it while another thread grows the pool
+        std::lock_guard lock(m_growMutex);
+        addSlab();
+    }
+
+    PacketPool(const PacketPool&) = delete;
+    PacketPool& operator=(const PacketPool&) = delete;
+
+    ~PacketPool()
+    {
+        assert(m_inUse.load() == 0 && "PacketPool destroyed with packets still in use");
+    }
+
+    // An empty PacketBuffer when the pool is exhausted
+    PacketBuffer allocate()
+    {
+        PacketHeader* header = popFree();
+        if(!header)
+        {
+            {
+                std::lock_guard lock(m_growMutex);
+                header = popFree(); // somebody else may have grown it already
+                if(!header && m_slabCount.load(std::memory_order_relaxed) < m_maxSlabs)
+                {
+                    addSlab();
+                    header = popFree();
+                }
+            }
+            if(!header)
+            {
+                m_failedAllocations.fetch_add(1, std::memory_order_relaxed);
+                return {};
+            }
+        }
+        header->refCount.store(1, std::memory_order_relaxed);
+        header->size = 0;
+        m_allocations.fetch_add(1, std::memory_order_relaxed);
+        const size_t inUse = m_inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+        size_t highWaterMark = m_highWaterMark.load(std::memory_order_relaxed);
+        while(inUse > highWaterMark && !m_highWaterMark.compare_exchange_weak(highWaterMark, inUse, std::memory_order_relaxed))
+        {
+        }
+        return PacketBuffer(header);
+    }
+
+    // Copies data into a fresh packet, for producers that don't receive straight into one
+    // An empty PacketBuffer when the pool is exhausted or data doesn't fit in a packet
+    PacketBuffer allocate(std::span<const uint8_t> data)
+    {
+        if(data.size() > m_packetSize)
+        {
+            return {};
+        }
+        auto packet = allocate();
+        if(packet)
+        {
+            std::memcpy(packet.data(), data.data(), data.size());
+            packet.resize(data.size());
+        }
+        return packet;
+    }
+
+    size_t getPacketSize() const
+    {
+        return m_packetSize;
+    }
+
+    PacketPoolStats getStats() const
+    {
+        const size_t slabs = m_slabCount.load(std::memory_order_acquire);
+        return PacketPoolStats
+        {
+            m_packetSize,
+            slabs * m_packetsPerSlab,
+            m_inUse.load(std::memory_order_relaxed),
+            m_highWaterMark.load(std::memory_order_relaxed),
+            m_allocations.load(std::memory_order_relaxed),
+            m_failedAllocations.load(std::memory_order_relaxed),
+            slabs
+        };
+    }
+
+private:
+    friend class PacketBuffer;
+
+    static constexpr uint32_t EmptyIndex = UINT32_MAX;
+
+    struct AlignedDelete
+    {
+        void operator()(uint8_t* slab) const
+        {
+            ::operator delete(slab, std::align_val_t(SlotAlignment));
+        }
+    };
+
+    PacketHeader* slot(uint32_t index) const
+    {
+        return reinterpret_cast<PacketHeader*>(m_slabs[index / m_packetsPerSlab].get() + (index % m_packetsPerSlab) * m_slotSize);
+    }
+
+    // Caller holds m_growMutex
+    void addSlab()
+    {
+        const size_t slabIndex = m_slabCount.load(std::memory_order_relaxed);
+        auto* slab = static_cast<uint8_t*>(::operator new(m_packetsPerSlab * m_slotSize, std::align_val_t(SlotAlignment)));
+        m_slabs[slabIndex].reset(slab);
+        const uint32_t firstIndex = static_cast<uint32_t>(slabIndex * m_packetsPerSlab);
+        for(size_t i = 0; i < m_packetsPerSlab; ++i)
+        {
+            auto* header = new (slab + i * m_slotSize) PacketHeader();
+            header->index = firstIndex + static_cast<uint32_t>(i);
+            header->pool = this;
+        }
+        m_slabCount.store(slabIndex + 1, std::memory_order_release);
+        for(size_t i = 0; i < m_packetsPerSlab; ++i)
+        {
+            pushFree(slot(firstIndex + static_cast<uint32_t>(i)));
+        }
+    }
+
+    // The free list head packs an ABA tag above the slot index
+    PacketHeader* popFree()
+    {
+        uint64_t head = m_freeHead.load(std::memory_order_acquire);
+        for(;;)
+        {
+            const uint32_t index = static_cast<uint32_t>(head);
+            if(index == EmptyIndex)
+            {
+                return nullptr;
+            }
+            PacketHeader* header = slot(index);
+            const uint64_t next = ((head >> 32) + 1) << 32 | header->nextFree.load(std::memory_order_relaxed);
+            if(m_freeHead.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire))
+            {
+                return header;
+            }
+        }
+    }
+
+    void pushFree(PacketHeader* header)
+    {
+        uint64_t head = m_freeHead.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            header->nextFree.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+            const uint64_t next = ((head >> 32) + 1) << 32 | header->index;
+            if(m_freeHead.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed))
+            {
+                return;
+            }
+        }
+    }
+
+    void release(PacketHeader* header)
+    {
+        m_inUse.fetch_sub(1, std::memory_order_relaxed);
+        pushFree(header);
+    }
+
+    const size_t m_packetSize;
+    const size_t m_packetsPerSlab;
+    const size_t m_slotSize;
+    const size_t m_maxSlabs;
+    std::vector<std::unique_ptr<uint8_t, AlignedDelete>> m_slabs;
+    std::mutex m_growMutex;
+    std::atomic<size_t> m_slabCount = 0;
+    std::atomic<uint64_t> m_freeHead = EmptyIndex;
+    std::atomic<size_t> m_inUse = 0;
+    std::atomic<size_t> m_highWaterMark = 0;
+    std::atomic<size_t> m_allocations = 0;
+    std::atomic<size_t> m_failedAllocations = 0;
+};
+
+inline void PacketBuffer::reset()
+{
+    if(m_header && m_header->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        m_header->pool->release(m_header);
+    }
+    m_header = nullptr;
+}
+
+inline size_t PacketBuffer::capacity() const
+{
+    return m_header ? m_header->pool->getPacketSize() : 0;
+}
@@ -0,0 +1,191 @@
+//
+//          Created by Riki Lowe on 17/09/2024.
+//
+//              Copyright Riki Lowe 2024
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#ifndef _WIN32
+
+#include <string>
+#include <span>
+#include <thread>
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <termios.h>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#ifdef __APPLE__
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+// Stand-in for serial hardware when testing or benchmarking SerialPort
+// The slave end is a tty a SerialPort opens by name, the master end plays whatever is on the other end of the cable
+class PseudoTerminal
+{
+public:
+    PseudoTerminal()
+    {
+        termios raw {};
+        ::cfmakeraw(&raw);
+        std::array<char, PATH_MAX> deviceName {};
+        if(::openpty(&m_master, &m_slave, deviceName.data(), &raw, nullptr) == 0)
+        {
+            m_deviceName = deviceName.data();
+        }
+        // the slave stays open here as well, otherwise the master reads EIO whenever the SerialPort is closed
+    }
+
+    PseudoTerminal(const PseudoTerminal&) = delete;
+    PseudoTerminal& operator=(const PseudoTerminal&) = delete;
+
+    ~PseudoTerminal()
+    {
+        if(m_master >= 0)
+        {
+            ::close(m_master);
+        }
+        if(m_slave >= 0)
+        {
+            ::close(m_slave);
+        }
+    }
+
+    bool isOpen() const
+    {
+        return m_master >= 0;
+    }
+
+    const std::string& getDeviceName() const
+    {
+        return m_deviceName;
+    }
+
+    int getMasterHandle() const
+    {
+        return m_master;
+    }
+
+    // Writes everything, returns how much that was
+    size_t write(std::span<const uint8_t> data)
+    {
+        size_t written = 0;
+        while(written < data.size())
+        {
+            const ssize_t bytes = ::write(m_master, data.data() + written, data.size() - written);
+            if(bytes <= 0)
+            {
+                break;
+            }
+            written += static_cast<size_t>(bytes);
+        }
+        return written;
+    }
+
+    // Waits up to timeoutMs for something to arrive then takes whatever is there, 0 bytes on a timeout
+    size_t read(std::span<uint8_t> data, int timeoutMs)
+    {
+        pollfd readable { m_master, POLLIN, 0 };
+        if(::poll(&readable, 1, timeoutMs) <= 0)
+        {
+            return 0;
+        }
+        const ssize_t bytes = ::read(m_master, data.data(), data.size());
+        return bytes > 0 ? static_cast<size_t>(bytes) : 0;
+    }
+
+private:
+    int m_master = -1;
+    int m_slave = -1;
+    std::string m_deviceName;
+};
+
+// Two pseudo-terminals with their masters cross-connected, like a null modem cable between two serial ports
+class NullModem
+{
+public:
+    NullModem()
+    {
+        if(::pipe(m_stopPipe.data()) == 0 && m_ends[0].isOpen() && m_ends[1].isOpen())
+        {
+            m_relay = std::thread([this]()
+            {
+                relay();
+            });
+        }
+    }
+
+    NullModem(const NullModem&) = delete;
+    NullModem& operator=(const NullModem&) = delete;
+
+    ~NullModem()
+    {
+        if(m_relay.joinable())
+        {
+            const uint8_t stop = 0;
+            [[maybe_unused]] auto written = ::write(m_stopPipe[1], &stop, sizeof(stop));
+            m_relay.join();
+        }
+        for(int handle : m_stopPipe)
+        {
+            if(handle >= 0)
+            {
+                ::close(handle);
+            }
+        }
+    }
+
+    bool isOpen() const
+    {
+        return m_relay.joinable();
+    }
+
+    // end is 0 or 1
+    const std::string& getDeviceName(size_t end) const
+    {
+        return m_ends[end].getDeviceName();
+    }
+
+private:
+    void relay()
+    {
+        std::array<uint8_t, 4096> buffer {};
+        for(;;)
+        {
+            std::array<pollfd, 3> handles
+            {{
+                { m_ends[0].getMasterHandle(), POLLIN, 0 },
+                { m_ends[1].getMasterHandle(), POLLIN, 0 },
+                { m_stopPipe[0], POLLIN, 0 }
+            }};
+            if(::poll(handles.data(), handles.size(), -1) < 0 || handles[2].revents)
+            {
+                return;
+            }
+            for(size_t end = 0; end < m_ends.size(); ++end)
+            {
+                if(handles[end].revents & POLLIN)
+                {
+                    const ssize_t bytes = ::read(handles[end].fd, buffer.data(), buffer.size());
+                    if(bytes > 0)
+                    {
+                        m_ends[1 - end].write(std::span(buffer.data(), static_cast<size_t>(bytes)));
+                    }
+                }
+            }
+        }
+    }
+
+    std::array<PseudoTerminal, 2> m_ends;
+    std::array<int, 2> m_stopPipe { -1, -1 };
+    std::thread m_relay;
+};
+
+#endif
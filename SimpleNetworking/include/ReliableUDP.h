@@ -0,0 +1,471 @@
+//
+//          Created by Riki Lowe on 17/09/2024.
+//
+//              Copyright Riki Lowe 2024
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include "UDPSocket.h"
+#include "Serialization.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <span>
+#include <utility>
+#include <vector>
+
+// Tuning for a ReliableSession, both ends should agree on windowSize and channelCount
+struct ReliableOptions
+{
+    uint32_t windowSize = 64; // messages sent but not yet acknowledged, and how far ahead of the first gap the receiver keeps what arrives
+    size_t maxPayload = 1200; // keeps a message and its header inside one datagram on a typical MTU
+    uint8_t channelCount = 4;
+    uint32_t fastRetransmitThreshold = 3; // acknowledgements of later messages before a missing one is sent again without waiting for its timeout
+    std::chrono::milliseconds initialTimeout { 100 }; // before there is a round trip to go on
+    std::chrono::milliseconds minTimeout { 5 };
+    std::chrono::milliseconds maxTimeout { 1000 };
+};
+
+struct ReliableStats
+{
+    uint64_t sent = 0; // messages, not counting retransmissions
+    uint64_t retransmitted = 0;
+    uint64_t fastRetransmits = 0; // of those, the ones sent because later messages were acknowledged, rather than on a timeout
+    uint64_t delivered = 0;
+    uint64_t duplicates = 0; // messages that arrived again after they had already been received
+    uint64_t acksSent = 0;
+};
+
+// Reliable delivery over any datagram transport, sequence numbers, selective acknowledgements, fast retransmit and a bounded send window
+// Every channel is ordered unless setChannelOrdered() says otherwise, a gap on one channel never holds back another
+// The session never touches a socket, datagrams go out through the output callback and come in through receive(), so it can run over a simulated link
+// update() resends whatever has timed out and has to be called regularly, poll() on ReliableUDPSocket does that
+// Not thread-safe, one thread drives a session
+class ReliableSession : public ErrorHandler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Output = std::function<void(std::span<const uint8_t> datagram)>;
+    using Receiver = std::function<void(uint8_t channel, std::span<const uint8_t> message)>;
+
+    ReliableSession(Output output, const ReliableOptions& options = {})
+        : m_output(std::move(output)), m_options(options), m_timeout(options.initialTimeout), m_sendSlots(std::max<uint32_t>(options.windowSize, 1)), m_received(m_sendSlots.size()), m_channels(options.channelCount)
+    {
+        m_options.maxPayload = std::min<size_t>(m_options.maxPayload, 0xffff); // a message's length is 16 bits on the wire
+        for(auto& slot : m_sendSlots)
+        {
+            slot.datagram.reserve(HeaderBytes + options.maxPayload);
+        }
+    }
+
+    // Called for every message as it is delivered, the view is only valid for the call
+    void setReceiveCallback(Receiver receiver)
+    {
+        m_receiver = std::move(receiver);
+    }
+
+    // Unordered channels deliver messages as they arrive, set before anything is sent or received on the channel
+    void setChannelOrdered(uint8_t channel, bool ordered)
+    {
+        if(channel < m_channels.size())
+        {
+            m_channels[channel].ordered = ordered;
+        }
+    }
+
+    // Sends the message and keeps a copy until it is acknowledged, false when the window is full, the channel doesn't exist or the message is too large
+    bool send(uint8_t channel, std::span<const uint8_t> message, Clock::time_point now = Clock::now())
+    {
+        if(channel >= m_channels.size())
+        {
+            setLastError({ SocketErrorReason::NoSuchChannel, {}, m_channels.size(), channel });
+            return false;
+        }
+        if(message.size() > m_options.maxPayload)
+        {
+            setLastError({ SocketErrorReason::SendBufferOverflow, {}, message.size(), m_options.maxPayload });
+            return false;
+        }
+        if(getInFlight() >= m_sendSlots.size())
+        {
+            setLastError({ SocketErrorReason::SendWindowFull, {}, getInFlight() });
+            return false;
+        }
+        const uint32_t sequence = m_nextSequence++;
+        auto& slot = sendSlot(sequence);
+        slot.datagram.resize(HeaderBytes + message.size());
+        MessageWriter<std::endian::big> writer(slot.datagram);
+        writer.write(PacketType::Data, channel, sequence, m_channels[channel].nextSend++, std::span<const uint8_t>(message));
+        slot.inFlight = true;
+        slot.transmissions = 0;
+        ++m_stats.sent;
+        transmit(slot, now);
+        return true;
+    }
+
+    // A datagram from the peer, data is acknowledged and delivered, acknowledgements release the window
+    void receive(std::span<const uint8_t> datagram, Clock::time_point now = Clock::now())
+    {
+        MessageReader<std::endian::big> reader(datagram);
+        PacketType type {};
+        if(!reader.read(type))
+        {
+            return;
+        }
+        if(type == PacketType::Data)
+        {
+            uint8_t channel = 0;
+            uint32_t sequence = 0;
+            uint32_t channelSequence = 0;
+            std::span<const uint8_t> message;
+            if(reader.read(channel, sequence, channelSequence, message) && channel < m_channels.size())
+            {
+                receiveData(channel, sequence, channelSequence, message);
+            }
+        }
+        else if(type == PacketType::Ack)
+        {
+            uint32_t cumulative = 0;
+            uint64_t selective = 0;
+            if(reader.read(cumulative, selective))
+            {
+                receiveAck(cumulative, selective, now);
+            }
+        }
+    }
+
+    // Resends every message whose timeout has passed, each time it times out its timeout doubles, up to maxTimeout
+    // A message later ones have overtaken goes once its reorder window has passed, without waiting for the timeout
+    void update(Clock::time_point now = Clock::now())
+    {
+        for(uint32_t sequence = m_sendBase; sequence != m_nextSequence; ++sequence)
+        {
+            auto& slot = sendSlot(sequence);
+            if(slot.inFlight && isLost(slot, now))
+            {
+                ++m_stats.retransmitted;
+                ++m_stats.fastRetransmits;
+                transmit(slot, now);
+            }
+            else if(slot.inFlight && now >= slot.retransmitAt)
+            {
+                ++m_stats.retransmitted;
+                transmit(slot, now);
+            }
+        }
+    }
+
+    // Messages sent and not yet acknowledged
+    size_t getInFlight() const
+    {
+        return m_nextSequence - m_sendBase;
+    }
+
+    // Everything sent has been acknowledged
+    bool isIdle() const
+    {
+        return m_sendBase == m_nextSequence;
+    }
+
+    // The next time update() has something to resend, Clock::time_point::max() when nothing is in flight
+    Clock::time_point getNextTimeout() const
+    {
+        auto next = Clock::time_point::max();
+        for(uint32_t sequence = m_sendBase; sequence != m_nextSequence; ++sequence)
+        {
+            const auto& slot = m_sendSlots[sequence % m_sendSlots.size()];
+            next = slot.inFlight ? std::min(next, slot.retransmitAt) : next;
+        }
+        return next;
+    }
+
+    Clock::duration getSmoothedRoundTrip() const
+    {
+        return m_smoothedRoundTrip;
+    }
+
+    Clock::duration getRetransmitTimeout() const
+    {
+        return m_timeout;
+    }
+
+    const ReliableStats& getStats() const
+    {
+        return m_stats;
+    }
+
+private:
+    enum class PacketType : uint8_t
+    {
+        Data = 1,
+        Ack = 2
+    };
+
+    // type, channel, sequence, channel sequence and the message's length
+    static constexpr size_t HeaderBytes = 1 + 1 + 4 + 4 + 2;
+    static constexpr size_t AckBytes = 1 + 4 + 8;
+    static constexpr uint32_t SelectiveAckBits = 64;
+
+    struct SendSlot
+    {
+        std::vector<uint8_t> datagram; // kept whole for retransmission, its capacity is reused
+        Clock::time_point sentAt {};
+        Clock::time_point retransmitAt {};
+        uint32_t transmissions = 0;
+        uint32_t missingReports = 0; // acknowledgements of messages sent after this one
+        bool inFlight = false;
+    };
+
+    struct Channel
+    {
+        bool ordered = true;
+        uint32_t nextSend = 0;
+        uint32_t nextDeliver = 0;
+        std::vector<std::vector<uint8_t>> pending; // ordered messages that arrived ahead of a gap, by channel sequence, only allocated once one does
+        std::vector<bool> isPending;
+    };
+
+    // Sequence numbers wrap, so a comes before b when the distance from b back to a is under half the space
+    static bool SequenceBefore(uint32_t a, uint32_t b)
+    {
+        return static_cast<int32_t>(a - b) < 0;
+    }
+
+    SendSlot& sendSlot(uint32_t sequence)
+    {
+        return m_sendSlots[sequence % m_sendSlots.size()];
+    }
+
+    void transmit(SendSlot& slot, Clock::time_point now)
+    {
+        slot.sentAt = now;
+        slot.missingReports = 0;
+        // exponential backoff for a message that keeps timing out
+        const auto backoff = std::min<Clock::duration>(m_timeout * (1u << std::min<uint32_t>(slot.transmissions, 16)), m_options.maxTimeout);
+        slot.retransmitAt = now + backoff;
+        ++slot.transmissions;
+        m_output(slot.datagram);
+    }
+
+    void receiveData(uint8_t channel, uint32_t sequence, uint32_t channelSequence, std::span<const uint8_t> message)
+    {
+        const bool alreadyReceived = SequenceBefore(sequence, m_receiveBase) || (sequence - m_receiveBase < m_received.size() && m_received[sequence % m_received.size()]);
+        if(alreadyReceived)
+        {
+            ++m_stats.duplicates;
+        }
+        // past the window it is dropped unacknowledged, the sender resends it once the window has moved on
+        else if(sequence - m_receiveBase < m_received.size())
+        {
+            m_received[sequence % m_received.size()] = true;
+            while(m_received[m_receiveBase % m_received.size()])
+            {
+                m_received[m_receiveBase++ % m_received.size()] = false;
+            }
+            deliver(channel, channelSequence, message);
+        }
+        sendAck();
+    }
+
+    void deliver(uint8_t channelIndex, uint32_t channelSequence, std::span<const uint8_t> message)
+    {
+        auto& channel = m_channels[channelIndex];
+        if(!channel.ordered)
+        {
+            deliver(channelIndex, message);
+            return;
+        }
+        if(channelSequence != channel.nextDeliver)
+        {
+            // a channel's gap never spans more than the window, so it fits a ring of that size
+            if(channel.pending.empty())
+            {
+                channel.pending.resize(m_received.size());
+                channel.isPending.resize(m_received.size());
+            }
+            const size_t index = channelSequence % channel.pending.size();
+            channel.pending[index].assign(message.begin(), message.end());
+            channel.isPending[index] = true;
+            return;
+        }
+        deliver(channelIndex, message);
+        ++channel.nextDeliver;
+        while(!channel.pending.empty() && channel.isPending[channel.nextDeliver % channel.pending.size()])
+        {
+            const size_t index = channel.nextDeliver++ % channel.pending.size();
+            channel.isPending[index] = false;
+            deliver(channelIndex, channel.pending[index]);
+        }
+    }
+
+    void deliver(uint8_t channel, std::span<const uint8_t> message)
+    {
+        ++m_stats.delivered;
+        if(m_receiver)
+        {
+            m_receiver(channel, message);
+        }
+    }
+
+    // Everything before m_receiveBase, and a bit for each of the SelectiveAckBits messages after the first gap
+    void sendAck()
+    {
+        uint64_t selective = 0;
+        const uint32_t bits = std::min<uint32_t>(SelectiveAckBits, static_cast<uint32_t>(m_received.size()) - 1);
+        for(uint32_t i = 0; i < bits; ++i)
+        {
+            selective |= static_cast<uint64_t>(m_received[(m_receiveBase + 1 + i) % m_received.size()]) << i;
+        }
+        std::array<uint8_t, AckBytes> ack;
+        MessageWriter<std::endian::big> writer(ack);
+        writer.write(PacketType::Ack, m_receiveBase, selective);
+        ++m_stats.acksSent;
+        m_output(writer.written());
+    }
+
+    void receiveAck(uint32_t cumulative, uint64_t selective, Clock::time_point now)
+    {
+        if(SequenceBefore(m_nextSequence, cumulative))
+        {
+            return; // acknowledges something never sent
+        }
+        // when the latest acknowledged message was sent, ties within a burst go by sequence
+        const uint32_t base = m_sendBase;
+        std::pair<Clock::time_point, uint32_t> latestSent {};
+        auto acknowledge = [this, now, base, &latestSent](uint32_t sequence)
+        {
+            auto& slot = sendSlot(sequence);
+            if(!slot.inFlight)
+            {
+                return;
+            }
+            slot.inFlight = false;
+            latestSent = std::max(latestSent, { slot.sentAt, sequence - base });
+            if(slot.transmissions == 1) // a resent message can't tell which transmission was acknowledged
+            {
+                sampleRoundTrip(now - slot.sentAt);
+            }
+        };
+        for(uint32_t sequence = m_sendBase; SequenceBefore(sequence, cumulative); ++sequence)
+        {
+            acknowledge(sequence);
+        }
+        for(uint32_t i = 0; i < SelectiveAckBits; ++i)
+        {
+            const uint32_t sequence = cumulative + 1 + i;
+            if(selective >> i & 1 && SequenceBefore(sequence, m_nextSequence) && !SequenceBefore(sequence, m_sendBase))
+            {
+                acknowledge(sequence);
+            }
+        }
+        while(m_sendBase != m_nextSequence && !sendSlot(m_sendBase).inFlight)
+        {
+            ++m_sendBase;
+        }
+        // anything sent before a message that has now been acknowledged was probably lost, enough of those and it goes again straight away
+        for(uint32_t sequence = m_sendBase; sequence != m_nextSequence; ++sequence)
+        {
+            auto& slot = sendSlot(sequence);
+            const std::pair<Clock::time_point, uint32_t> sent { slot.sentAt, sequence - base };
+            if(!slot.inFlight || !(sent < latestSent))
+            {
+                continue;
+            }
+            ++slot.missingReports;
+            if(isLost(slot, now))
+            {
+                ++m_stats.retransmitted;
+                ++m_stats.fastRetransmits;
+                transmit(slot, now);
+            }
+        }
+    }
+
+    // Enough later messages acknowledged, and out for longer than a round trip and a quarter so reordering on the link doesn't look like loss
+    bool isLost(const SendSlot& slot, Clock::time_point now) const
+    {
+        return slot.missingReports >= m_options.fastRetransmitThreshold && now - slot.sentAt >= m_smoothedRoundTrip + m_smoothedRoundTrip / 4;
+    }
+
+    // Smoothed round trip and retransmit timeout as TCP keeps them (RFC 6298)
+    void sampleRoundTrip(Clock::duration sample)
+    {
+        if(m_smoothedRoundTrip == Clock::duration::zero())
+        {
+            m_smoothedRoundTrip = sample;
+            m_roundTripVariance = sample / 2;
+        }
+        else
+        {
+            const auto difference = m_smoothedRoundTrip > sample ? m_smoothedRoundTrip - sample : sample - m_smoothedRoundTrip;
+            m_roundTripVariance = (m_roundTripVariance * 3 + difference) / 4;
+            m_smoothedRoundTrip = (m_smoothedRoundTrip * 7 + sample) / 8;
+        }
+        m_timeout = std::clamp<Clock::duration>(m_smoothedRoundTrip + 4 * m_roundTripVariance, m_options.minTimeout, m_options.maxTimeout);
+    }
+
+    Output m_output;
+    Receiver m_receiver;
+    ReliableOptions m_options;
+    ReliableStats m_stats;
+    Clock::duration m_smoothedRoundTrip {};
+    Clock::duration m_roundTripVariance {};
+    Clock::duration m_timeout;
+
+    // sending
+    std::vector<SendSlot> m_sendSlots; // a ring indexed by sequence
+    uint32_t m_sendBase = 0; // the oldest message not yet acknowledged
+    uint32_t m_nextSequence = 0;
+
+    // receiving
+    std::vector<bool> m_received; // a ring indexed by sequence, what has arrived past m_receiveBase
+    uint32_t m_receiveBase = 0; // every message before it has arrived
+    std::vector<Channel> m_channels;
+};
+
+// A ReliableSession over a SocketMode::ReadWrite UDPClient or UDPServer
+// A server answers whoever sent to it last, so it carries one peer's session
+class ReliableUDPSocket
+{
+public:
+    ReliableUDPSocket(UDPSocket& socket, const ReliableOptions& options = {})
+        : m_socket(socket), m_session([this](std::span<const uint8_t> datagram)
+        {
+            // a failed write is just another lost datagram, the session resends it
+            m_socket.writeData(const_cast<uint8_t*>(datagram.data()), datagram.size()).get();
+        }, options)
+    {
+    }
+
+    ReliableSession& getSession()
+    {
+        return m_session;
+    }
+
+    bool send(uint8_t channel, std::span<const uint8_t> message)
+    {
+        return m_session.send(channel, message);
+    }
+
+    // Waits up to the socket's timeout for one datagram and hands it to the session, then resends whatever is due
+    // Keep the socket's timeout short, it bounds how late a retransmission can be
+    SocketResult poll()
+    {
+        auto& recvBuffer = m_socket.getRecvBuffer();
+        auto result = m_socket.readData(recvBuffer.data(), recvBuffer.size()).get();
+        if(result)
+        {
+            m_session.receive(std::span<const uint8_t>(recvBuffer.data(), result.bytes));
+        }
+        m_session.update();
+        return result;
+    }
+
+private:
+    UDPSocket& m_socket;
+    ReliableSession m_session;
+};
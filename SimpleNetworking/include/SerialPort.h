@@ -20,16 +20,40 @@ namespace
     }
 }
 #else
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
 namespace
 {
     void FlushSerialReceive(boost::asio::serial_port& port)
     {
-        // \todo implement FlushSerialReceive for Linux
-        assert(false && "FlushSerialReceive not implemented for Linux");
+        ::tcflush(port.native_handle(), TCIFLUSH);
     }
 }
 #endif
 
+// How soon a read returns once bytes start arriving, only applied on POSIX
+struct SerialLatencyOptions
+{
+    uint8_t minBytes = 1; // VMIN, asio polls before it reads so this is how many bytes wake a reader when interByteTimeout is 0
+    uint8_t interByteTimeout = 0; // VTIME in tenths of a second
+    bool lowLatency = true; // ASYNC_LOW_LATENCY, asks the UART driver to push bytes up straight away rather than batching them
+};
+
+// Latency is measured from the last byte of a frame arriving to its callback starting, so it includes the frame gap itself
+struct SerialFrameStatistics
+{
+    size_t frames = 0;
+    size_t overflows = 0; // frames delivered early because they filled the frame buffer before a gap was seen
+    std::chrono::nanoseconds lastLatency {};
+    std::chrono::nanoseconds minLatency {};
+    std::chrono::nanoseconds maxLatency {};
+    std::chrono::nanoseconds meanLatency {};
+};
+
 class SerialPort : public ISocket
 {
 public:
@@ -40,15 +64,37 @@ public:
     using CharSize = BoostSerial::character_size;
     using FlowCtrl = BoostSerial::flow_control;
     using StopBits = BoostSerial::stop_bits;
+    using FrameCallback = std::function<void(std::span<const uint8_t>)>;
+
+    static constexpr size_t DefaultMaxFrameSize = 256; // a Modbus RTU ADU
 
+    // port n is COMn on Windows and /dev/ttyS(n-1) elsewhere
+    // SocketType::BusyPoll is Blocking here, there is no socket to spin on
     SerialPort (SocketType type, SocketMode mode, uint16_t port, SocketRole role = DefaultRole) // for now SerialPort is client-only
-    : ISocket(type, mode, role, "COM", port), m_serialPort(m_ioService)
+    : ISocket(type == SocketType::BusyPoll ? SocketType::Blocking : type, mode, role, "COM", port), m_serialPort(*m_ioContext)
+    #ifndef _WIN32
+    , m_readiness(*m_ioContext)
+    #endif
+    {
+    }
+
+    // A full device name, e.g. /dev/ttyUSB0 or \\.\COM12
+    SerialPort (SocketType type, SocketMode mode, const std::string& deviceName, SocketRole role = DefaultRole)
+    : ISocket(type == SocketType::BusyPoll ? SocketType::Blocking : type, mode, role, deviceName, 0), m_serialPort(*m_ioContext)
+    #ifndef _WIN32
+    , m_readiness(*m_ioContext)
+    #endif
     {
     }
 
     ~SerialPort() override
     {
         SerialPort::close();
+        // a framer stopped from its own callback still has its cancelled read to come back, and that uses the port
+        if(m_continuousRead.valid() && !isInContinuousReader())
+        {
+            m_continuousRead.wait();
+        }
     }
 
     bool open() override
@@ -60,9 +106,134 @@ public:
         auto flowControl = FlowCtrl(FlowCtrl::none);
         auto stopBits = StopBits(StopBits::one);
         internalOpen(getSocketName(), baudRate, parity, charSize, flowControl, stopBits);
+        m_readFlushed = false; // a read the close failed may have left it set
+        if(m_initialised)
+        {
+            m_initialised = applyLatencyOptions() && openReadiness();
+        }
         return m_initialised && ISocket::open();
     }
 
+    // Takes effect straight away on an open port, otherwise the next time it is opened
+    bool setLatencyOptions(const SerialLatencyOptions& latencyOptions)
+    {
+        std::lock_guard lock(m_socketMutex);
+        m_latencyOptions = latencyOptions;
+        return !isOpen() || applyLatencyOptions();
+    }
+
+    SerialLatencyOptions getLatencyOptions() const
+    {
+        return m_latencyOptions;
+    }
+
+    // Opening and configuring the device, shared with SerialTransport
+    static void OpenDevice(serial_port& port, const std::string& deviceName, BaudRate baudRate, Parity parity, CharSize charSize, FlowCtrl flowControl, StopBits stopBits, boost::system::error_code& err)
+    {
+        port.open(deviceName, err);
+        if (!err)
+        {
+            port.set_option(baudRate, err);
+        }
+        if (!err)
+        {
+            port.set_option(parity, err);
+        }
+        if (!err)
+        {
+            port.set_option(charSize, err);
+        }
+        if (!err)
+        {
+            port.set_option(flowControl, err);
+        }
+        if (!err)
+        {
+            port.set_option(stopBits, err);
+        }
+    }
+
+    static void ApplyLatencyOptions([[maybe_unused]] serial_port& port, [[maybe_unused]] const SerialLatencyOptions& latencyOptions, [[maybe_unused]] boost::system::error_code& err)
+    {
+    #ifndef _WIN32
+        const int handle = port.native_handle();
+        termios options {};
+        if(::tcgetattr(handle, &options) != 0)
+        {
+            err = LastSystemError();
+            return;
+        }
+        options.c_cc[VMIN] = latencyOptions.minBytes;
+        options.c_cc[VTIME] = latencyOptions.interByteTimeout;
+        if(::tcsetattr(handle, TCSANOW, &options) != 0)
+        {
+            err = LastSystemError();
+            return;
+        }
+    #ifdef __linux__
+        // Only real UARTs have the flag, ptys and most USB adapters don't support the ioctl so a failure here is expected
+        serial_struct serial {};
+        if(::ioctl(handle, TIOCGSERIAL, &serial) == 0)
+        {
+            const int flags = latencyOptions.lowLatency ? serial.flags | ASYNC_LOW_LATENCY : serial.flags & ~ASYNC_LOW_LATENCY;
+            if(flags != serial.flags)
+            {
+                serial.flags = flags;
+                ::ioctl(handle, TIOCSSERIAL, &serial);
+            }
+        }
+    #endif
+    #endif
+    }
+
+    // Time on the wire for one 8N1 character, Modbus RTU frames end after 3.5 of these
+    std::chrono::nanoseconds getCharacterTime()
+    {
+        return std::chrono::nanoseconds(10 * std::nano::den / getBaudRate());
+    }
+
+    // Assembles frames delimited by silence on the line, once nothing has arrived for frameGap the bytes so far are one frame
+    // A frameGap of zero uses the port's byte interval. Reads and the gap timer both run on the shared io_context, nothing polls
+    // The frame passed to onFrame is only valid during the call. Stopped by stopReadingContinuously() or close()
+    bool startReadingFrames(FrameCallback onFrame, std::chrono::nanoseconds frameGap = {}, size_t maxFrameSize = DefaultMaxFrameSize)
+    {
+        std::lock_guard lock(m_readMutex);
+        if(CheckIsValid(SocketMode::Read, getRecvBuffer().data(), maxFrameSize) != SocketErrorReason::None)
+        {
+            return false;
+        }
+        if(m_readContinuously.exchange(true))
+        {
+            setLastError({ SocketErrorReason::AlreadyReading });
+            return false;
+        }
+        if(m_continuousRead.valid())
+        {
+            m_continuousRead.wait();
+        }
+        {
+            std::lock_guard statisticsLock(m_frameStatisticsMutex);
+            m_frameStatistics = {};
+            m_totalFrameLatency = {};
+        }
+        if(frameGap == std::chrono::nanoseconds::zero())
+        {
+            frameGap = std::chrono::milliseconds(m_byteIntervalMs);
+        }
+        FlushSerialReceive(m_serialPort);
+        auto framer = std::make_shared<GapFramer>(*this, std::move(onFrame), frameGap, maxFrameSize);
+        m_continuousRead = framer->finished.get_future();
+        m_framer = framer;
+        framer->read();
+        return true;
+    }
+
+    SerialFrameStatistics getFrameStatistics()
+    {
+        std::lock_guard lock(m_frameStatisticsMutex);
+        return m_frameStatistics;
+    }
+
     
     virtual uint32_t getBaudRate()
     {
@@ -74,16 +245,34 @@ public:
         return m_serialPort.is_open();
     }
 
+    void cancel() override
+    {
+        if(auto framer = m_framer.lock())
+        {
+            framer->cancel();
+        }
+        else
+        {
+            boost::system::error_code err;
+            m_serialPort.cancel(err);
+        }
+        m_readinessWaiter.cancel();
+    }
+
     void close() override
     {
-        /*if(m_readContinuously)
+        if(m_readContinuously)
         {
             stopReadingContinuously();
-        }*/
+        }
         if(isOpen())
         {
             boost::system::error_code err;
+        #ifndef _WIN32
+            m_readiness.close(err);
+        #endif
             m_serialPort.close(err);
+            m_readinessWaiter.cancel(); // a reader waiting on the tty has to let go of the read lock before ISocket::close() takes it
             /// \todo Check error?
             ISocket::close();
         }
@@ -91,23 +280,125 @@ public:
 
     std::string getSocketName() const override
     {
+        if(m_port == 0)
+        {
+            return m_address;
+        }
+    #ifdef _WIN32
         /// \todo could just turn this into a member since it can't change?
         static constexpr const char* serialPortConst = R"(\\.\)";
         return serialPortConst + m_address + std::to_string(m_port);
+    #else
+        return "/dev/ttyS" + std::to_string(m_port - 1);
+    #endif
+    }
+
+    serial_port::native_handle_type getNativeHandle()
+    {
+        return m_serialPort.native_handle();
     }
     
     
 protected:
-    SocketResult internalReadData(unsigned char* data, size_t bufferSize) override
+    bool rebindEventLoop(io_context& context) override
     {
-        if(!m_readContinuously)
+        m_serialPort = boost::asio::serial_port(context);
+    #ifndef _WIN32
+        m_readiness = boost::asio::posix::stream_descriptor(context);
+    #endif
+        return true;
+    }
+
+    // The frame callback runs on the framer's strand
+    bool isInContinuousReader() const override
+    {
+        auto framer = m_framer.lock();
+        return framer && framer->strand.running_in_this_thread();
+    }
+
+    // Serial reads and writes take as long as they take, only a deadline bounds a non-blocking one's wait
+    uint32_t getWaitTimeoutMs([[maybe_unused]] SocketMode mode) const override
+    {
+        return 0;
+    }
+
+#ifndef _WIN32
+    // A non-blocking read flushes the first time it looks, rather than throw away what it then waits for
+    bool isReady(SocketMode mode) override
+    {
+        if(mode == SocketMode::Read && !m_readFlushed)
         {
-            // if we are not reading continuously, we can flush
-            FlushSerialReceive(m_serialPort);
+            flushBeforeRead();
+            m_readFlushed = true;
         }
+        return ReadinessWaiter::IsReady(m_serialPort, mode == SocketMode::Read ? POLLIN : POLLOUT);
+    }
+
+    void asyncWaitReady(SocketMode mode, std::function<void(const boost::system::error_code&)> handler) override
+    {
+        m_readiness.async_wait(mode == SocketMode::Read ? boost::asio::posix::stream_descriptor::wait_read : boost::asio::posix::stream_descriptor::wait_write, std::move(handler));
+    }
+
+    // asio's serial_port can't wait for readiness, a descriptor of its own on a duplicate of the tty's handle can
+    bool openReadiness()
+    {
+        return CheckForError([this](boost::system::error_code& err)
+        {
+            const int handle = ::dup(m_serialPort.native_handle());
+            if(handle < 0)
+            {
+                err = LastSystemError();
+                return;
+            }
+            m_readiness.assign(handle, err);
+            if(err)
+            {
+                ::close(handle);
+            }
+        });
+    }
+#else
+    // Windows has nothing to wait on, non-blocking operations run straight through on the pool
+    bool openReadiness()
+    {
+        return true;
+    }
+#endif
+
+#ifdef HAS_IO_URING
+    int getRingHandle() override
+    {
+        return m_serialPort.is_open() ? m_serialPort.native_handle() : -1;
+    }
+
+    // readv/writev on the tty
+    void beginRingOperation(SocketMode mode, [[maybe_unused]] IoUringOperation& operation) override
+    {
+        if(mode == SocketMode::Read)
+        {
+            flushBeforeRead();
+        }
+    }
+
+    // Like read_some, a read waits for as long as it takes
+    uint32_t getRingTimeoutMs() const override
+    {
+        return 0;
+    }
+#endif
+
+    SocketResult internalReadData(unsigned char* data, size_t bufferSize) override
+    {
+        flushBeforeRead();
         SocketResult result;
-        result.success = CheckForError([&](auto& err)
+        CheckForError(result, [&](auto& err)
         {
+            err = waitReady(SocketMode::Read);
+            if(err)
+            {
+                result.timedOut = err == boost::asio::error::timed_out;
+                return;
+            }
             result.bytes = m_serialPort.read_some(boost::asio::buffer(data, bufferSize), err);
         });
         return result;
@@ -116,12 +407,65 @@ protected:
     SocketResult internalWriteData(unsigned char* data, size_t bufferSize) override
     {
         SocketResult result;
-        result.success = CheckForError([&](auto& err)
+        CheckForError(result, [&](auto& err)
+        {
+            const boost::asio::const_buffer buffer(data, bufferSize);
+            result.bytes = writeAll(ConstBuffers(&buffer, 1), err);
+            result.timedOut = err == boost::asio::error::timed_out;
+        });
+        return result;
+    }
+
+    SocketResult internalReadBuffers(MutableBuffers buffers) override
+    {
+        flushBeforeRead();
+        SocketResult result;
+        CheckForError(result, [&](auto& err)
+        {
+            err = waitReady(SocketMode::Read);
+            if(err)
+            {
+                result.timedOut = err == boost::asio::error::timed_out;
+                return;
+            }
+            result.bytes = m_serialPort.read_some(buffers, err);
+        });
+        return result;
+    }
+
+    // readv/writev on POSIX, one WriteFile per buffer on Windows
+    SocketResult internalWriteBuffers(ConstBuffers buffers) override
+    {
+        SocketResult result;
+        CheckForError(result, [&](auto& err)
         {
-            result.bytes = boost::asio::write(m_serialPort, boost::asio::buffer(data, bufferSize), err);
+            result.bytes = writeAll(buffers, err);
+            result.timedOut = err == boost::asio::error::timed_out;
         });
         return result;
     }
+
+    AwaitableSocketResult internalAsyncReadData(unsigned char* data, size_t bufferSize) override
+    {
+        if(!m_readContinuously)
+        {
+            FlushSerialReceive(m_serialPort);
+        }
+        SocketResult result {};
+        boost::system::error_code err;
+        result.bytes = co_await m_serialPort.async_read_some(boost::asio::buffer(data, bufferSize), boost::asio::redirect_error(boost::asio::use_awaitable, err));
+        CheckAsyncResult(result, err);
+        co_return result;
+    }
+
+    AwaitableSocketResult internalAsyncWriteData(unsigned char* data, size_t bufferSize) override
+    {
+        SocketResult result {};
+        boost::system::error_code err;
+        result.bytes = co_await boost::asio::async_write(m_serialPort, boost::asio::buffer(data, bufferSize), boost::asio::redirect_error(boost::asio::use_awaitable, err));
+        CheckAsyncResult(result, err);
+        co_return result;
+    }
     
     void internalOpen(const std::string& deviceName,
         BaudRate baud_rate,
@@ -132,30 +476,211 @@ protected:
     {
         m_initialised = CheckForError([&](auto& err)
         {
-            m_serialPort.open(deviceName, err);
-           if (!err)
-           {
-               m_serialPort.set_option(baud_rate, err);
-           }
-           if (!err)
-           {
-               m_serialPort.set_option(opt_parity, err);
-           }
-           if (!err)
-           {
-               m_serialPort.set_option(opt_csize, err);
-           }
-           if (!err)
-           {
-               m_serialPort.set_option(opt_flow, err);
-           }
-           if (!err)
-           {
-               m_serialPort.set_option(opt_stop, err);
-           }
+            OpenDevice(m_serialPort, deviceName, baud_rate, opt_parity, opt_csize, opt_flow, opt_stop, err);
         });
     }
     
+    // Everything runs on one strand, so the read and gap timer handlers never overlap
+    struct GapFramer : std::enable_shared_from_this<GapFramer>
+    {
+        using Clock = std::chrono::steady_clock;
+
+        GapFramer(SerialPort& port, FrameCallback onFrame, std::chrono::nanoseconds frameGap, size_t maxFrameSize)
+            : port(port), strand(boost::asio::make_strand(port.getEventLoop())), gapTimer(strand), onFrame(std::move(onFrame)), frameGap(frameGap), frame(maxFrameSize)
+        {
+        }
+
+        void read()
+        {
+            readPending = true;
+            port.m_serialPort.async_read_some(boost::asio::buffer(frame.data() + frameBytes, frame.size() - frameBytes), boost::asio::bind_executor(strand, [self = this->shared_from_this()](const boost::system::error_code& err, size_t bytes)
+            {
+                self->onRead(err, bytes);
+            }));
+        }
+
+        // On the strand, where read() starts the next async_read_some, so the two never touch the port at once
+        // From off the event loop that means waiting for the strand, on it the loop may have no other thread to run it
+        void cancel()
+        {
+            auto cancelRead = [self = this->shared_from_this()]()
+            {
+                boost::system::error_code err;
+                self->port.m_serialPort.cancel(err);
+            };
+            if(strand.running_in_this_thread())
+            {
+                cancelRead();
+            }
+            else if(port.getEventLoop().get_executor().running_in_this_thread())
+            {
+                boost::asio::post(strand, std::move(cancelRead));
+            }
+            else
+            {
+                std::promise<void> cancelled;
+                boost::asio::post(strand, [&cancelRead, &cancelled]()
+                {
+                    cancelRead();
+                    cancelled.set_value();
+                });
+                cancelled.get_future().wait();
+            }
+        }
+
+        void onRead(const boost::system::error_code& err, size_t bytes)
+        {
+            readPending = false;
+            if(!port.CheckAsyncResult(err) || !port.m_readContinuously)
+            {
+                // a partial frame is dropped, it can't be told apart from a complete one
+                port.m_readContinuously = false;
+                gapTimer.cancel();
+                finishIfIdle();
+                return;
+            }
+            lastByte = Clock::now();
+            frameBytes += bytes;
+            if(frameBytes == frame.size())
+            {
+                deliver(true);
+            }
+            else if(!gapPending)
+            {
+                waitForGap(lastByte + frameGap);
+            }
+            read();
+        }
+
+        // Armed once per frame rather than per read, a late byte just pushes the expiry back when the timer fires
+        void waitForGap(Clock::time_point due)
+        {
+            gapPending = true;
+            gapTimer.expires_at(due);
+            gapTimer.async_wait(boost::asio::bind_executor(strand, [self = this->shared_from_this()](const boost::system::error_code& err)
+            {
+                self->onGap(err);
+            }));
+        }
+
+        void onGap(const boost::system::error_code& err)
+        {
+            gapPending = false;
+            if(err || !port.m_readContinuously)
+            {
+                finishIfIdle();
+                return;
+            }
+            if(frameBytes == 0)
+            {
+                return;
+            }
+            const auto due = lastByte + frameGap;
+            if(Clock::now() < due)
+            {
+                waitForGap(due);
+                return;
+            }
+            deliver(false);
+        }
+
+        void deliver(bool overflow)
+        {
+            const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - lastByte);
+            onFrame(std::span<const uint8_t>(frame.data(), frameBytes));
+            frameBytes = 0;
+            port.recordFrame(latency, overflow);
+        }
+
+        void finishIfIdle()
+        {
+            if(!readPending && !gapPending && !isFinished)
+            {
+                isFinished = true;
+                finished.set_value();
+            }
+        }
+
+        SerialPort& port;
+        boost::asio::strand<boost::asio::io_context::executor_type> strand;
+        boost::asio::steady_timer gapTimer;
+        FrameCallback onFrame;
+        std::chrono::nanoseconds frameGap;
+        std::vector<uint8_t> frame;
+        size_t frameBytes = 0;
+        Clock::time_point lastByte;
+        bool readPending = false;
+        bool gapPending = false;
+        bool isFinished = false;
+        std::promise<void> finished;
+    };
+
+    void recordFrame(std::chrono::nanoseconds latency, bool overflow)
+    {
+        std::lock_guard lock(m_frameStatisticsMutex);
+        auto& statistics = m_frameStatistics;
+        statistics.minLatency = statistics.frames == 0 ? latency : std::min(statistics.minLatency, latency);
+        statistics.maxLatency = std::max(statistics.maxLatency, latency);
+        statistics.lastLatency = latency;
+        statistics.overflows += overflow ? 1 : 0;
+        ++statistics.frames;
+        m_totalFrameLatency += latency;
+        statistics.meanLatency = m_totalFrameLatency / statistics.frames;
+    }
+
+    bool applyLatencyOptions()
+    {
+        return CheckForError([this](boost::system::error_code& err)
+        {
+            ApplyLatencyOptions(m_serialPort, m_latencyOptions, err);
+        });
+    }
+
+    // If we are not reading continuously, whatever arrived before the read started is flushed
+    // Unless isReady() already did as a non-blocking read first looked, under the same read lock
+    void flushBeforeRead()
+    {
+        if(!m_readContinuously && !std::exchange(m_readFlushed, false))
+        {
+            FlushSerialReceive(m_serialPort);
+        }
+    }
+
+    // Serial reads and writes take as long as they take, unless they have a deadline, but always on the waiter so close() can wake them
+    // Closing the tty wouldn't, a read blocked in read_some() keeps it open. Windows can't poll one, there the transfer itself waits
+    boost::system::error_code waitReady([[maybe_unused]] SocketMode mode)
+    {
+    #ifndef _WIN32
+        return m_readinessWaiter.waitUntil(m_serialPort, mode == SocketMode::Read ? POLLIN : POLLOUT, waitDeadline(mode));
+    #else
+        return {};
+    #endif
+    }
+
+    size_t writeAll(ConstBuffers buffers, boost::system::error_code& err)
+    {
+    #ifndef _WIN32
+        return m_readinessWaiter.writeAll(m_serialPort, buffers, waitDeadline(SocketMode::Write), err);
+    #else
+        return boost::asio::write(m_serialPort, buffers, err);
+    #endif
+    }
+
+    ReadinessWaiter::Clock::time_point waitDeadline(SocketMode mode)
+    {
+        return hasOperationDeadline(mode) ? getOperationDeadline(mode) : ReadinessWaiter::Clock::time_point::max();
+    }
+
     serial_port m_serialPort;
+#ifndef _WIN32
+    boost::asio::posix::stream_descriptor m_readiness; // see openReadiness()
+#endif
+    ReadinessWaiter m_readinessWaiter;
+    std::weak_ptr<GapFramer> m_framer; // while reading frames, cancel() goes through its strand
+    bool m_readFlushed = false; // by isReady(), for the read in progress
+    SerialLatencyOptions m_latencyOptions {};
+    std::mutex m_frameStatisticsMutex;
+    SerialFrameStatistics m_frameStatistics {};
+    std::chrono::nanoseconds m_totalFrameLatency {};
 
 };
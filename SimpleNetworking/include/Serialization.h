@@ -0,0 +1,617 @@
+//
+//          Created by Riki Lowe on 17/09/2024.
+//
+//              Copyright Riki Lowe 2024
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Width of a length that precedes a message, string or dynamic span
+enum class LengthPrefix : size_t
+{
+    UInt8 = 1,
+    UInt16 = 2,
+    UInt32 = 4,
+    UInt64 = 8
+};
+
+// Why a MessageWriter or MessageReader stopped
+enum class SerializationError : uint8_t
+{
+    None,
+    BufferTooSmall, // the writer ran out of buffer, or the reader out of message
+    LengthPrefixOverflow // a string or span longer than its length prefix can describe
+};
+
+// What the wire format supports, and how each type is laid out on it
+// Arithmetic types and enums are converted to Order, the conversion is resolved at compile time and is a plain copy when Order is the host's
+// Fixed arrays (T[N], std::array, std::span<T, N>) are their elements back to back, strings and dynamic spans are a length prefix followed by their elements
+// A struct listing its members as `static constexpr auto SerializedFields = std::make_tuple(&T::a, &T::b);` is those members in turn,
+// any other trivially copyable struct is copied as it is laid out in memory, so only in the host's byte order and padding
+template<std::endian Order>
+struct Encoding
+{
+    template<typename T>
+    static constexpr bool IsScalar = std::is_arithmetic_v<T> || std::is_enum_v<T>;
+
+    // Types that can be viewed in place rather than copied out
+    template<typename T>
+    static constexpr bool IsByte = sizeof(T) == 1 && (std::is_same_v<T, uint8_t> || std::is_same_v<T, char> || std::is_same_v<T, int8_t> || std::is_same_v<T, std::byte>);
+
+    template<typename T>
+    static constexpr bool HasSerializedFields = requires { T::SerializedFields; };
+
+    // Elements whose encoding is their bytes in memory, a range of them is one memcpy
+    template<typename T>
+    static constexpr bool IsMemoryLayout = IsByte<T> || (IsScalar<T> && Order == std::endian::native && !std::is_same_v<T, bool>)
+        || (std::is_trivially_copyable_v<T> && std::is_class_v<T> && !HasSerializedFields<T>);
+
+    template<typename T>
+    struct IsStdArray : std::false_type {};
+    template<typename T, size_t N>
+    struct IsStdArray<std::array<T, N>> : std::true_type {};
+
+    template<typename T>
+    struct IsSpan : std::false_type {};
+    template<typename T, size_t N>
+    struct IsSpan<std::span<T, N>> : std::true_type {};
+
+    template<size_t Size>
+    using Bits = std::conditional_t<Size == 1, uint8_t, std::conditional_t<Size == 2, uint16_t, std::conditional_t<Size == 4, uint32_t, uint64_t>>>;
+
+    template<typename U>
+    static constexpr U ByteSwap(U value)
+    {
+    #if defined(__GNUC__) || defined(__clang__)
+        if constexpr(sizeof(U) == 2)
+        {
+            return __builtin_bswap16(value);
+        }
+        else if constexpr(sizeof(U) == 4)
+        {
+            return __builtin_bswap32(value);
+        }
+        else if constexpr(sizeof(U) == 8)
+        {
+            return __builtin_bswap64(value);
+        }
+    #endif
+        U swapped = 0;
+        for(size_t i = 0; i < sizeof(U); ++i)
+        {
+            swapped = static_cast<U>(swapped << 8 | ((value >> (i * 8)) & 0xff));
+        }
+        return swapped;
+    }
+
+    template<typename T>
+    static void Store(uint8_t* out, T value)
+    {
+        static_assert(sizeof(T) <= sizeof(uint64_t) && std::has_single_bit(sizeof(T)), "Scalars are at most 8 bytes");
+        auto bits = std::bit_cast<Bits<sizeof(T)>>(value);
+        if constexpr(Order != std::endian::native && sizeof(T) > 1)
+        {
+            bits = ByteSwap(bits);
+        }
+        std::memcpy(out, &bits, sizeof(T));
+    }
+
+    template<typename T>
+    static T Load(const uint8_t* in)
+    {
+        Bits<sizeof(T)> bits;
+        std::memcpy(&bits, in, sizeof(T));
+        if constexpr(Order != std::endian::native && sizeof(T) > 1)
+        {
+            bits = ByteSwap(bits);
+        }
+        // any byte but 0 is true, bit-casting something other than 0 or 1 to a bool is undefined
+        if constexpr(std::is_same_v<T, bool>)
+        {
+            return bits != 0;
+        }
+        else
+        {
+            return std::bit_cast<T>(bits);
+        }
+    }
+
+    static void StoreLength(uint8_t* out, uint64_t length, size_t prefixBytes)
+    {
+        for(size_t i = 0; i < prefixBytes; ++i)
+        {
+            const size_t shift = Order == std::endian::big ? (prefixBytes - i - 1) * 8 : i * 8;
+            out[i] = static_cast<uint8_t>(length >> shift);
+        }
+    }
+
+    static uint64_t LoadLength(const uint8_t* in, size_t prefixBytes)
+    {
+        uint64_t length = 0;
+        for(size_t i = 0; i < prefixBytes; ++i)
+        {
+            const size_t shift = Order == std::endian::big ? (prefixBytes - i - 1) * 8 : i * 8;
+            length |= static_cast<uint64_t>(in[i]) << shift;
+        }
+        return length;
+    }
+};
+
+// Encodes values straight into a buffer the caller owns, typically an ISocket's getSendBuffer(), nothing is built up on the side
+// Prefix is the width of every length it writes, and like everything else the lengths are in Order
+// Once something doesn't fit the writer stops writing, size() is what was written before that
+// Order has no default so it is always spelled out, ISocket::send() stays in host order while protocols mostly want std::endian::big
+template<std::endian Order, LengthPrefix Prefix = LengthPrefix::UInt16>
+class MessageWriter
+{
+    using Format = Encoding<Order>;
+    static constexpr size_t PrefixBytes = static_cast<size_t>(Prefix);
+
+public:
+    explicit MessageWriter(std::span<uint8_t> buffer) : m_buffer(buffer)
+    {
+    }
+
+    // Appends the values in turn, false once something didn't fit
+    template<typename... Values>
+    bool write(const Values&... values)
+    {
+        (encode(values), ...);
+        return m_error == SerializationError::None;
+    }
+
+    // Appends one length-prefixed message to a batch, so several go out as one datagram and MessageReader::readMessages() splits them again
+    // With big-endian Order the batch is also what a MessageFramer of the same prefix expects on a stream
+    // A message that doesn't fit is taken back out, the batch before it is left intact to send
+    template<typename... Values>
+    bool writeMessage(const Values&... values)
+    {
+        if(m_error != SerializationError::None)
+        {
+            return false;
+        }
+        const size_t start = m_size;
+        uint8_t* prefix = take(PrefixBytes);
+        (encode(values), ...);
+        const size_t length = m_size - start - PrefixBytes;
+        if(m_error == SerializationError::None && !checkLength(length))
+        {
+            m_error = SerializationError::LengthPrefixOverflow;
+        }
+        if(m_error != SerializationError::None)
+        {
+            m_size = start;
+            return false;
+        }
+        Format::StoreLength(prefix, length, PrefixBytes);
+        return true;
+    }
+
+    // Starts again from the front of the buffer, for the next batch
+    void clear()
+    {
+        m_size = 0;
+        m_required = 0;
+        m_oversizedLength = 0;
+        m_error = SerializationError::None;
+    }
+
+    explicit operator bool() const
+    {
+        return m_error == SerializationError::None;
+    }
+
+    SerializationError getError() const
+    {
+        return m_error;
+    }
+
+    // What the values written so far would have needed, more than the buffer's size after BufferTooSmall
+    size_t getRequiredBytes() const
+    {
+        return m_required;
+    }
+
+    // The length that didn't fit after LengthPrefixOverflow
+    size_t getOversizedLength() const
+    {
+        return m_oversizedLength;
+    }
+
+    uint8_t* data() const
+    {
+        return m_buffer.data();
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    std::span<const uint8_t> written() const
+    {
+        return m_buffer.first(m_size);
+    }
+
+    // Bytes a set of values takes on the wire
+    template<typename... Values>
+    static constexpr size_t encodedSize(const Values&... values)
+    {
+        return (sizeOf(values) + ... + 0);
+    }
+
+private:
+    // Where the next bytes go, nullptr and a sticky error when they don't fit
+    uint8_t* take(size_t bytes)
+    {
+        m_required += bytes;
+        if(m_error != SerializationError::None || m_buffer.size() - m_size < bytes)
+        {
+            if(m_error == SerializationError::None)
+            {
+                m_error = SerializationError::BufferTooSmall;
+            }
+            return nullptr;
+        }
+        uint8_t* out = m_buffer.data() + m_size;
+        m_size += bytes;
+        return out;
+    }
+
+    bool checkLength(size_t length)
+    {
+        if(PrefixBytes < sizeof(uint64_t) && static_cast<uint64_t>(length) >> (PrefixBytes * 8) != 0)
+        {
+            m_oversizedLength = length;
+            return false;
+        }
+        return true;
+    }
+
+    template<typename T>
+    void encodeRange(std::span<const T> values)
+    {
+        if constexpr(Format::template IsMemoryLayout<T>)
+        {
+            if(uint8_t* out = take(values.size_bytes()); out && !values.empty())
+            {
+                std::memcpy(out, values.data(), values.size_bytes());
+            }
+        }
+        else
+        {
+            for(const auto& value : values)
+            {
+                encode(value);
+            }
+        }
+    }
+
+    template<typename T>
+    void encodeLengthPrefixed(std::span<const T> values)
+    {
+        if(!checkLength(values.size()))
+        {
+            if(m_error == SerializationError::None)
+            {
+                m_error = SerializationError::LengthPrefixOverflow;
+            }
+            return;
+        }
+        if(uint8_t* prefix = take(PrefixBytes))
+        {
+            Format::StoreLength(prefix, values.size(), PrefixBytes);
+        }
+        encodeRange(values);
+    }
+
+    template<typename T>
+    void encode(const T& value)
+    {
+        if constexpr(Format::template IsScalar<T>)
+        {
+            if(uint8_t* out = take(sizeof(T)))
+            {
+                Format::Store(out, value);
+            }
+        }
+        else if constexpr(std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+        {
+            encodeLengthPrefixed(std::span<const char>(value.data(), value.size()));
+        }
+        else if constexpr(Format::template IsSpan<T>::value)
+        {
+            using Element = std::remove_cv_t<typename T::element_type>;
+            if constexpr(T::extent == std::dynamic_extent)
+            {
+                encodeLengthPrefixed(std::span<const Element>(value));
+            }
+            else
+            {
+                encodeRange(std::span<const Element>(value));
+            }
+        }
+        else if constexpr(std::is_array_v<T> || Format::template IsStdArray<T>::value)
+        {
+            encodeRange(std::span<const std::remove_cvref_t<decltype(value[0])>>(value));
+        }
+        else if constexpr(Format::template HasSerializedFields<T>)
+        {
+            std::apply([this, &value](auto... fields)
+            {
+                (encode(value.*fields), ...);
+            }, T::SerializedFields);
+        }
+        else
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "Only arithmetic types, enums, strings, arrays, spans and trivially copyable structs can be serialized");
+            if(uint8_t* out = take(sizeof(T)))
+            {
+                std::memcpy(out, &value, sizeof(T));
+            }
+        }
+    }
+
+    template<typename T>
+    static constexpr size_t sizeOf(const T& value)
+    {
+        if constexpr(Format::template IsScalar<T>)
+        {
+            return sizeof(T);
+        }
+        else if constexpr(std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+        {
+            return PrefixBytes + value.size();
+        }
+        else if constexpr(Format::template IsSpan<T>::value || std::is_array_v<T> || Format::template IsStdArray<T>::value)
+        {
+            size_t bytes = 0;
+            if constexpr(Format::template IsSpan<T>::value)
+            {
+                bytes = T::extent == std::dynamic_extent ? PrefixBytes : 0;
+            }
+            for(const auto& element : value)
+            {
+                bytes += sizeOf(element);
+            }
+            return bytes;
+        }
+        else if constexpr(Format::template HasSerializedFields<T>)
+        {
+            return std::apply([&value](auto... fields)
+            {
+                return (sizeOf(value.*fields) + ... + 0);
+            }, T::SerializedFields);
+        }
+        else
+        {
+            return sizeof(T);
+        }
+    }
+
+    std::span<uint8_t> m_buffer;
+    size_t m_size = 0;
+    size_t m_required = 0;
+    size_t m_oversizedLength = 0;
+    SerializationError m_error = SerializationError::None;
+};
+
+// Decodes what a MessageWriter of the same Order and Prefix wrote, typically out of an ISocket's getRecvBuffer()
+// Strings can be read as a std::string_view and byte spans as a std::span<const uint8_t>, both are views into the message and copy nothing
+// A dynamic std::span<T> of anything else is filled from the front and shrunk to the count that arrived
+// Once the message runs out the reader stops, values read from then on are left as they were
+template<std::endian Order, LengthPrefix Prefix = LengthPrefix::UInt16>
+class MessageReader
+{
+    using Format = Encoding<Order>;
+    static constexpr size_t PrefixBytes = static_cast<size_t>(Prefix);
+
+public:
+    explicit MessageReader(std::span<const uint8_t> data) : m_data(data)
+    {
+    }
+
+    // Reads the values in turn, false once the message ran out
+    template<typename... Values>
+    bool read(Values&&... values)
+    {
+        (decode(values), ...);
+        return m_error == SerializationError::None;
+    }
+
+    // Calls onMessage(MessageReader&) for each message of a batch written by MessageWriter::writeMessage(), returns how many there were
+    // A length running past the end stops it with BufferTooSmall
+    template<typename Handler>
+    size_t readMessages(Handler&& onMessage)
+    {
+        size_t messages = 0;
+        while(m_error == SerializationError::None && m_offset < m_data.size())
+        {
+            auto message = takeLengthPrefixed();
+            if(message.data() == nullptr)
+            {
+                break;
+            }
+            MessageReader reader(message);
+            onMessage(reader);
+            ++messages;
+        }
+        return messages;
+    }
+
+    explicit operator bool() const
+    {
+        return m_error == SerializationError::None;
+    }
+
+    SerializationError getError() const
+    {
+        return m_error;
+    }
+
+    // What the values read so far would have needed, more than the message's size after BufferTooSmall
+    size_t getRequiredBytes() const
+    {
+        return m_required;
+    }
+
+    size_t getRemainingBytes() const
+    {
+        return m_data.size() - m_offset;
+    }
+
+    // Everything not yet read, a view into the message
+    std::span<const uint8_t> remaining() const
+    {
+        return m_data.subspan(m_offset);
+    }
+
+private:
+    const uint8_t* take(size_t bytes)
+    {
+        m_required += bytes;
+        if(m_error != SerializationError::None || m_data.size() - m_offset < bytes)
+        {
+            m_error = SerializationError::BufferTooSmall;
+            return nullptr;
+        }
+        const uint8_t* in = m_data.data() + m_offset;
+        m_offset += bytes;
+        return in;
+    }
+
+    // The bytes following a length prefix, a null view when they aren't all there
+    std::span<const uint8_t> takeLengthPrefixed()
+    {
+        const uint8_t* prefix = take(PrefixBytes);
+        if(!prefix)
+        {
+            return {};
+        }
+        const uint64_t length = Format::LoadLength(prefix, PrefixBytes);
+        if(length > getRemainingBytes())
+        {
+            m_required += static_cast<size_t>(length);
+            m_error = SerializationError::BufferTooSmall;
+            return {};
+        }
+        return { take(static_cast<size_t>(length)), static_cast<size_t>(length) };
+    }
+
+    template<typename T>
+    void decodeRange(std::span<T> values)
+    {
+        if constexpr(Format::template IsMemoryLayout<T>)
+        {
+            if(const uint8_t* in = take(values.size_bytes()); in && !values.empty())
+            {
+                std::memcpy(values.data(), in, values.size_bytes());
+            }
+        }
+        else
+        {
+            for(auto& value : values)
+            {
+                decode(value);
+            }
+        }
+    }
+
+    template<typename T>
+    void decode(T& value)
+    {
+        if constexpr(Format::template IsScalar<T>)
+        {
+            if(const uint8_t* in = take(sizeof(T)))
+            {
+                value = Format::template Load<T>(in);
+            }
+        }
+        else if constexpr(std::is_same_v<T, std::string_view>)
+        {
+            if(auto bytes = takeLengthPrefixed(); bytes.data())
+            {
+                value = std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            }
+        }
+        else if constexpr(std::is_same_v<T, std::string>)
+        {
+            if(auto bytes = takeLengthPrefixed(); bytes.data())
+            {
+                value.assign(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            }
+        }
+        else if constexpr(Format::template IsSpan<T>::value)
+        {
+            using Element = typename T::element_type;
+            if constexpr(T::extent != std::dynamic_extent)
+            {
+                static_assert(!std::is_const_v<Element>, "A fixed span is read into, it can't be const");
+                decodeRange(std::span<Element>(value));
+            }
+            else if constexpr(std::is_const_v<Element>)
+            {
+                static_assert(Format::template IsByte<std::remove_const_t<Element>>, "Only byte spans can view the message, read anything else into a std::span<T>");
+                if(auto bytes = takeLengthPrefixed(); bytes.data())
+                {
+                    value = T(reinterpret_cast<Element*>(bytes.data()), bytes.size());
+                }
+            }
+            else
+            {
+                const uint8_t* prefix = take(PrefixBytes);
+                if(!prefix)
+                {
+                    return;
+                }
+                const size_t count = static_cast<size_t>(Format::LoadLength(prefix, PrefixBytes));
+                if(count > value.size()) // more than the caller has room for
+                {
+                    m_required += count * sizeof(Element);
+                    m_error = SerializationError::BufferTooSmall;
+                    return;
+                }
+                value = value.first(count);
+                decodeRange(value);
+            }
+        }
+        else if constexpr(std::is_array_v<T> || Format::template IsStdArray<T>::value)
+        {
+            decodeRange(std::span<std::remove_reference_t<decltype(value[0])>>(value));
+        }
+        else if constexpr(Format::template HasSerializedFields<T>)
+        {
+            std::apply([this, &value](auto... fields)
+            {
+                (decode(value.*fields), ...);
+            }, T::SerializedFields);
+        }
+        else
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "Only arithmetic types, enums, strings, arrays, spans and trivially copyable structs can be serialized");
+            if(const uint8_t* in = take(sizeof(T)))
+            {
+                std::memcpy(&value, in, sizeof(T));
+            }
+        }
+    }
+
+    std::span<const uint8_t> m_data;
+    size_t m_offset = 0;
+    size_t m_required = 0;
+    SerializationError m_error = SerializationError::None;
+};
@@ -0,0 +1,227 @@
+//
+//          Created by Riki Lowe on 17/09/2024.
+//
+//              Copyright Riki Lowe 2024
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include "ISocket.h"
+
+#include <algorithm>
+#include <span>
+#include <tuple>
+#include <vector>
+
+// Reads and writes across any number of sockets, handed to the kernel together through one io_uring_enter
+// Reads wait up to their socket's timeout (a socket without one waits for data), writes to a socket go out in the order they were added
+// and a short one cancels the writes after it. Operations run synchronously on the calling thread whatever the socket's SocketType
+// Without io_uring, or for a socket that can't use it, each operation runs on its socket's reactor path in turn
+// The buffers must stay alive until submit() returns, the batch itself belongs to one thread
+class SocketBatch
+{
+public:
+    void read(ISocket& socket, std::span<uint8_t> data)
+    {
+        add(socket, SocketMode::Read, data.data(), data.size());
+    }
+
+    void write(ISocket& socket, std::span<const uint8_t> data)
+    {
+        add(socket, SocketMode::Write, const_cast<uint8_t*>(data.data()), data.size());
+    }
+
+    size_t size() const
+    {
+        return m_operations.size();
+    }
+
+    // Keeps the capacity, so a batch rebuilt every iteration stops allocating
+    void clear()
+    {
+        m_operations.clear();
+        m_results.clear();
+    }
+
+    // Runs everything added since the last clear(), the results are in the order the operations were added
+    std::span<const SocketResult> submit()
+    {
+        m_results.assign(m_operations.size(), SocketResult {});
+        // writes to one socket have to sit next to each other to be linked in order
+        std::sort(m_operations.begin(), m_operations.end(), [](const Operation& left, const Operation& right)
+        {
+            return std::tie(left.socket, left.mode, left.index) < std::tie(right.socket, right.mode, right.index);
+        });
+        lock();
+        for(auto& operation : m_operations)
+        {
+            auto& result = m_results[operation.index];
+            auto& socket = *operation.socket;
+            operation.isQueued = false;
+            if(auto invalid = socket.CheckIsValid(operation.mode, operation.data, operation.bufferSize); invalid != SocketErrorReason::None)
+            {
+                result = SocketResult::failed(invalid);
+                operation.isValid = false;
+                continue;
+            }
+            operation.isValid = true;
+            events(operation).preEvent();
+            operation.started = socket.metricsClock();
+        }
+    #ifdef HAS_IO_URING
+        submitToRing();
+    #endif
+        for(auto& operation : m_operations)
+        {
+            if(operation.isValid && !operation.isQueued)
+            {
+                auto& socket = *operation.socket;
+                m_results[operation.index] = operation.mode == SocketMode::Read ? socket.internalReadData(operation.data, operation.bufferSize) : socket.internalWriteData(operation.data, operation.bufferSize);
+            }
+        }
+        for(auto& operation : m_operations)
+        {
+            if(!operation.isValid)
+            {
+                continue;
+            }
+            auto& socket = *operation.socket;
+            auto& result = m_results[operation.index];
+            const bool isWrite = operation.mode == SocketMode::Write;
+            socket.recordMetrics(operation.mode, result, isWrite ? operation.bufferSize : 0, operation.started);
+            if(isWrite)
+            {
+                socket.CheckIsComplete(result, operation.bufferSize);
+            }
+            events(operation).postEvent(operation.data, result);
+        }
+        unlock();
+        return m_results;
+    }
+
+private:
+    struct Operation
+    {
+        ISocket* socket = nullptr;
+        SocketMode mode = SocketMode::Read;
+        uint8_t* data = nullptr;
+        size_t bufferSize = 0;
+        size_t index = 0; // where it was added, and where its result goes
+        bool isValid = false;
+        bool isQueued = false;
+        bool isCompleted = false;
+        SocketMetrics::Clock::time_point started {};
+    #ifdef HAS_IO_URING
+        iovec vector {};
+        IoUringOperation ring;
+    #endif
+    };
+
+    void add(ISocket& socket, SocketMode mode, uint8_t* data, size_t bufferSize)
+    {
+        Operation operation;
+        operation.socket = &socket;
+        operation.mode = mode;
+        operation.data = data;
+        operation.bufferSize = bufferSize;
+        operation.index = m_operations.size();
+        m_operations.push_back(operation);
+    }
+
+    static const SocketEvents& events(const Operation& operation)
+    {
+        auto& callbacks = operation.socket->m_socketEventCallbacks;
+        return operation.mode == SocketMode::Read ? callbacks.read : callbacks.write;
+    }
+
+    // Every direction lock involved, taken in address order so two batches can't deadlock
+    void lock()
+    {
+        m_locks.clear();
+        for(auto& operation : m_operations)
+        {
+            m_locks.push_back(operation.mode == SocketMode::Read ? &operation.socket->m_readMutex : &operation.socket->m_writeMutex);
+        }
+        std::sort(m_locks.begin(), m_locks.end());
+        m_locks.erase(std::unique(m_locks.begin(), m_locks.end()), m_locks.end());
+        for(auto* mutex : m_locks)
+        {
+            mutex->lock();
+        }
+    }
+
+    void unlock()
+    {
+        for(auto mutex = m_locks.rbegin(); mutex != m_locks.rend(); ++mutex)
+        {
+            (*mutex)->unlock();
+        }
+    }
+
+#ifdef HAS_IO_URING
+    void submitToRing()
+    {
+        if(!IoUring::isSupported() || !IoUring::threadRing().isOpen())
+        {
+            return;
+        }
+        auto& ring = IoUring::threadRing();
+        auto onCompletion = [this](uint64_t position, int transferred)
+        {
+            auto& operation = m_operations[position];
+            operation.isCompleted = true;
+            operation.socket->ringCompleted(operation.mode, operation.ring, transferred, m_results[operation.index]);
+        };
+        for(size_t i = 0; i < m_operations.size(); ++i)
+        {
+            auto& operation = m_operations[i];
+            auto& socket = *operation.socket;
+            const int handle = operation.isValid ? socket.getRingHandle() : -1;
+            if(handle < 0)
+            {
+                continue;
+            }
+            operation.vector = { operation.data, operation.bufferSize };
+            operation.ring = {};
+            operation.isCompleted = false;
+            operation.ring.message.msg_iov = &operation.vector;
+            operation.ring.message.msg_iovlen = 1;
+            socket.beginRingOperation(operation.mode, operation.ring);
+            const bool read = operation.mode == SocketMode::Read;
+            const uint32_t timeoutMs = read ? socket.getRingTimeoutMs() : 0;
+            // the next write to this socket only goes once this one has, in full
+            const bool linkNext = !read && i + 1 < m_operations.size() && m_operations[i + 1].socket == operation.socket && m_operations[i + 1].mode == operation.mode;
+            if(!ring.queue(read, handle, operation.ring, i, timeoutMs, linkNext && ring.getFreeEntries() > 1))
+            {
+                // the ring is full, finish what is on it to make room
+                completeRing(ring.submitAndWait(onCompletion));
+                if(!ring.queue(read, handle, operation.ring, i, timeoutMs, linkNext && ring.getFreeEntries() > 1))
+                {
+                    continue;
+                }
+            }
+            operation.isQueued = true;
+        }
+        completeRing(ring.submitAndWait(onCompletion));
+    }
+
+    // Only a broken ring fails io_uring_enter, whatever it still held fails with it
+    void completeRing(int failed)
+    {
+        for(auto& operation : m_operations)
+        {
+            if(failed && operation.isQueued && !operation.isCompleted)
+            {
+                operation.isCompleted = true;
+                operation.socket->ringCompleted(operation.mode, operation.ring, failed, m_results[operation.index]);
+            }
+        }
+    }
+#endif
+
+    std::vector<Operation> m_operations;
+    std::vector<SocketResult> m_results;
+    std::vector<std::mutex*> m_locks;
+};
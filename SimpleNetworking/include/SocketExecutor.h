@@ -0,0 +1,134 @@
+//
+//          Created by Riki Lowe on 17/09/2024.
+//
+//              Copyright Riki Lowe 2024
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <optional>
+#include <boost/asio.hpp>
+
+// Process-wide pool of threads running one shared io_context
+// Sockets post their non-blocking operations here instead of spawning a thread per operation, one that has to wait
+// for its socket waits on the io_context's reactor, so the thread count stays at the pool's size however many sockets are idle
+class SocketExecutor
+{
+public:
+    using WorkGuard = boost::asio::executor_work_guard<boost::asio::io_context::executor_type>;
+
+    static constexpr size_t MinimumThreadCount = 2;
+
+    static SocketExecutor& instance()
+    {
+        static SocketExecutor executor(getDefaultThreadCount());
+        return executor;
+    }
+
+    static size_t getDefaultThreadCount()
+    {
+        return std::max<size_t>(MinimumThreadCount, std::thread::hardware_concurrency());
+    }
+
+    explicit SocketExecutor(size_t threadCount)
+    {
+        start(threadCount);
+    }
+
+    SocketExecutor(const SocketExecutor&) = delete;
+    SocketExecutor& operator=(const SocketExecutor&) = delete;
+
+    // Abandons whatever is still queued rather than drain it, a socket left open at exit keeps a wait outstanding forever
+    ~SocketExecutor()
+    {
+        std::lock_guard lock(m_poolMutex);
+        m_ioContext.stop();
+        joinThreads();
+    }
+
+    // Stops the io_context rather than draining it, so open sockets, their pending waits, continuous reads and accept loops
+    // carry on under the new threads. Handlers already running finish first, so not from one of the pool's own threads
+    void setThreadCount(size_t threadCount)
+    {
+        std::lock_guard lock(m_poolMutex);
+        m_ioContext.stop();
+        joinThreads();
+        internalStart(threadCount);
+    }
+
+    size_t getThreadCount()
+    {
+        std::lock_guard lock(m_poolMutex);
+        return m_threads.size();
+    }
+
+    template<typename Operation>
+    void post(Operation&& operation)
+    {
+        boost::asio::post(m_ioContext, std::forward<Operation>(operation));
+    }
+
+    boost::asio::io_context& getContext()
+    {
+        return m_ioContext;
+    }
+
+    void start(size_t threadCount)
+    {
+        std::lock_guard lock(m_poolMutex);
+        internalStart(threadCount);
+    }
+
+    // Like setThreadCount(), the io_context stops rather than drains, waits for open sockets are kept for start()
+    // Draining would never end while a socket is open. Handlers already running finish first, so not from one of the pool's own threads
+    void stop()
+    {
+        std::lock_guard lock(m_poolMutex);
+        m_ioContext.stop();
+        joinThreads();
+    }
+
+private:
+    void internalStart(size_t threadCount)
+    {
+        if(!m_threads.empty())
+        {
+            return;
+        }
+        // a guard left over from setThreadCount() finishes its work as it is replaced, which stops the context, so restart afterwards
+        m_workGuard.emplace(m_ioContext.get_executor());
+        m_ioContext.restart();
+        threadCount = std::max<size_t>(1, threadCount);
+        m_threads.reserve(threadCount);
+        for(size_t i = 0; i < threadCount; ++i)
+        {
+            m_threads.emplace_back([this]()
+            {
+                m_ioContext.run();
+            });
+        }
+    }
+
+    void joinThreads()
+    {
+        for(auto& thread : m_threads)
+        {
+            if(thread.joinable())
+            {
+                thread.join();
+            }
+        }
+        m_threads.clear();
+    }
+
+    boost::asio::io_context m_ioContext;
+    std::optional<WorkGuard> m_workGuard;
+    std::vector<std::thread> m_threads;
+    std::mutex m_poolMutex;
+};
@@ -0,0 +1,172 @@
+//
+//          Created by Riki Lowe on 17/09/2024.
+//
+//              Copyright Riki Lowe 2024
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include "ISocket.h"
+#include "TCPSocket.h"
+
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// A few event loops, each an io_context run by a single thread, serving any number of UDP, TCP and serial sockets
+// A socket joins the least loaded loop while it is closed, from then on its continuous reads, coroutines and non-blocking operations run there
+// Adding and removing take a slot off and back onto a free list, the group's share of a socket is one Slot
+// Sockets have to be closed before they are removed, and removed before the group goes, an open socket keeps its loop running
+class SocketGroup
+{
+public:
+    // Stays valid until remove(), a slot reused afterwards gets a new generation
+    struct Handle
+    {
+        static constexpr uint32_t Invalid = std::numeric_limits<uint32_t>::max();
+
+        uint32_t index = Invalid;
+        uint32_t generation = 0;
+
+        explicit operator bool() const
+        {
+            return index != Invalid;
+        }
+    };
+
+    static size_t getDefaultLoopCount()
+    {
+        return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    explicit SocketGroup(size_t loopCount = getDefaultLoopCount())
+    {
+        loopCount = std::max<size_t>(1, loopCount);
+        m_loops.reserve(loopCount);
+        for(size_t i = 0; i < loopCount; ++i)
+        {
+            m_loops.push_back({ std::make_unique<SocketExecutor>(1), 0 });
+        }
+    }
+
+    SocketGroup(const SocketGroup&) = delete;
+    SocketGroup& operator=(const SocketGroup&) = delete;
+
+    // Moves the socket onto the least loaded loop, an invalid handle when it is open or its transport can't move
+    Handle add(ISocket& socket)
+    {
+        return add(&socket, nullptr);
+    }
+
+    Handle add(TCPServer& server)
+    {
+        return add(nullptr, &server);
+    }
+
+    // Hands the socket back to the SocketExecutor's io_context, false for a stale handle or an open socket
+    bool remove(Handle handle)
+    {
+        std::lock_guard lock(m_mutex);
+        if(handle.index >= m_slots.size() || m_slots[handle.index].generation != handle.generation)
+        {
+            return false;
+        }
+        auto& slot = m_slots[handle.index];
+        auto& shared = SocketExecutor::instance().getContext();
+        const bool moved = slot.socket ? slot.socket->setEventLoop(shared) : slot.server && slot.server->setEventLoop(shared);
+        if(!moved)
+        {
+            return false;
+        }
+        --m_loops[slot.loop].socketCount;
+        --m_socketCount;
+        slot.socket = nullptr;
+        slot.server = nullptr;
+        ++slot.generation;
+        slot.nextFree = m_freeSlot;
+        m_freeSlot = handle.index;
+        return true;
+    }
+
+    size_t getSocketCount() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_socketCount;
+    }
+
+    size_t getLoopCount() const
+    {
+        return m_loops.size();
+    }
+
+    size_t getLoopSocketCount(size_t loop) const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_loops.at(loop).socketCount;
+    }
+
+    // For anything else that should run alongside a loop's sockets, timers or coroutines of the application's own
+    io_context& getLoop(size_t loop)
+    {
+        return m_loops.at(loop).executor->getContext();
+    }
+
+private:
+    struct Slot
+    {
+        ISocket* socket = nullptr;
+        TCPServer* server = nullptr;
+        uint32_t generation = 0;
+        uint32_t loop = 0;
+        uint32_t nextFree = Handle::Invalid;
+    };
+
+    struct Loop
+    {
+        std::unique_ptr<SocketExecutor> executor;
+        size_t socketCount = 0;
+    };
+
+    Handle add(ISocket* socket, TCPServer* server)
+    {
+        std::lock_guard lock(m_mutex);
+        // a handful of loops, so finding the quietest is a short scan
+        uint32_t loop = 0;
+        for(uint32_t i = 1; i < m_loops.size(); ++i)
+        {
+            loop = m_loops[i].socketCount < m_loops[loop].socketCount ? i : loop;
+        }
+        auto& context = m_loops[loop].executor->getContext();
+        if(!(socket ? socket->setEventLoop(context) : server->setEventLoop(context)))
+        {
+            return {};
+        }
+        uint32_t index = m_freeSlot;
+        if(index == Handle::Invalid)
+        {
+            index = static_cast<uint32_t>(m_slots.size());
+            m_slots.emplace_back();
+        }
+        else
+        {
+            m_freeSlot = m_slots[index].nextFree;
+        }
+        auto& slot = m_slots[index];
+        slot.socket = socket;
+        slot.server = server;
+        slot.loop = loop;
+        slot.nextFree = Handle::Invalid;
+        ++m_loops[loop].socketCount;
+        ++m_socketCount;
+        return { index, slot.generation };
+    }
+
+    std::vector<Loop> m_loops;
+    std::vector<Slot> m_slots;
+    uint32_t m_freeSlot = Handle::Invalid;
+    size_t m_socketCount = 0;
+    mutable std::mutex m_mutex;
+};
@@ -0,0 +1,207 @@
+//
+//          Created by Riki Lowe on 17/09/2024.
+//
+//              Copyright Riki Lowe 2024
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+//
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+// Log-bucketed latency histogram in the style of HdrHistogram
+// Every power of two is split into SubBucketCount linear buckets, so any value is held to within 1/SubBucketCount of itself
+// Recording is a single relaxed fetch_add, values past MaxValue land in the top bucket
+class LatencyHistogram
+{
+public:
+    static constexpr uint32_t SubBucketBits = 3;
+    static constexpr uint64_t SubBucketCount = 1ull << SubBucketBits;
+    static constexpr uint32_t MaxValueBits = 36; // ~68s in nanoseconds
+    static constexpr uint64_t MaxValue = (1ull << MaxValueBits) - 1;
+    static constexpr size_t BucketCount = 2 * SubBucketCount + (MaxValueBits - SubBucketBits - 1) * SubBucketCount;
+
+    using Counts = std::array<uint64_t, BucketCount>;
+
+    // Values below 2 * SubBucketCount get a bucket each, above that the top SubBucketBits + 1 bits pick the bucket
+    static constexpr size_t bucketIndex(uint64_t value)
+    {
+        value = std::min(value, MaxValue);
+        const uint32_t magnitude = static_cast<uint32_t>(std::bit_width(value));
+        if(magnitude <= SubBucketBits + 1)
+        {
+            return static_cast<size_t>(value);
+        }
+        const uint32_t shift = magnitude - (SubBucketBits + 1);
+        return static_cast<size_t>(2 * SubBucketCount + (shift - 1) * SubBucketCount + ((value >> shift) - SubBucketCount));
+    }
+
+    static constexpr uint64_t bucketLowerBound(size_t index)
+    {
+        if(index < 2 * SubBucketCount)
+        {
+            return index;
+        }
+        const uint64_t shift = (index - 2 * SubBucketCount) / SubBucketCount + 1;
+        return ((index - 2 * SubBucketCount) % SubBucketCount + SubBucketCount) << shift;
+    }
+
+    static constexpr uint64_t bucketUpperBound(size_t index)
+    {
+        return index + 1 < BucketCount ? bucketLowerBound(index + 1) - 1 : MaxValue;
+    }
+
+    // Snapshot of the counts, can be taken while other threads record
+    struct Snapshot
+    {
+        Counts counts {};
+        uint64_t count = 0;
+
+        // The highest value that shares a bucket with the requested percentile (0 to 1), 0 when nothing was recorded
+        std::chrono::nanoseconds getPercentile(double percentile) const
+        {
+            if(count == 0)
+            {
+                return {};
+            }
+            const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(percentile * count + 0.5));
+            uint64_t seen = 0;
+            for(size_t i = 0; i < counts.size(); ++i)
+            {
+                seen += counts[i];
+                if(seen >= rank)
+                {
+                    return std::chrono::nanoseconds(bucketUpperBound(i));
+                }
+            }
+            return std::chrono::nanoseconds(MaxValue);
+        }
+    };
+
+    void record(std::chrono::nanoseconds latency)
+    {
+        m_counts[bucketIndex(static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0)))].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Snapshot snapshot() const
+    {
+        Snapshot snapshot;
+        for(size_t i = 0; i < BucketCount; ++i)
+        {
+            snapshot.counts[i] = m_counts[i].load(std::memory_order_relaxed);
+            snapshot.count += snapshot.counts[i];
+        }
+        return snapshot;
+    }
+
+    void reset()
+    {
+        for(auto& count : m_counts)
+        {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, BucketCount> m_counts {};
+};
+
+struct SocketDirectionMetrics
+{
+    uint64_t operations = 0; // operations that reached the transport, a batch is one operation
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+    uint64_t timeouts = 0;
+    uint64_t partialWrites = 0;
+    LatencyHistogram::Snapshot latency;
+};
+
+struct SocketMetricsSnapshot
+{
+    SocketDirectionMetrics read;
+    SocketDirectionMetrics write;
+    LatencyHistogram::Snapshot receiveDelay; // kernel timestamp to the read returning, for sockets that have kernel timestamps
+};
+
+// Counters and latency histograms for one socket, every field is atomic so snapshot() never takes a socket lock
+// Sockets only have one once ISocket::enableMetrics() is called, until then nothing is allocated or counted
+// Reads and writes keep their own cache lines, the two directions of a ReadWrite socket run on different threads
+class SocketMetrics
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct alignas(64) Direction
+    {
+        // expectedBytes is only checked for writes, pass 0 for reads
+        // Two relaxed atomic adds when the operation succeeds, the operation count is the histogram's own
+        void record(bool success, bool timedOut, size_t bytes, size_t expectedBytes, std::chrono::nanoseconds latency)
+        {
+            this->bytes.fetch_add(bytes, std::memory_order_relaxed);
+            if(timedOut)
+            {
+                timeouts.fetch_add(1, std::memory_order_relaxed);
+            }
+            else if(!success)
+            {
+                errors.fetch_add(1, std::memory_order_relaxed);
+            }
+            else if(expectedBytes != 0 && bytes != expectedBytes)
+            {
+                partialWrites.fetch_add(1, std::memory_order_relaxed);
+            }
+            this->latency.record(latency);
+        }
+
+        SocketDirectionMetrics snapshot() const
+        {
+            auto latencySnapshot = latency.snapshot();
+            return SocketDirectionMetrics
+            {
+                latencySnapshot.count,
+                bytes.load(std::memory_order_relaxed),
+                errors.load(std::memory_order_relaxed),
+                timeouts.load(std::memory_order_relaxed),
+                partialWrites.load(std::memory_order_relaxed),
+                latencySnapshot
+            };
+        }
+
+        void reset()
+        {
+            bytes.store(0, std::memory_order_relaxed);
+            errors.store(0, std::memory_order_relaxed);
+            timeouts.store(0, std::memory_order_relaxed);
+            partialWrites.store(0, std::memory_order_relaxed);
+            latency.reset();
+        }
+
+        std::atomic<uint64_t> bytes = 0;
+        std::atomic<uint64_t> errors = 0;
+        std::atomic<uint64_t> timeouts = 0;
+        std::atomic<uint64_t> partialWrites = 0;
+        LatencyHistogram latency;
+    };
+
+    SocketMetricsSnapshot snapshot() const
+    {
+        return { read.snapshot(), write.snapshot(), receiveDelay.snapshot() };
+    }
+
+    void reset()
+    {
+        read.reset();
+        write.reset();
+        receiveDelay.reset();
+    }
+
+    Direction read;
+    Direction write;
+    LatencyHistogram receiveDelay;
+};
@@ -8,12 +8,10 @@
 //
 #pragma once
 
-/*
-
-// Not ready - needs further testing as of 17/09/2024
-
 #include "ISocket.h"
 
+#include <unordered_map>
+
 #define DEFAULT_TCP_RECV_MSG_FLAG 0 // same windows or posix flags
 #define DEFAULT_TCP_SEND_MSG_FLAG 0 // same windows or posix flags
 
@@ -25,8 +23,45 @@ public:
     using BoostTCP = boost::asio::ip::tcp;
 
     TCPSocket(SocketType type, SocketMode mode, const std::string& address, uint16_t port, SocketRole role = DefaultRole, uint32_t timeoutMs = 20, uint32_t byteIntervalMs = 10)
-    : ISocket(type, mode, role, address, port, timeoutMs, byteIntervalMs, static_cast<size_t>(BufferSize::TCP), static_cast<size_t>(BufferSize::TCP)), m_tcpSocket(m_ioService)
+    : ISocket(type, mode, role, address, port, timeoutMs, byteIntervalMs, static_cast<size_t>(BufferSize::TCP), static_cast<size_t>(BufferSize::TCP)), m_tcpSocket(*m_ioContext)
+    {
+    }
+
+    ~TCPSocket() override
+    {
+        TCPSocket::close();
+    }
+
+    bool isOpen() const override
     {
+        return m_tcpSocket.is_open();
+    }
+
+    void cancel() override
+    {
+        boost::system::error_code err;
+        m_tcpSocket.cancel(err);
+        m_readinessWaiter.cancel();
+    }
+
+    void close() override
+    {
+        if(m_readContinuously)
+        {
+            stopReadingContinuously();
+        }
+        if(isOpen())
+        {
+            // the peer may already have gone, so a failed shutdown isn't worth reporting
+            boost::system::error_code err;
+            m_tcpSocket.shutdown(BoostTCP::socket::shutdown_both, err);
+            CheckForError([this](boost::system::error_code& err)
+            {
+                m_tcpSocket.close(err);
+            });
+            m_readinessWaiter.cancel(); // shutdown() normally wakes a waiting reader already, this doesn't leave it to
+            ISocket::close();
+        }
     }
 
     std::string getSocketName() const override
@@ -34,12 +69,119 @@ public:
         return m_address + ":" + std::to_string(m_port);
     }
 
+    BoostTCP::socket::native_handle_type getNativeHandle()
+    {
+        return m_tcpSocket.native_handle();
+    }
+
 protected:
+    bool rebindEventLoop(io_context& context) override
+    {
+        m_tcpSocket = BoostTCP::socket(context);
+        return true;
+    }
+
+    // Writes go out as soon as they are made, otherwise Nagle holds back the tail of anything larger than a segment until the peer's delayed ACK
+    bool setNoDelay()
+    {
+        return CheckForError([this](boost::system::error_code& err)
+        {
+            m_tcpSocket.set_option(BoostTCP::no_delay(true), err);
+        });
+    }
+
+    // A write the peer isn't keeping up with still waits in the kernel for the rest of its room
+    bool isReady(SocketMode mode) override
+    {
+        return ReadinessWaiter::IsReady(m_tcpSocket, mode == SocketMode::Read ? POLLIN : POLLOUT);
+    }
+
+    void asyncWaitReady(SocketMode mode, std::function<void(const boost::system::error_code&)> handler) override
+    {
+        m_tcpSocket.async_wait(mode == SocketMode::Read ? BoostTCP::socket::wait_read : BoostTCP::socket::wait_write, std::move(handler));
+    }
+
+    // Like waitWritable(), only a deadline bounds a write
+    uint32_t getWaitTimeoutMs(SocketMode mode) const override
+    {
+        return mode == SocketMode::Read ? m_timeoutMs : 0;
+    }
+
+#ifdef HAS_IO_URING
+    int getRingHandle() override
+    {
+        return m_tcpSocket.is_open() ? m_tcpSocket.native_handle() : -1;
+    }
+
+    void beginRingOperation([[maybe_unused]] SocketMode mode, IoUringOperation& operation) override
+    {
+        operation.useMessage = true; // sendmsg with MSG_NOSIGNAL, writev would raise SIGPIPE once the peer has gone
+    }
+
+    // Nothing read means the peer closed its end, the same eof the reactor reports
+    void endRingOperation(SocketMode mode, [[maybe_unused]] IoUringOperation& operation, SocketResult& result, boost::system::error_code& err) override
+    {
+        if(mode == SocketMode::Read && result.bytes == 0)
+        {
+            err = boost::asio::error::eof;
+        }
+    }
+#endif
+
+    boost::system::error_code waitReadable()
+    {
+        return m_readinessWaiter.waitForData(m_tcpSocket, operationDeadline(SocketMode::Read));
+    }
+
+    // Writes block in the kernel, only a deadline overload waits for room first
+    boost::system::error_code waitWritable()
+    {
+        return hasOperationDeadline(SocketMode::Write) ? m_readinessWaiter.waitUntil(m_tcpSocket, POLLOUT, getOperationDeadline(SocketMode::Write)) : boost::system::error_code();
+    }
+
+#ifndef _WIN32
+    // SocketType::BusyPoll spins on the socket first, false once the spin budget is spent with nothing read
+    bool receiveBusyPolling(iovec* vectors, size_t count, SocketResult& result, boost::system::error_code& err)
+    {
+        msghdr message {};
+        message.msg_iov = vectors;
+        message.msg_iovlen = count;
+        const ssize_t bytes = busyPollReceive(m_tcpSocket.native_handle(), message);
+        if(bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return false;
+        }
+        if(bytes < 0)
+        {
+            err = LastSystemError();
+        }
+        else if(bytes == 0)
+        {
+            err = boost::asio::error::eof;
+        }
+        result.bytes = bytes > 0 ? static_cast<size_t>(bytes) : 0;
+        return true;
+    }
+#endif
+
     SocketResult internalReadData(unsigned char* data, size_t bufferSize) override
     {
-        SocketResult result;
-        result.success = CheckForError([&](boost::system::error_code& err)
+        SocketResult result {};
+        CheckForError(result, [&](boost::system::error_code& err)
         {
+        #ifndef _WIN32
+            iovec vector { data, bufferSize };
+            if(m_type == SocketType::BusyPoll && receiveBusyPolling(&vector, 1, result, err))
+            {
+                return;
+            }
+        #endif
+            err = waitReadable();
+            if(err)
+            {
+                result.timedOut = err == boost::asio::error::timed_out;
+                return;
+            }
             result.bytes = m_tcpSocket.receive(boost::asio::buffer(data, bufferSize), DEFAULT_TCP_RECV_MSG_FLAG, err);
         });
         return result;
@@ -47,28 +189,101 @@ protected:
 
     SocketResult internalWriteData(unsigned char* data, size_t bufferSize) override
     {
-        SocketResult result;
-        result.success = CheckForError([&](boost::system::error_code& err)
+        SocketResult result {};
+        CheckForError(result, [&](boost::system::error_code& err)
+        {
+            err = waitWritable();
+            if(err)
+            {
+                result.timedOut = err == boost::asio::error::timed_out;
+                return;
+            }
+            result.bytes = boost::asio::write(m_tcpSocket, boost::asio::buffer(data, bufferSize), err);
+        });
+        return result;
+    }
+
+    // Like internalReadData, takes whatever has arrived and spreads it across the buffers in order
+    SocketResult internalReadBuffers(MutableBuffers buffers) override
+    {
+        SocketResult result {};
+        CheckForError(result, [&](boost::system::error_code& err)
+        {
+        #ifndef _WIN32
+            if(m_type == SocketType::BusyPoll)
+            {
+                std::array<iovec, MaxBufferCount> vectors;
+                for(size_t i = 0; i < buffers.size(); ++i)
+                {
+                    vectors[i] = { buffers[i].data(), buffers[i].size() };
+                }
+                if(receiveBusyPolling(vectors.data(), buffers.size(), result, err))
+                {
+                    return;
+                }
+            }
+        #endif
+            err = waitReadable();
+            if(err)
+            {
+                result.timedOut = err == boost::asio::error::timed_out;
+                return;
+            }
+            result.bytes = m_tcpSocket.receive(buffers, DEFAULT_TCP_RECV_MSG_FLAG, err);
+        });
+        return result;
+    }
+
+    // sendmsg with every buffer at once, repeated from wherever a short write left off
+    SocketResult internalWriteBuffers(ConstBuffers buffers) override
+    {
+        SocketResult result {};
+        CheckForError(result, [&](boost::system::error_code& err)
         {
-            result.bytes = m_tcpSocket.send(boost::asio::buffer(data, bufferSize), DEFAULT_TCP_SEND_MSG_FLAG, err);
+            result.bytes = boost::asio::write(m_tcpSocket, buffers, err);
         });
         return result;
     }
-    
+
+    AwaitableSocketResult internalAsyncReadData(unsigned char* data, size_t bufferSize) override
+    {
+        SocketResult result {};
+        boost::system::error_code err;
+        result.bytes = co_await m_tcpSocket.async_read_some(boost::asio::buffer(data, bufferSize), boost::asio::redirect_error(boost::asio::use_awaitable, err));
+        CheckAsyncResult(result, err);
+        co_return result;
+    }
+
+    AwaitableSocketResult internalAsyncWriteData(unsigned char* data, size_t bufferSize) override
+    {
+        SocketResult result {};
+        boost::system::error_code err;
+        result.bytes = co_await boost::asio::async_write(m_tcpSocket, boost::asio::buffer(data, bufferSize), boost::asio::redirect_error(boost::asio::use_awaitable, err));
+        CheckAsyncResult(result, err);
+        co_return result;
+    }
+
     BoostTCP::socket m_tcpSocket;
     BoostTCP::endpoint m_endPoint;
+    ReadinessWaiter m_readinessWaiter;
 };
 
 class TCPClient : public TCPSocket
 {
 public:
-    TCPClient(SocketType type, const std::string& address, uint16_t port)
-        : TCPSocket(type, SocketMode::Write, address, port, SocketRole::Client)
+    TCPClient(SocketType type, const std::string& address, uint16_t port, uint32_t timeoutMs = 20)
+        : TCPClient(type, SocketMode::Write, address, port, timeoutMs)
+    {
+    }
+
+    TCPClient(SocketType type, SocketMode mode, const std::string& address, uint16_t port, uint32_t timeoutMs = 20)
+        : TCPSocket(type, mode, address, port, SocketRole::Client, timeoutMs)
     {
     }
 
     bool open() override
     {
+        close();
         m_address = toV4();
         m_initialised = CheckForError([this](boost::system::error_code& err)
         {
@@ -78,77 +293,414 @@ public:
         {
             m_initialised = CheckForError([this](boost::system::error_code& err)
             {
-                m_tcpSocket.connect(m_endPoint, err);
-            });
+                connectWithinTimeout(err);
+            }) && setNoDelay();
+        }
+    #ifndef _WIN32
+        if(m_initialised)
+        {
+            applyBusyPoll(m_tcpSocket.native_handle());
         }
-        return m_initialised && isOpen();
+    #endif
+        if(!m_initialised)
+        {
+            close();
+            return false;
+        }
+        return ISocket::open();
+    }
+
+private:
+    void connectWithinTimeout(boost::system::error_code& err)
+    {
+        ConnectWithin(m_tcpSocket, m_endPoint, m_readinessWaiter, m_timeoutMs, err);
+    }
+
+public:
+    // timed_out after timeoutMs rather than the minutes of SYN retries a blocking connect sits through, 0 leaves it to the kernel
+    // The wait is on the waiter, so cancelling it gives up the connect. TCPClientTransport connects the same way
+    static void ConnectWithin(BoostTCP::socket& socket, const BoostTCP::endpoint& endPoint, ReadinessWaiter& waiter, uint32_t timeoutMs, boost::system::error_code& err)
+    {
+    #ifndef _WIN32
+        socket.open(endPoint.protocol(), err);
+        if(!err)
+        {
+            socket.non_blocking(true, err);
+        }
+        if(err)
+        {
+            return;
+        }
+        const auto handle = socket.native_handle();
+        if(::connect(handle, endPoint.data(), static_cast<socklen_t>(endPoint.size())) != 0)
+        {
+            err = LastSystemError();
+            if(err == boost::asio::error::in_progress || err == boost::asio::error::interrupted)
+            {
+                err = waiter.waitUntil(socket, POLLOUT, ReadinessWaiter::DeadlineAfter(timeoutMs));
+            }
+            if(!err)
+            {
+                int connectError = 0;
+                socklen_t connectErrorSize = sizeof(connectError);
+                err = ::getsockopt(handle, SOL_SOCKET, SO_ERROR, &connectError, &connectErrorSize) == 0
+                    ? boost::system::error_code(connectError, boost::asio::error::get_system_category()) : LastSystemError();
+            }
+        }
+        if(!err)
+        {
+            socket.non_blocking(false, err); // reads and writes wait for themselves
+        }
+    #else
+        socket.connect(endPoint, err);
+    #endif
     }
 };
 
-class TCPServer : public TCPSocket
+// One accepted peer of a TCPServer
+// The server keeps a read outstanding on it, so data arrives through its read callbacks, and it can be written to like any other ISocket
+class TCPConnection : public TCPSocket
 {
 public:
-    TCPServer(SocketType type, const std::string& address, uint16_t port)
-        : TCPSocket(type, SocketMode::Read, address, port, SocketRole::Server), m_acceptor(m_ioService, m_endPoint.protocol())
+    TCPConnection(SocketType type, BoostTCP::socket&& socket, const SocketEventCallbacks& socketEventCallbacks)
+        : TCPSocket(type, SocketMode::ReadWrite, "", 0, SocketRole::Server, 0)
     {
+        boost::system::error_code err;
+        m_ioContext = &static_cast<io_context&>(socket.get_executor().context()); // the accepting server's event loop, always an io_context
+        m_tcpSocket = std::move(socket);
+        m_endPoint = m_tcpSocket.remote_endpoint(err);
+        m_address = m_endPoint.address().to_string();
+        m_port = m_endPoint.port();
+        m_socketEventCallbacks = socketEventCallbacks;
+        m_initialised = m_tcpSocket.is_open() && setNoDelay();
+    #ifndef _WIN32
+        if(m_initialised)
+        {
+            applyBusyPoll(m_tcpSocket.native_handle());
+        }
+    #endif
     }
 
-    void close() override
+    // Accepted connections are already open
+    bool open() override
+    {
+        return ISocket::open();
+    }
+
+    // Ends the outstanding read so the receive loop closes the connection itself, rather than two threads closing one socket
+    void shutdown()
+    {
+        boost::system::error_code err;
+        m_tcpSocket.shutdown(BoostTCP::socket::shutdown_both, err);
+    }
+
+    boost::asio::awaitable<void> receiveUntilClosed()
+    {
+        while(isOpen())
+        {
+            auto result = co_await asyncRead();
+            if(!result)
+            {
+                break;
+            }
+        }
+        close();
+    }
+};
+
+struct TCPServerCallbacks
+{
+    using ConnectionCallback = std::function<void(const std::shared_ptr<TCPConnection>&)>;
+
+    ConnectionCallback acceptedCallback; // runs before the first read, so connection callbacks can be replaced here
+    ConnectionCallback closedCallback;
+    SocketEventCallbacks connection; // copied into every accepted connection
+
+    inline void accepted(const std::shared_ptr<TCPConnection>& connection) const { if(acceptedCallback) { acceptedCallback(connection); } }
+    inline void closed(const std::shared_ptr<TCPConnection>& connection) const { if(closedCallback) { closedCallback(connection); } }
+};
+
+// Accepts any number of peers on the shared SocketExecutor io_context, or on a SocketGroup's event loop
+// Every connection costs one TCPConnection and its two fixed BufferSize::TCP buffers, and maxConnections bounds the total
+class TCPServer
+{
+public:
+    using BoostAddress = boost::asio::ip::address;
+    using BoostAddressV4 = boost::asio::ip::address_v4;
+    using BoostTCP = boost::asio::ip::tcp;
+    using ConnectionPtr = std::shared_ptr<TCPConnection>;
+
+    static constexpr size_t DefaultMaxConnections = 16384;
+    static constexpr uint32_t AcceptBackOffMs = 10;
+
+    TCPServer(SocketType type, const std::string& address, uint16_t port, size_t maxConnections = DefaultMaxConnections)
+        : m_listener(std::make_shared<Listener>(SocketExecutor::instance().getContext(), type, maxConnections)), m_address(address), m_port(port)
+    {
+    }
+
+    ~TCPServer()
+    {
+        close();
+    }
+
+    // From the event loop close() can only post the acceptor's close, reopening has to wait until that has run
+    // On the accept loop's strand it closes straight away, the old accept loop then ends on its own and a new listener takes over
+    bool open()
+    {
+        close();
+        if(m_acceptLoop.valid())
+        {
+            if(!m_listener->strand.running_in_this_thread() && m_acceptLoop.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                m_listener->setLastError({ SocketErrorReason::StillClosing });
+                return false;
+            }
+            replaceListener(*m_listener->ioContext);
+        }
+        if(m_address == "localhost")
+        {
+            m_address = "127.0.0.1";
+        }
+        auto& acceptor = m_listener->acceptor;
+        bool opened = m_listener->CheckForError([this, &acceptor](boost::system::error_code& err)
+        {
+            m_endPoint = m_address.empty() ? BoostTCP::endpoint(BoostAddressV4::any(), m_port) : BoostTCP::endpoint(BoostAddress::from_string(m_address, err), m_port);
+            if (!err)
+            {
+                acceptor.open(m_endPoint.protocol(), err);
+            }
+            if (!err)
+            {
+                acceptor.set_option(BoostTCP::acceptor::reuse_address(true), err);
+            }
+            if (!err)
+            {
+                acceptor.bind(m_endPoint, err);
+            }
+            if (!err)
+            {
+                acceptor.listen(boost::asio::socket_base::max_listen_connections, err);
+            }
+        });
+        if(!opened)
+        {
+            close();
+            return false;
+        }
+        m_acceptLoop = boost::asio::co_spawn(m_listener->strand, AcceptConnections(m_listener), boost::asio::use_future);
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return m_listener->acceptor.is_open();
+    }
+
+    // Moves the server onto another event loop, a SocketGroup's, only while it is closed. Its connections are served on the same loop
+    // The listener is replaced rather than rebuilt, a close() posted from the old loop may still be on its way to it
+    bool setEventLoop(io_context& context)
     {
         if(isOpen())
         {
-            if (m_acceptor.is_open() && m_acceptorListeningState)
+            return false;
+        }
+        replaceListener(context);
+        return true;
+    }
+
+    io_context& getEventLoop() const
+    {
+        return *m_listener->ioContext;
+    }
+
+    // From the server's own callbacks, or anything else on its event loop, close() can't wait for the loop it is holding up
+    // The acceptor then closes on the accept loop's strand as soon as the loop gets to it. Both hold the listener
+    // rather than the server, so the server may be destroyed in the meantime
+    void close()
+    {
+        if(m_acceptLoop.valid())
+        {
+            // the accept loop uses the acceptor on its strand, so it is closed there too
+            if(m_listener->strand.running_in_this_thread())
             {
-                //In case the acceptor is blocking in listening state
-                CheckForError([this](boost::system::error_code& err)
+                m_listener->closeAcceptor();
+            }
+            else if(m_listener->ioContext->get_executor().running_in_this_thread())
+            {
+                boost::asio::post(m_listener->strand, [listener = m_listener]()
                 {
-                    BoostTCP::socket tempTcpSocket(m_ioService, BoostTCP::v4());
-                    tempTcpSocket.connect(m_endPoint, err);
+                    listener->closeAcceptor();
                 });
             }
-
-            CheckForError([this](boost::system::error_code& err)
+            else
             {
-                m_acceptor.non_blocking(true, err);
-                if (!err)
+                std::promise<void> closed;
+                boost::asio::dispatch(m_listener->strand, [this, &closed]()
                 {
-                    m_acceptor.cancel(err);
-                    if (!err)
-                    {
-                        m_acceptor.close(err);
-                    }
-                }
-            });
-            CheckForError([this](boost::system::error_code& err)
+                    m_listener->closeAcceptor();
+                    closed.set_value();
+                });
+                closed.get_future().wait();
+                m_acceptLoop.wait();
+                m_acceptLoop = {};
+            }
+        }
+        else
+        {
+            m_listener->closeAcceptor(); // nothing else has it
+        }
+        // Each connection closes and removes itself once its outstanding read ends
+        forEachConnection([](const ConnectionPtr& connection)
+        {
+            connection->shutdown();
+        });
+    }
+
+    std::string getSocketName() const
+    {
+        return m_address + ":" + std::to_string(getPort());
+    }
+
+    // The bound port, which differs from the requested one when that was 0
+    uint16_t getPort() const
+    {
+        boost::system::error_code err;
+        auto endPoint = m_listener->acceptor.local_endpoint(err);
+        return err ? m_port : endPoint.port();
+    }
+
+    size_t getConnectionCount() const
+    {
+        return m_listener->getConnectionCount();
+    }
+
+    template<typename Function>
+    void forEachConnection(Function&& function)
+    {
+        std::vector<ConnectionPtr> connections;
+        {
+            std::lock_guard lock(m_listener->mutex);
+            connections.reserve(m_listener->connections.size());
+            for(auto& [key, connection] : m_listener->connections)
             {
-                m_tcpSocket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, err);
-                m_tcpSocket.close(err);
-            });
-            ISocket::close();
+                connections.push_back(connection);
+            }
+        }
+        for(auto& connection : connections)
+        {
+            function(connection);
         }
     }
-    
-    bool listen()
+
+    TCPServerCallbacks& getServerCallbacks()
     {
-        m_acceptorListeningState = true;
+        return m_listener->callbacks;
+    }
 
-        return CheckForError([this](boost::system::error_code& err)
+    // Errors opening the server or accepting on it, the accept loop reports them after the server might have gone
+    SocketError getLastError() // clears and returns the last error
+    {
+        return m_listener->getLastError();
+    }
+
+    std::string getLastErrorMessage() // clears and returns the last error
+    {
+        return m_listener->getLastErrorMessage();
+    }
+
+private:
+    // Everything the accept loop and its connections use, shared with them so they never touch the server itself
+    struct Listener : NetworkingErrorHandler
+    {
+        Listener(io_context& context, SocketType type, size_t maxConnections)
+            : ioContext(&context), strand(boost::asio::make_strand(context)), acceptor(strand), maxConnections(maxConnections), type(type)
         {
-            if (isOpen())
+        }
+
+        void closeAcceptor()
+        {
+            if(acceptor.is_open())
             {
-                m_acceptor.listen(boost::asio::socket_base::max_connections, err);
-                if (!err)
+                CheckForError([this](boost::system::error_code& err)
                 {
-                    // m_tcpSocket = BoostTCP::socket(m_ioService);
-                    m_acceptor.accept(m_tcpSocket, err);
-                }
-                m_acceptorListeningState = false;
+                    acceptor.close(err);
+                });
             }
-        });
+        }
+
+        size_t getConnectionCount() const
+        {
+            std::lock_guard lock(mutex);
+            return connections.size();
+        }
+
+        io_context* ioContext; // accepted connections share it
+        boost::asio::strand<io_context::executor_type> strand; // the accept loop and close() take turns with the acceptor on it
+        BoostTCP::acceptor acceptor;
+        size_t maxConnections;
+        SocketType type; // for accepted connections
+        TCPServerCallbacks callbacks {};
+        mutable std::mutex mutex;
+        std::unordered_map<TCPConnection*, ConnectionPtr> connections;
+    };
+
+    void replaceListener(io_context& context)
+    {
+        auto listener = std::make_shared<Listener>(context, m_listener->type, m_listener->maxConnections);
+        listener->callbacks = m_listener->callbacks;
+        m_listener = std::move(listener);
+        m_acceptLoop = {};
     }
 
-private:
-    BoostTCP::acceptor m_acceptor;
-    bool m_acceptorListeningState = false;
+    static boost::asio::awaitable<void> AcceptConnections(std::shared_ptr<Listener> listener)
+    {
+        for(;;)
+        {
+            boost::system::error_code err;
+            BoostTCP::socket socket(*listener->ioContext);
+            co_await listener->acceptor.async_accept(socket, boost::asio::redirect_error(boost::asio::use_awaitable, err));
+            if(err == boost::asio::error::operation_aborted || !listener->acceptor.is_open())
+            {
+                co_return;
+            }
+            if(listener->CheckForError([&err](boost::system::error_code& acceptError) { acceptError = err; }) == false)
+            {
+                // Usually out of file descriptors, back off rather than spinning on the same error
+                boost::asio::steady_timer backOff(*listener->ioContext, std::chrono::milliseconds(AcceptBackOffMs));
+                co_await backOff.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, err));
+                continue;
+            }
+            if(listener->getConnectionCount() >= listener->maxConnections)
+            {
+                socket.close(err);
+                continue;
+            }
+            auto connection = std::make_shared<TCPConnection>(listener->type, std::move(socket), listener->callbacks.connection);
+            {
+                std::lock_guard lock(listener->mutex);
+                listener->connections.emplace(connection.get(), connection);
+            }
+            listener->callbacks.accepted(connection);
+            boost::asio::co_spawn(*listener->ioContext, ServeConnection(listener, connection, listener->callbacks.closedCallback), boost::asio::detached);
+        }
+    }
+
+    static boost::asio::awaitable<void> ServeConnection(std::shared_ptr<Listener> listener, ConnectionPtr connection, TCPServerCallbacks::ConnectionCallback closedCallback)
+    {
+        co_await connection->receiveUntilClosed();
+        {
+            std::lock_guard lock(listener->mutex);
+            listener->connections.erase(connection.get());
+        }
+        if(closedCallback)
+        {
+            closedCallback(connection);
+        }
+    }
+
+    std::shared_ptr<Listener> m_listener;
+    BoostTCP::endpoint m_endPoint;
+    std::string m_address;
+    uint16_t m_port;
+    std::future<void> m_acceptLoop;
 };
-*/
@@ -10,10 +10,55 @@
 
 #include "ISocket.h"
 
+#ifdef __linux__
+#include <sys/socket.h>
+#include <netinet/udp.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 // same windows or posix flags
 #define DEFAULT_RECV_MSG_FLAG 0 
 #define DEFAULT_SEND_MSG_FLAG 0 
 
+// One entry of a readBatch/writeBatch, the buffer is owned by the caller
+struct UDPDatagram
+{
+    unsigned char* data = nullptr;
+    size_t bufferSize = 0;
+    size_t bytes = 0; // Bytes read or written for this datagram
+    boost::asio::ip::udp::endpoint endPoint {}; // Source endpoint on reads
+    std::chrono::system_clock::time_point timestamp {}; // When the kernel received it, only set with receive timestamps on
+};
+
+// A software transmit timestamp read back from UDPClient::readTransmitTimestamps
+struct UDPTransmitTimestamp
+{
+    uint32_t id = 0; // Counts datagrams sent since transmit timestamps were switched on, from 0
+    std::chrono::system_clock::time_point timestamp {}; // When the datagram left the stack for the driver
+};
+
+struct SocketBatchResult
+{
+    size_t datagrams; // Datagrams read or written, the first n entries of the batch are filled in
+    size_t bytes; // Total bytes across those datagrams
+    bool success;
+    bool timedOut = false;
+    SocketErrorReason reason = SocketErrorReason::None;
+    boost::system::error_code error {};
+
+    explicit operator bool() const
+    {
+        return success;
+    }
+
+    static SocketBatchResult failed(SocketErrorReason reason, boost::system::error_code error = {})
+    {
+        return { .datagrams = 0, .bytes = 0, .success = false, .reason = reason, .error = error };
+    }
+};
 
 class UDPSocket : public ISocket
 {
@@ -24,7 +69,7 @@ public:
 
     
     UDPSocket(SocketType type, SocketMode mode, const std::string& address, uint16_t port, SocketRole role = DefaultRole, uint32_t timeoutMs = 20, uint32_t byteIntervalMs = 10)
-        : ISocket(type, mode, role, address, port, timeoutMs, byteIntervalMs), m_udpSocket(m_ioService)
+        : ISocket(type, mode, role, address, port, timeoutMs, byteIntervalMs), m_udpSocket(*m_ioContext)
     {
     }
 
@@ -33,9 +78,9 @@ public:
         UDPSocket::close();
     }
 
-    bool CheckForError(const std::function<void(boost::system::error_code&)>& operation, bool isUDP = false) override
+    bool CheckError(const boost::system::error_code& error, [[maybe_unused]] bool isUDP = false) override
     {
-        return ISocket::CheckForError(operation, true);
+        return ISocket::CheckError(error, true);
     }
 
     bool isOpen() const override
@@ -43,8 +88,19 @@ public:
         return m_udpSocket.is_open();
     }
 
+    void cancel() override
+    {
+        boost::system::error_code err;
+        m_udpSocket.cancel(err);
+        m_readinessWaiter.cancel();
+    }
+
     void close() override
     {
+        if(m_readContinuously)
+        {
+            stopReadingContinuously();
+        }
         if(isOpen())
         {
             CheckForError([this](boost::system::error_code& err)
@@ -52,14 +108,26 @@ public:
                 m_udpSocket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, err);
                 m_udpSocket.close(err);
             });
+            m_readinessWaiter.cancel(); // shutdown() normally wakes a waiting reader already, this doesn't leave it to
             ISocket::close();
         }
     }
     
+    // flag is SO_RCVTIMEO or SO_SNDTIMEO, for anything else using the native handle
+    // The socket's own reads and writes don't block in the kernel, they time out after m_timeoutMs in the library's poll() instead
     bool setSocketTimeOut(int flag, uint32_t timeOutMs)
     {
     #ifndef _WIN32
-        return true;
+        return CheckForError([this, flag, timeOutMs](auto& err)
+        {
+            timeval timeOut {};
+            timeOut.tv_sec = static_cast<time_t>(timeOutMs / 1000);
+            timeOut.tv_usec = static_cast<suseconds_t>((timeOutMs % 1000) * 1000);
+            if(::setsockopt(m_udpSocket.native_handle(), SOL_SOCKET, flag, &timeOut, sizeof(timeOut)) != 0)
+            {
+                err = LastSystemError();
+            }
+        });
     #else
         return CheckForError([this, flag, timeOutMs](auto& err)
         {
@@ -80,31 +148,363 @@ public:
         return m_address + ":" + std::to_string(m_port);
     }
 
+    BoostUDP::socket::native_handle_type getNativeHandle()
+    {
+        return m_udpSocket.native_handle();
+    }
+
+    BoostUDP::endpoint getLocalEndPoint() const
+    {
+        boost::system::error_code err;
+        return m_udpSocket.local_endpoint(err);
+    }
+
+    // Kernel receive timestamps (SO_TIMESTAMPNS, Linux), synchronous reads then carry the time their datagram reached the socket
+    // How long it waited there for the application is recorded in the metrics as receiveDelay, when they are enabled
+    // Can be asked for before open(), returns false where it isn't supported
+    bool setReceiveTimestamps(bool enabled)
+    {
+        m_receiveTimestampsRequested = enabled;
+        m_receiveTimestamps = false;
+    #if defined(__linux__) && defined(SO_TIMESTAMPNS)
+        if(m_udpSocket.is_open())
+        {
+            const int option = enabled ? 1 : 0;
+            m_receiveTimestamps = ::setsockopt(m_udpSocket.native_handle(), SOL_SOCKET, SO_TIMESTAMPNS, &option, sizeof(option)) == 0 && enabled;
+        }
+    #endif
+        return m_receiveTimestamps;
+    }
+
+    bool isReceiveTimestampsEnabled() const
+    {
+        return m_receiveTimestamps;
+    }
+
 protected:
+    bool rebindEventLoop(io_context& context) override
+    {
+        m_udpSocket = BoostUDP::socket(context);
+        return true;
+    }
+
     SocketResult internalReadData(unsigned char* data, size_t bufferSize) override
     {
-        SocketResult result;
-        result.success = CheckForError([this, data, bufferSize, &result](boost::system::error_code& err)
+        SocketResult result {};
+        CheckForError(result, [this, data, bufferSize, &result](boost::system::error_code& err)
         {
-            while(m_udpSocket.available() == 0) /// \todo change to receive whilst this is > 0
+            BoostUDP::endpoint senderEndPoint;
+        #ifdef __linux__
+            if(m_receiveTimestamps || m_type == SocketType::BusyPoll)
             {
-                std::this_thread::yield();
+                iovec vector { data, bufferSize };
+                result.bytes = receiveMessage(&vector, 1, senderEndPoint, result.timestamp, err);
+                result.timedOut = err == boost::asio::error::timed_out;
+            }
+            else
+        #endif
+            {
+                result.bytes = transferWithinTimeout(POLLIN, [this, data, bufferSize, &senderEndPoint](boost::system::error_code& err)
+                {
+                    return m_udpSocket.receive_from(boost::asio::buffer(data, bufferSize), senderEndPoint, DEFAULT_RECV_MSG_FLAG, err);
+                }, err);
+                result.timedOut = err == boost::asio::error::timed_out;
+            }
+            if(!err)
+            {
+                updateEndPoint(senderEndPoint);
+                recordReceiveDelay(result.timestamp);
             }
-            result.bytes = m_udpSocket.receive_from(boost::asio::buffer(data, bufferSize), m_endPoint, DEFAULT_RECV_MSG_FLAG, err);
         });
         return result;
     }
 
+    // The buffers become one recvmsg iovec array
+    SocketResult internalReadBuffers(MutableBuffers buffers) override
+    {
+        SocketResult result {};
+        CheckForError(result, [this, buffers, &result](boost::system::error_code& err)
+        {
+            BoostUDP::endpoint senderEndPoint;
+        #ifdef __linux__
+            if(m_receiveTimestamps || m_type == SocketType::BusyPoll)
+            {
+                std::array<iovec, MaxBufferCount> vectors;
+                for(size_t i = 0; i < buffers.size(); ++i)
+                {
+                    vectors[i] = { buffers[i].data(), buffers[i].size() };
+                }
+                result.bytes = receiveMessage(vectors.data(), buffers.size(), senderEndPoint, result.timestamp, err);
+                result.timedOut = err == boost::asio::error::timed_out;
+            }
+            else
+        #endif
+            {
+                result.bytes = transferWithinTimeout(POLLIN, [this, buffers, &senderEndPoint](boost::system::error_code& err)
+                {
+                    return m_udpSocket.receive_from(buffers, senderEndPoint, DEFAULT_RECV_MSG_FLAG, err);
+                }, err);
+                result.timedOut = err == boost::asio::error::timed_out;
+            }
+            if(!err)
+            {
+                updateEndPoint(senderEndPoint);
+                recordReceiveDelay(result.timestamp);
+            }
+        });
+        return result;
+    }
+
+    AwaitableSocketResult internalAsyncReadData(unsigned char* data, size_t bufferSize) override
+    {
+        SocketResult result {};
+        boost::system::error_code err;
+        BoostUDP::endpoint senderEndPoint;
+        result.bytes = co_await m_udpSocket.async_receive_from(boost::asio::buffer(data, bufferSize), senderEndPoint, DEFAULT_RECV_MSG_FLAG, boost::asio::redirect_error(boost::asio::use_awaitable, err));
+        CheckAsyncResult(result, err);
+        if(result.success)
+        {
+            setEndPoint(senderEndPoint);
+        }
+        co_return result;
+    }
+
+    // The last sender is who a server replies to, the write path reads it from another thread on ReadWrite sockets
+    void setEndPoint(const BoostUDP::endpoint& endPoint)
+    {
+        std::lock_guard lock(m_endPointMutex);
+        m_endPoint = endPoint;
+        m_endPointChanged.store(true, std::memory_order_relaxed);
+    }
+
+    // As above for synchronous readers, which hold the read lock, so a sender that hasn't changed costs no lock at all
+    void updateEndPoint(const BoostUDP::endpoint& endPoint)
+    {
+        if(endPoint != m_lastSender || m_endPointChanged.load(std::memory_order_relaxed))
+        {
+            m_lastSender = endPoint;
+            setEndPoint(endPoint);
+            m_endPointChanged.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    BoostUDP::endpoint getEndPoint()
+    {
+        std::lock_guard lock(m_endPointMutex);
+        return m_endPoint;
+    }
+
+    // Options asked for before open() are applied once the socket exists
+    void applyRequestedOptions()
+    {
+        m_endPointChanged = true; // open() has just reset the endpoint
+        boost::system::error_code err;
+        m_udpSocket.non_blocking(true, err); // see transferWithinTimeout()
+    #ifndef _WIN32
+        applyBusyPoll(m_udpSocket.native_handle());
+    #endif
+        if(m_receiveTimestampsRequested)
+        {
+            setReceiveTimestamps(true);
+        }
+    }
+
+    void recordReceiveDelay(std::chrono::system_clock::time_point timestamp)
+    {
+        if(timestamp != std::chrono::system_clock::time_point {} && m_metricsEnabled.load(std::memory_order_acquire))
+        {
+            m_metrics.load(std::memory_order_acquire)->receiveDelay.record(std::chrono::system_clock::now() - timestamp);
+        }
+    }
+
+    bool isReady(SocketMode mode) override
+    {
+        return ReadinessWaiter::IsReady(m_udpSocket, mode == SocketMode::Read ? POLLIN : POLLOUT);
+    }
+
+    void asyncWaitReady(SocketMode mode, std::function<void(const boost::system::error_code&)> handler) override
+    {
+        m_udpSocket.async_wait(mode == SocketMode::Read ? BoostUDP::socket::wait_read : BoostUDP::socket::wait_write, std::move(handler));
+    }
+
+#ifdef HAS_IO_URING
+    int getRingHandle() override
+    {
+        return m_udpSocket.is_open() ? m_udpSocket.native_handle() : -1;
+    }
+
+    // recvmsg for the sender and any timestamp, sendmsg to whoever the socket is talking to
+    void beginRingOperation(SocketMode mode, IoUringOperation& operation) override
+    {
+        operation.useMessage = true;
+        operation.message.msg_name = &operation.address;
+        if(mode == SocketMode::Read)
+        {
+            operation.message.msg_namelen = sizeof(operation.address);
+            if(m_receiveTimestamps)
+            {
+                operation.message.msg_control = operation.control.data();
+                operation.message.msg_controllen = operation.control.size();
+            }
+            return;
+        }
+        const auto endPoint = getEndPoint();
+        std::memcpy(&operation.address, endPoint.data(), endPoint.size());
+        operation.message.msg_namelen = static_cast<socklen_t>(endPoint.size());
+    }
+
+    void endRingOperation(SocketMode mode, IoUringOperation& operation, SocketResult& result, boost::system::error_code& err) override
+    {
+        if(mode != SocketMode::Read)
+        {
+            return;
+        }
+        // every datagram has a sender, the shutdown in close() wakes the read with neither
+        if(operation.message.msg_namelen == 0)
+        {
+            err = boost::asio::error::operation_aborted;
+            return;
+        }
+        BoostUDP::endpoint senderEndPoint;
+        std::memcpy(senderEndPoint.data(), &operation.address, std::min<size_t>(operation.message.msg_namelen, senderEndPoint.capacity()));
+        senderEndPoint.resize(operation.message.msg_namelen);
+        updateEndPoint(senderEndPoint);
+        if(operation.message.msg_controllen > 0)
+        {
+            result.timestamp = ReceiveTimestamp(operation.message);
+            recordReceiveDelay(result.timestamp);
+        }
+    }
+#endif
+
+#ifdef __linux__
+    // Room for every control message a receive asks for, a GRO segment size and a timestamp
+    using ControlBuffer = std::array<char, CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(timespec))>;
+
+    static std::chrono::system_clock::time_point ToTimePoint(const timespec& time)
+    {
+        return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec)));
+    }
+
+    // The SO_TIMESTAMPNS timestamp of a received message, a default time point when it has none
+    static std::chrono::system_clock::time_point ReceiveTimestamp(msghdr& message)
+    {
+        for(cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header))
+        {
+            if(header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_TIMESTAMPNS)
+            {
+                timespec time {};
+                std::memcpy(&time, CMSG_DATA(header), sizeof(time));
+                return ToTimePoint(time);
+            }
+        }
+        return {};
+    }
+
+    // recvmsg rather than receive_from so the timestamp comes back with the datagram, and so a busy-polling socket can spin on it
+    size_t receiveMessage(iovec* vectors, size_t count, BoostUDP::endpoint& sender, std::chrono::system_clock::time_point& timestamp, boost::system::error_code& err)
+    {
+        alignas(cmsghdr) ControlBuffer control {};
+        for(;;)
+        {
+            msghdr message {};
+            message.msg_name = sender.data();
+            message.msg_namelen = static_cast<socklen_t>(sender.capacity());
+            message.msg_iov = vectors;
+            message.msg_iovlen = count;
+            message.msg_control = control.data();
+            message.msg_controllen = control.size();
+            const ssize_t bytes = busyPollReceive(m_udpSocket.native_handle(), message);
+            if(bytes >= 0)
+            {
+                sender.resize(message.msg_namelen);
+                timestamp = ReceiveTimestamp(message);
+                return static_cast<size_t>(bytes);
+            }
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                err = LastSystemError();
+                return 0;
+            }
+            err = waitReadable();
+            if(err)
+            {
+                return 0;
+            }
+        }
+    }
+#endif
+
+    // Skips the poll entirely when a datagram is already queued
+    boost::system::error_code waitReadable()
+    {
+        return m_readinessWaiter.waitForData(m_udpSocket, operationDeadline(SocketMode::Read), true);
+    }
+
+    // The socket never blocks in the kernel, a transfer that would is retried whenever poll() says it can go, until m_timeoutMs or the operation's deadline has passed
+    template<typename Transfer>
+    size_t transferWithinTimeout(short events, Transfer&& transfer, boost::system::error_code& err)
+    {
+        const auto deadline = operationDeadline(events == POLLIN ? SocketMode::Read : SocketMode::Write);
+        return m_readinessWaiter.transfer(m_udpSocket, events, deadline, std::forward<Transfer>(transfer), err, events == POLLIN);
+    }
+
+    // Batches are moved synchronously on the calling thread, they are meant for hot loops that cannot afford a dispatch per datagram
+    template<typename Operation>
+    SocketBatchResult checkedBatch(SocketMode expectedMode, std::span<UDPDatagram> datagrams, Operation&& operation)
+    {
+        std::lock_guard lock(expectedMode == SocketMode::Read ? m_readMutex : m_writeMutex);
+        if(auto invalid = CheckIsValid(expectedMode, reinterpret_cast<unsigned char*>(datagrams.data()), datagrams.size()); invalid != SocketErrorReason::None)
+        {
+            return SocketBatchResult::failed(invalid);
+        }
+        auto& events = expectedMode == SocketMode::Read ? m_socketEventCallbacks.read : m_socketEventCallbacks.write;
+        events.preEvent();
+        const auto started = metricsClock();
+        SocketBatchResult batchResult = operation();
+        if(started != SocketMetrics::Clock::time_point {})
+        {
+            size_t expectedBytes = 0;
+            for(size_t i = 0; expectedMode == SocketMode::Write && i < datagrams.size(); ++i)
+            {
+                expectedBytes += datagrams[i].bufferSize;
+            }
+            metricsDirection(expectedMode).record(batchResult.success, batchResult.timedOut, batchResult.bytes, expectedBytes, SocketMetrics::Clock::now() - started);
+        }
+        for(size_t i = 0; i < batchResult.datagrams; ++i)
+        {
+            SocketResult result { datagrams[i].bytes, true };
+            events.postEvent(datagrams[i].data, result);
+        }
+        return batchResult;
+    }
+
+#ifdef __linux__
+    static constexpr size_t MaxBatchSize = 64; // mmsghdr/iovec arrays are kept on the stack
+#endif
+
     BoostUDP::socket m_udpSocket;
+    bool m_receiveTimestampsRequested = false;
+    std::atomic_bool m_receiveTimestamps = false;
     BoostUDP::endpoint m_endPoint;
+    std::mutex m_endPointMutex;
+    BoostUDP::endpoint m_lastSender; // the synchronous reader's own copy of the last sender
+    std::atomic_bool m_endPointChanged = false; // by anyone else since the reader last set it
+    ReadinessWaiter m_readinessWaiter;
 };
 
 
 class UDPClient : public UDPSocket
 {
 public:
-    UDPClient(SocketType type, const std::string& address, uint16_t port)
-        : UDPSocket(type, SocketMode::Write, address, port, SocketRole::Client)
+    UDPClient(SocketType type, const std::string& address, uint16_t port, uint32_t timeoutMs = 20)
+        : UDPClient(type, SocketMode::Write, address, port, timeoutMs)
+    {
+    }
+
+    // SocketMode::ReadWrite also receives from the connected endpoint
+    UDPClient(SocketType type, SocketMode mode, const std::string& address, uint16_t port, uint32_t timeoutMs = 20)
+        : UDPSocket(type, mode, address, port, SocketRole::Client, timeoutMs)
     {
     }
 
@@ -112,17 +512,25 @@ public:
     {
         if(CheckForError([&](auto& err)
         {
-            m_udpSocket.open(BoostUDP::v4());
+            m_udpSocket.open(BoostUDP::v4(), err);
         }) == false)
         {
             return false;
         }
         m_address = toV4();
-        m_endPoint = BoostUDP::endpoint(BoostAddress::from_string(m_address), m_port);
+        m_initialised = CheckForError([this](boost::system::error_code& err)
+        {
+            m_endPoint = BoostUDP::endpoint(BoostAddress::from_string(m_address, err), m_port);
+        });
+        if(!m_initialised)
+        {
+            close();
+            return false;
+        }
 
         m_initialised = CheckForError([this](boost::system::error_code& err)
         {
-            m_udpSocket = BoostUDP::socket(m_ioService, BoostUDP::v4());
+            m_udpSocket = BoostUDP::socket(*m_ioContext, BoostUDP::v4());
             m_udpSocket.connect(m_endPoint, err);
         });
 
@@ -131,32 +539,347 @@ public:
             close();
             return false;
         }
-
-        if(m_timeoutMs > 0)
+        detectSegmentationOffload();
+        applyRequestedOptions();
+        if(m_transmitTimestampsRequested)
         {
-            setSocketTimeOut(SO_RCVTIMEO, m_timeoutMs);
+            setTransmitTimestamps(true);
         }
 
         return ISocket::open();
     }
 
+    // Sends every datagram to the connected endpoint, sendmmsg moves up to MaxBatchSize per syscall on Linux
+    SocketBatchResult writeBatch(std::span<UDPDatagram> datagrams)
+    {
+        return checkedBatch(SocketMode::Write, datagrams, [this, datagrams]()
+        {
+            SocketBatchResult batchResult {};
+            CheckForError(batchResult, [this, datagrams, &batchResult](boost::system::error_code& err)
+            {
+                sendBatch(datagrams, batchResult, err);
+            });
+            return batchResult;
+        });
+    }
+
+    static constexpr size_t MaxSegments = 64; // per send, the oldest limit the kernel has had (UDP_MAX_SEGMENTS)
+    static constexpr size_t MaxSegmentedBytes = 65507; // per send, one IPv4 UDP payload before the kernel splits it
+
+    // Sends data as consecutive datagrams of segmentSize bytes, the last one takes whatever is left
+    // With UDP_SEGMENT (Linux 4.18+) the kernel cuts up to MaxSegments datagrams out of a single sendmsg, otherwise they go out through writeBatch's path
+    // Every send is one batch as far as callbacks and metrics are concerned
+    SocketBatchResult writeSegmented(std::span<const uint8_t> data, size_t segmentSize)
+    {
+        if(segmentSize == 0 || segmentSize > MaxSegmentedBytes)
+        {
+            setLastError({ SocketErrorReason::System, boost::asio::error::message_size });
+            return SocketBatchResult::failed(SocketErrorReason::System, boost::asio::error::message_size);
+        }
+        const size_t segmentsPerSend = std::min(MaxSegments, MaxSegmentedBytes / segmentSize);
+        std::array<UDPDatagram, MaxSegments> segments;
+        SocketBatchResult total { 0, 0, true };
+        do
+        {
+            const size_t remaining = data.size() - total.bytes;
+            const size_t count = std::max<size_t>(1, std::min(segmentsPerSend, (remaining + segmentSize - 1) / segmentSize));
+            for(size_t i = 0; i < count; ++i)
+            {
+                const size_t offset = total.bytes + i * segmentSize;
+                auto* segment = const_cast<unsigned char*>(data.data()) + offset;
+                segments[i] = { segment, std::min(segmentSize, data.size() - offset) };
+            }
+            auto sent = std::span(segments).first(count);
+            auto batchResult = checkedBatch(SocketMode::Write, sent, [this, sent, segmentSize]()
+            {
+                SocketBatchResult batchResult {};
+                CheckForError(batchResult, [this, sent, segmentSize, &batchResult](boost::system::error_code& err)
+                {
+                    sendSegments(sent, segmentSize, batchResult, err);
+                });
+                return batchResult;
+            });
+            total.datagrams += batchResult.datagrams;
+            total.bytes += batchResult.bytes;
+            if(!batchResult)
+            {
+                batchResult.datagrams = total.datagrams;
+                batchResult.bytes = total.bytes;
+                return batchResult;
+            }
+        }
+        while(total.bytes < data.size());
+        return total;
+    }
+
+    // Whether writeSegmented() hands segmentation to the kernel, found out on open()
+    // Switching it off forces the fallback, it can't be switched on where the kernel doesn't support it
+    bool setSegmentationOffload(bool enabled)
+    {
+        if(!enabled)
+        {
+            m_segmentationOffload = false;
+            return false;
+        }
+        detectSegmentationOffload();
+        return m_segmentationOffload;
+    }
+
+    bool isSegmentationOffloadEnabled() const
+    {
+        return m_segmentationOffload;
+    }
+
+    // Software transmit timestamps (SO_TIMESTAMPING, Linux), the kernel queues one per datagram sent for readTransmitTimestamps()
+    // Switching them on restarts the ids, can be asked for before open(), returns false where it isn't supported
+    bool setTransmitTimestamps(bool enabled)
+    {
+        m_transmitTimestampsRequested = enabled;
+        m_transmitTimestamps = false;
+    #if defined(__linux__) && defined(SO_TIMESTAMPING)
+        if(m_udpSocket.is_open())
+        {
+            const int flags = enabled ? SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY : 0;
+            m_transmitTimestamps = ::setsockopt(m_udpSocket.native_handle(), SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0 && enabled;
+        }
+    #endif
+        return m_transmitTimestamps;
+    }
+
+    bool isTransmitTimestampsEnabled() const
+    {
+        return m_transmitTimestamps;
+    }
+
+    // Takes whatever transmit timestamps the kernel has queued, up to timestamps.size(), never blocks
+    // Returns how many were written to the front of timestamps
+    size_t readTransmitTimestamps(std::span<UDPTransmitTimestamp> timestamps)
+    {
+        size_t count = 0;
+    #if defined(__linux__) && defined(SO_TIMESTAMPING)
+        while(count < timestamps.size() && m_transmitTimestamps)
+        {
+            alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(timespec) * 3) + CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in))> control {};
+            msghdr message {};
+            message.msg_control = control.data();
+            message.msg_controllen = control.size();
+            if(::recvmsg(m_udpSocket.native_handle(), &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            {
+                break;
+            }
+            UDPTransmitTimestamp transmitted;
+            bool isTimestamp = false;
+            for(cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header))
+            {
+                if(header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_TIMESTAMPING)
+                {
+                    timespec software {}; // the first of the three, the hardware ones are never asked for
+                    std::memcpy(&software, CMSG_DATA(header), sizeof(software));
+                    transmitted.timestamp = ToTimePoint(software);
+                }
+                else if((header->cmsg_level == SOL_IP && header->cmsg_type == IP_RECVERR) || (header->cmsg_level == SOL_IPV6 && header->cmsg_type == IPV6_RECVERR))
+                {
+                    sock_extended_err error {};
+                    std::memcpy(&error, CMSG_DATA(header), sizeof(error));
+                    isTimestamp = error.ee_errno == ENOMSG && error.ee_origin == SO_EE_ORIGIN_TIMESTAMPING;
+                    transmitted.id = error.ee_data;
+                }
+            }
+            if(isTimestamp)
+            {
+                timestamps[count++] = transmitted;
+            }
+        }
+    #endif
+        return count;
+    }
+
+private:
+    void detectSegmentationOffload()
+    {
+    #if defined(__linux__) && defined(UDP_SEGMENT)
+        int segmentSize = 0;
+        socklen_t optionLength = sizeof(segmentSize);
+        m_segmentationOffload = isOpen() && ::getsockopt(m_udpSocket.native_handle(), SOL_UDP, UDP_SEGMENT, &segmentSize, &optionLength) == 0;
+    #else
+        m_segmentationOffload = false;
+    #endif
+    }
+
+    // One sendmsg with a UDP_SEGMENT control message when the kernel takes it, the datagrams are contiguous
+    void sendSegments(std::span<UDPDatagram> segments, size_t segmentSize, SocketBatchResult& batchResult, boost::system::error_code& err)
+    {
+    #if defined(__linux__) && defined(UDP_SEGMENT)
+        if(m_segmentationOffload && segments.size() > 1)
+        {
+            const size_t totalBytes = static_cast<size_t>(segments.back().data + segments.back().bufferSize - segments.front().data);
+            iovec vector { segments.front().data, totalBytes };
+            alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(uint16_t))> control {};
+            msghdr message {};
+            message.msg_iov = &vector;
+            message.msg_iovlen = 1;
+            message.msg_control = control.data();
+            message.msg_controllen = control.size();
+            cmsghdr* header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_UDP;
+            header->cmsg_type = UDP_SEGMENT;
+            header->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            const auto segmentLength = static_cast<uint16_t>(segmentSize);
+            std::memcpy(CMSG_DATA(header), &segmentLength, sizeof(segmentLength));
+            const auto deadline = operationDeadline(SocketMode::Write);
+            for(;;)
+            {
+                const ssize_t sent = ::sendmsg(m_udpSocket.native_handle(), &message, DEFAULT_SEND_MSG_FLAG);
+                if(sent >= 0)
+                {
+                    for(auto& segment : segments)
+                    {
+                        segment.bytes = segment.bufferSize;
+                    }
+                    batchResult.datagrams = segments.size();
+                    batchResult.bytes = static_cast<size_t>(sent);
+                    return;
+                }
+                if(errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    err = m_readinessWaiter.waitUntil(m_udpSocket, POLLOUT, deadline);
+                    if(err)
+                    {
+                        batchResult.timedOut = err == boost::asio::error::timed_out;
+                        return;
+                    }
+                    continue;
+                }
+                if(errno != EIO && errno != EINVAL && errno != ENOPROTOOPT && errno != EOPNOTSUPP)
+                {
+                    err = LastSystemError();
+                    return;
+                }
+                // the device or the segment size isn't supported, stop asking
+                m_segmentationOffload = false;
+                break;
+            }
+        }
+    #endif
+        sendBatch(segments, batchResult, err);
+    }
+
+    void sendBatch(std::span<UDPDatagram> datagrams, SocketBatchResult& batchResult, boost::system::error_code& err)
+    {
+    #ifdef __linux__
+        mmsghdr messages[MaxBatchSize];
+        iovec vectors[MaxBatchSize];
+        const auto deadline = operationDeadline(SocketMode::Write); // for the whole batch, however many sends it takes
+        while(batchResult.datagrams < datagrams.size())
+        {
+            const size_t count = std::min(MaxBatchSize, datagrams.size() - batchResult.datagrams);
+            for(size_t i = 0; i < count; ++i)
+            {
+                auto& datagram = datagrams[batchResult.datagrams + i];
+                vectors[i] = { datagram.data, datagram.bufferSize };
+                messages[i] = {};
+                messages[i].msg_hdr.msg_iov = &vectors[i];
+                messages[i].msg_hdr.msg_iovlen = 1;
+            }
+            const int sent = ::sendmmsg(m_udpSocket.native_handle(), messages, static_cast<unsigned int>(count), DEFAULT_SEND_MSG_FLAG);
+            if(sent < 0)
+            {
+                if(errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    err = m_readinessWaiter.waitUntil(m_udpSocket, POLLOUT, deadline);
+                    if(!err)
+                    {
+                        continue;
+                    }
+                    batchResult.timedOut = err == boost::asio::error::timed_out;
+                }
+                else
+                {
+                    err = LastSystemError();
+                }
+                return;
+            }
+            for(int i = 0; i < sent; ++i)
+            {
+                auto& datagram = datagrams[batchResult.datagrams + i];
+                datagram.bytes = messages[i].msg_len;
+                batchResult.bytes += datagram.bytes;
+            }
+            batchResult.datagrams += sent;
+        }
+    #else
+        for(auto& datagram : datagrams)
+        {
+            datagram.bytes = transferWithinTimeout(POLLOUT, [this, &datagram](boost::system::error_code& err)
+            {
+                return m_udpSocket.send(boost::asio::buffer(datagram.data, datagram.bufferSize), DEFAULT_SEND_MSG_FLAG, err);
+            }, err);
+            if(err)
+            {
+                batchResult.timedOut = err == boost::asio::error::timed_out;
+                return;
+            }
+            batchResult.bytes += datagram.bytes;
+            ++batchResult.datagrams;
+        }
+    #endif
+    }
+
+    std::atomic_bool m_segmentationOffload = false;
+    bool m_transmitTimestampsRequested = false;
+    std::atomic_bool m_transmitTimestamps = false;
+
 protected:
     SocketResult internalWriteData(unsigned char* data, size_t bufferSize) override
     {
         SocketResult result;
-        result.success = CheckForError([this, data, bufferSize, &result](boost::system::error_code& err)
+        CheckForError(result, [this, data, bufferSize, &result](boost::system::error_code& err)
         {
-            result.bytes = m_udpSocket.send(boost::asio::buffer(data, bufferSize), DEFAULT_SEND_MSG_FLAG, err);
+            result.bytes = transferWithinTimeout(POLLOUT, [this, data, bufferSize](boost::system::error_code& err)
+            {
+                return m_udpSocket.send(boost::asio::buffer(data, bufferSize), DEFAULT_SEND_MSG_FLAG, err);
+            }, err);
+            result.timedOut = err == boost::asio::error::timed_out;
         });
         return result;
     }
+
+    // One sendmsg, the buffers make up a single datagram
+    SocketResult internalWriteBuffers(ConstBuffers buffers) override
+    {
+        SocketResult result {};
+        CheckForError(result, [this, buffers, &result](boost::system::error_code& err)
+        {
+            result.bytes = transferWithinTimeout(POLLOUT, [this, buffers](boost::system::error_code& err)
+            {
+                return m_udpSocket.send(buffers, DEFAULT_SEND_MSG_FLAG, err);
+            }, err);
+            result.timedOut = err == boost::asio::error::timed_out;
+        });
+        return result;
+    }
+
+    AwaitableSocketResult internalAsyncWriteData(unsigned char* data, size_t bufferSize) override
+    {
+        SocketResult result {};
+        boost::system::error_code err;
+        result.bytes = co_await m_udpSocket.async_send(boost::asio::buffer(data, bufferSize), DEFAULT_SEND_MSG_FLAG, boost::asio::redirect_error(boost::asio::use_awaitable, err));
+        CheckAsyncResult(result, err);
+        co_return result;
+    }
 };
 
 class UDPServer : public UDPSocket
 {
 public:
-    UDPServer(SocketType type, const std::string& address, uint16_t port)
-        : UDPSocket(type, SocketMode::Read, address, port, SocketRole::Server)
+    UDPServer(SocketType type, const std::string& address, uint16_t port, uint32_t timeoutMs = 20) // a timeoutMs of 0 waits indefinitely for data
+        : UDPServer(type, SocketMode::Read, address, port, timeoutMs)
+    {
+    }
+
+    // SocketMode::ReadWrite also replies to whoever sent the last datagram
+    UDPServer(SocketType type, SocketMode mode, const std::string& address, uint16_t port, uint32_t timeoutMs = 20)
+        : UDPSocket(type, mode, address, port, SocketRole::Server, timeoutMs)
     {
     }
 
@@ -164,7 +887,7 @@ public:
     {
         if(CheckForError([&](auto& err)
         {
-            m_udpSocket.open(BoostUDP::v4());
+            m_udpSocket.open(BoostUDP::v4(), err);
         }) == false)
         {
             return false;
@@ -179,14 +902,31 @@ public:
         {
             m_initialised = CheckForError([this](boost::system::error_code& err)
             {
-                m_endPoint = BoostUDP::endpoint(BoostAddress::from_string(m_address), m_port);
+                m_endPoint = BoostUDP::endpoint(BoostAddress::from_string(m_address, err), m_port);
             });
+            // the bind below would otherwise go ahead on a default endpoint, every interface
+            if(!m_initialised)
+            {
+                close();
+                return false;
+            }
         }
 
         m_initialised = CheckForError([this](boost::system::error_code& err)
         {
-            m_udpSocket = BoostUDP::socket(m_ioService, BoostUDP::v4());
-            m_udpSocket.bind(m_endPoint, err);
+            m_udpSocket = BoostUDP::socket(*m_ioContext, BoostUDP::v4());
+            if(m_reusePort)
+            {
+            #ifdef SO_REUSEPORT
+                m_udpSocket.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true), err);
+            #else
+                err = boost::asio::error::operation_not_supported;
+            #endif
+            }
+            if(!err)
+            {
+                m_udpSocket.bind(m_endPoint, err);
+            }
         });
 
         if(!m_initialised)
@@ -194,23 +934,538 @@ public:
             close();
             return false;
         }
-
-        if(m_timeoutMs > 0)
+        if(m_receiveOffloadRequested)
         {
-            setSocketTimeOut(SO_RCVTIMEO, m_timeoutMs);
+            setReceiveOffload(true);
         }
+        applyRequestedOptions();
 
         return ISocket::open();
     }
 
+    // Lets several servers bind the same address and port, the kernel then spreads flows across them (SO_REUSEPORT)
+    // Every one of them has to ask for it before open()
+    void setReusePort(bool reusePort)
+    {
+        m_reusePort = reusePort;
+    }
+
+    bool getReusePort() const
+    {
+        return m_reusePort;
+    }
+
+    // Lets the kernel hand over consecutive datagrams of a flow as one coalesced receive (UDP_GRO, Linux 5.0+)
+    // Only readSegmented() splits them up again, so use it rather than readData/readBatch while this is on
+    // Can be asked for before open(), returns false where the kernel doesn't support it
+    bool setReceiveOffload(bool enabled)
+    {
+        m_receiveOffloadRequested = enabled;
+        m_receiveOffload = false;
+    #if defined(__linux__) && defined(UDP_GRO)
+        if(isOpen())
+        {
+            const int option = enabled ? 1 : 0;
+            m_receiveOffload = ::setsockopt(m_udpSocket.native_handle(), SOL_UDP, UDP_GRO, &option, sizeof(option)) == 0 && enabled;
+        }
+    #endif
+        return m_receiveOffload;
+    }
+
+    bool isReceiveOffloadEnabled() const
+    {
+        return m_receiveOffload;
+    }
+
+    static constexpr size_t MaxSegmentedBytes = UDPClient::MaxSegmentedBytes; // enough buffer for the largest coalesced receive
+
+    // One receive into buffer, split into the datagrams it carries, which are written to the front of datagrams
+    // Each datagram's data points into buffer, with GRO off there is only ever one
+    // Segments that don't fit in datagrams are dropped and reported as no_buffer_space, UDPClient::MaxSegments is always enough
+    SocketBatchResult readSegmented(std::span<uint8_t> buffer, std::span<UDPDatagram> datagrams)
+    {
+        return checkedBatch(SocketMode::Read, datagrams, [this, buffer, datagrams]()
+        {
+            SocketBatchResult batchResult {};
+            CheckForError(batchResult, [this, buffer, datagrams, &batchResult](boost::system::error_code& err)
+            {
+                if(buffer.empty())
+                {
+                    err = boost::asio::error::invalid_argument;
+                    return;
+                }
+                BoostUDP::endpoint sender;
+                size_t received = 0;
+                size_t segmentSize = 0;
+            #ifdef __linux__
+                iovec vector { buffer.data(), buffer.size() };
+                alignas(cmsghdr) ControlBuffer control {};
+                msghdr message {};
+                for(;;)
+                {
+                    message = {};
+                    message.msg_name = sender.data();
+                    message.msg_namelen = static_cast<socklen_t>(sender.capacity());
+                    message.msg_iov = &vector;
+                    message.msg_iovlen = 1;
+                    message.msg_control = control.data();
+                    message.msg_controllen = control.size();
+                    const ssize_t bytes = ::recvmsg(m_udpSocket.native_handle(), &message, DEFAULT_RECV_MSG_FLAG | MSG_DONTWAIT);
+                    if(bytes >= 0)
+                    {
+                        received = static_cast<size_t>(bytes);
+                        break;
+                    }
+                    if(errno != EAGAIN && errno != EWOULDBLOCK)
+                    {
+                        err = LastSystemError();
+                        return;
+                    }
+                    err = waitReadable();
+                    if(err)
+                    {
+                        batchResult.timedOut = err == boost::asio::error::timed_out;
+                        return;
+                    }
+                }
+                sender.resize(message.msg_namelen);
+                if(message.msg_flags & MSG_TRUNC)
+                {
+                    err = boost::asio::error::message_size;
+                    return;
+                }
+                const auto timestamp = ReceiveTimestamp(message);
+                recordReceiveDelay(timestamp);
+            #ifdef UDP_GRO
+                for(cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header))
+                {
+                    if(header->cmsg_level == SOL_UDP && header->cmsg_type == UDP_GRO)
+                    {
+                        int coalescedSize = 0;
+                        std::memcpy(&coalescedSize, CMSG_DATA(header), sizeof(coalescedSize));
+                        segmentSize = static_cast<size_t>(coalescedSize);
+                    }
+                }
+            #endif
+            #else
+                received = transferWithinTimeout(POLLIN, [this, buffer, &sender](boost::system::error_code& err)
+                {
+                    return m_udpSocket.receive_from(boost::asio::buffer(buffer.data(), buffer.size()), sender, DEFAULT_RECV_MSG_FLAG, err);
+                }, err);
+                if(err)
+                {
+                    batchResult.timedOut = err == boost::asio::error::timed_out;
+                    return;
+                }
+            #endif
+                if(segmentSize == 0)
+                {
+                    segmentSize = received; // a single datagram, possibly an empty one
+                }
+                size_t offset = 0;
+                do
+                {
+                    if(batchResult.datagrams == datagrams.size())
+                    {
+                        err = boost::asio::error::no_buffer_space;
+                        return;
+                    }
+                    auto& datagram = datagrams[batchResult.datagrams++];
+                    datagram.data = buffer.data() + offset;
+                    datagram.bytes = std::min(segmentSize, received - offset);
+                    datagram.bufferSize = datagram.bytes;
+                    datagram.endPoint = sender;
+                #ifdef __linux__
+                    datagram.timestamp = timestamp; // every segment of a coalesced receive shares the first one's arrival
+                #endif
+                    offset += datagram.bytes;
+                    batchResult.bytes += datagram.bytes;
+                }
+                while(offset < received);
+            });
+            return batchResult;
+        });
+    }
+
+    // Waits for at least one datagram then takes whatever else is already queued, up to datagrams.size()
+    // recvmmsg moves up to MaxBatchSize per syscall on Linux
+    SocketBatchResult readBatch(std::span<UDPDatagram> datagrams)
+    {
+        return checkedBatch(SocketMode::Read, datagrams, [this, datagrams]()
+        {
+            SocketBatchResult batchResult {};
+            CheckForError(batchResult, [this, datagrams, &batchResult](boost::system::error_code& err)
+            {
+            #ifdef __linux__
+                mmsghdr messages[MaxBatchSize];
+                iovec vectors[MaxBatchSize];
+                alignas(cmsghdr) ControlBuffer controls[MaxBatchSize];
+                const bool timestamps = m_receiveTimestamps;
+                while(batchResult.datagrams < datagrams.size())
+                {
+                    const size_t count = std::min(MaxBatchSize, datagrams.size() - batchResult.datagrams);
+                    for(size_t i = 0; i < count; ++i)
+                    {
+                        auto& datagram = datagrams[batchResult.datagrams + i];
+                        vectors[i] = { datagram.data, datagram.bufferSize };
+                        messages[i] = {};
+                        messages[i].msg_hdr.msg_iov = &vectors[i];
+                        messages[i].msg_hdr.msg_iovlen = 1;
+                        messages[i].msg_hdr.msg_name = datagram.endPoint.data();
+                        messages[i].msg_hdr.msg_namelen = static_cast<socklen_t>(datagram.endPoint.capacity());
+                        if(timestamps)
+                        {
+                            messages[i].msg_hdr.msg_control = controls[i].data();
+                            messages[i].msg_hdr.msg_controllen = controls[i].size();
+                        }
+                    }
+                    const int received = ::recvmmsg(m_udpSocket.native_handle(), messages, static_cast<unsigned int>(count), DEFAULT_RECV_MSG_FLAG | MSG_DONTWAIT, nullptr);
+                    if(received < 0)
+                    {
+                        if(errno != EAGAIN && errno != EWOULDBLOCK)
+                        {
+                            err = LastSystemError();
+                            return;
+                        }
+                        if(batchResult.datagrams > 0)
+                        {
+                            return; // drained the queue
+                        }
+                        err = waitReadable();
+                        if(err)
+                        {
+                            batchResult.timedOut = err == boost::asio::error::timed_out;
+                            return;
+                        }
+                        continue;
+                    }
+                    for(int i = 0; i < received; ++i)
+                    {
+                        auto& datagram = datagrams[batchResult.datagrams + i];
+                        datagram.bytes = messages[i].msg_len;
+                        datagram.endPoint.resize(messages[i].msg_hdr.msg_namelen);
+                        if(timestamps)
+                        {
+                            datagram.timestamp = ReceiveTimestamp(messages[i].msg_hdr);
+                            recordReceiveDelay(datagram.timestamp);
+                        }
+                        batchResult.bytes += datagram.bytes;
+                    }
+                    batchResult.datagrams += received;
+                    if(static_cast<size_t>(received) < count)
+                    {
+                        return;
+                    }
+                }
+            #else
+                for(auto& datagram : datagrams)
+                {
+                    if(batchResult.datagrams > 0 && m_udpSocket.available(err) == 0)
+                    {
+                        return;
+                    }
+                    datagram.bytes = transferWithinTimeout(POLLIN, [this, &datagram](boost::system::error_code& err)
+                    {
+                        return m_udpSocket.receive_from(boost::asio::buffer(datagram.data, datagram.bufferSize), datagram.endPoint, DEFAULT_RECV_MSG_FLAG, err);
+                    }, err);
+                    if(err)
+                    {
+                        batchResult.timedOut = err == boost::asio::error::timed_out;
+                        return;
+                    }
+                    batchResult.bytes += datagram.bytes;
+                    ++batchResult.datagrams;
+                }
+            #endif
+            });
+            return batchResult;
+        });
+    }
+
 protected:
     SocketResult internalWriteData(unsigned char* data, size_t bufferSize) override
     {
         SocketResult result;
-        result.success = CheckForError([this, data, bufferSize, &result](boost::system::error_code& err)
+        CheckForError(result, [this, data, bufferSize, &result](boost::system::error_code& err)
         {
-            result.bytes = m_udpSocket.send_to(boost::asio::buffer(data, bufferSize), m_endPoint, DEFAULT_SEND_MSG_FLAG, err);
+            const auto endPoint = getEndPoint();
+            result.bytes = transferWithinTimeout(POLLOUT, [this, data, bufferSize, &endPoint](boost::system::error_code& err)
+            {
+                return m_udpSocket.send_to(boost::asio::buffer(data, bufferSize), endPoint, DEFAULT_SEND_MSG_FLAG, err);
+            }, err);
+            result.timedOut = err == boost::asio::error::timed_out;
         });
         return result;
     }
-};
\ No newline at end of file
+
+    SocketResult internalWriteBuffers(ConstBuffers buffers) override
+    {
+        SocketResult result {};
+        CheckForError(result, [this, buffers, &result](boost::system::error_code& err)
+        {
+            const auto endPoint = getEndPoint();
+            result.bytes = transferWithinTimeout(POLLOUT, [this, buffers, &endPoint](boost::system::error_code& err)
+            {
+                return m_udpSocket.send_to(buffers, endPoint, DEFAULT_SEND_MSG_FLAG, err);
+            }, err);
+            result.timedOut = err == boost::asio::error::timed_out;
+        });
+        return result;
+    }
+
+    AwaitableSocketResult internalAsyncWriteData(unsigned char* data, size_t bufferSize) override
+    {
+        SocketResult result {};
+        boost::system::error_code err;
+        const auto endPoint = getEndPoint();
+        result.bytes = co_await m_udpSocket.async_send_to(boost::asio::buffer(data, bufferSize), endPoint, DEFAULT_SEND_MSG_FLAG, boost::asio::redirect_error(boost::asio::use_awaitable, err));
+        CheckAsyncResult(result, err);
+        co_return result;
+    }
+
+    bool m_reusePort = false;
+    bool m_receiveOffloadRequested = false;
+    std::atomic_bool m_receiveOffload = false;
+};
+struct UDPShardOptions
+{
+    size_t shardCount = 0; // 0 is one per hardware thread
+    bool pinToCpus = false; // shard n runs on CPU n, Linux only
+    size_t batchSize = 32; // datagrams taken per readBatch
+    size_t datagramSize = static_cast<size_t>(BufferSize::UDP);
+    size_t frameCount = FrameRing::CacheLineSize * 16; // per shard, merged mode only
+    uint32_t timeoutMs = 20; // how long a worker waits before checking whether it should stop
+};
+
+// Spreads one port across several UDPServers bound with SO_REUSEPORT, each with its own worker thread
+// The kernel hashes every flow (source address and port) to one shard, so a single flow never goes faster than one core
+// Datagrams go to a callback on the receiving shard's thread, or into a ring per shard that one consumer drains as a merged stream
+class ShardedUDPServer : public NetworkingErrorHandler
+{
+public:
+    using ShardCallback = std::function<void(size_t shard, const UDPDatagram& datagram)>;
+
+    static constexpr uint32_t ErrorBackOffMs = 10;
+
+    ShardedUDPServer(const std::string& address, uint16_t port, UDPShardOptions options = {})
+        : m_address(address), m_port(port), m_options(options)
+    {
+        if(m_options.shardCount == 0)
+        {
+            m_options.shardCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        m_options.batchSize = std::max<size_t>(m_options.batchSize, 1);
+    }
+
+    ~ShardedUDPServer()
+    {
+        close();
+    }
+
+    // Binds every shard, nothing is read until start()
+    bool open()
+    {
+        close();
+        for(size_t i = 0; i < m_options.shardCount; ++i)
+        {
+            auto shard = std::make_unique<Shard>();
+            shard->socket = std::make_unique<UDPServer>(SocketType::Blocking, m_address, m_port, m_options.timeoutMs);
+            shard->socket->setReusePort(true);
+            if(!shard->socket->open())
+            {
+                setLastError(shard->socket->getLastError());
+                close();
+                return false;
+            }
+            m_shards.push_back(std::move(shard));
+        }
+        return true;
+    }
+
+    // Per-shard mode, onDatagram runs on the shard's own thread and the datagram is only valid during the call
+    bool start(ShardCallback onDatagram)
+    {
+        return startWorkers(std::move(onDatagram));
+    }
+
+    // Merged mode, drain() hands over what every shard has received
+    bool start()
+    {
+        return startWorkers(nullptr);
+    }
+
+    // Merged mode, calls function(size_t shard, std::span<const uint8_t> payload) for every datagram waiting on any shard
+    // Only one thread may drain, order is kept within a shard but not across them
+    template<typename Function>
+    size_t drain(Function&& function)
+    {
+        size_t frames = 0;
+        for(size_t i = 0; i < m_shards.size(); ++i)
+        {
+            if(m_shards[i]->frames)
+            {
+                frames += m_shards[i]->frames->drain([&function, i](std::span<const uint8_t> frame)
+                {
+                    function(i, frame);
+                });
+            }
+        }
+        return frames;
+    }
+
+    // Waits for the workers, the sockets stay bound
+    void stop()
+    {
+        m_running = false;
+        for(auto& shard : m_shards)
+        {
+            if(shard->worker.joinable())
+            {
+                shard->worker.join();
+            }
+        }
+    }
+
+    void close()
+    {
+        stop();
+        m_shards.clear();
+    }
+
+    bool isOpen() const
+    {
+        return !m_shards.empty();
+    }
+
+    bool isRunning() const
+    {
+        return m_running;
+    }
+
+    size_t getShardCount() const
+    {
+        return m_options.shardCount;
+    }
+
+    // Each shard keeps its own metrics and last error, enableMetrics() on the shard to have them
+    UDPServer& getShard(size_t shard)
+    {
+        return *m_shards.at(shard)->socket;
+    }
+
+    uint64_t getShardDatagrams(size_t shard) const
+    {
+        return m_shards.at(shard)->datagrams.load(std::memory_order_relaxed);
+    }
+
+    // Merged mode, datagrams thrown away because a shard's ring was full
+    size_t getDroppedFrames() const
+    {
+        size_t dropped = 0;
+        for(auto& shard : m_shards)
+        {
+            dropped += shard->frames ? shard->frames->getDroppedFrames() : 0;
+        }
+        return dropped;
+    }
+
+private:
+    struct alignas(FrameRing::CacheLineSize) Shard
+    {
+        std::unique_ptr<UDPServer> socket;
+        std::unique_ptr<FrameRing> frames;
+        std::thread worker;
+        std::atomic<uint64_t> datagrams = 0;
+    };
+
+    bool startWorkers(ShardCallback onDatagram)
+    {
+        if(m_shards.empty())
+        {
+            setLastError({ SocketErrorReason::NotInitialised });
+            return false;
+        }
+        if(m_running.exchange(true))
+        {
+            setLastError({ SocketErrorReason::AlreadyReading });
+            return false;
+        }
+        // only once nothing is running, the workers commit into the rings
+        if(!onDatagram)
+        {
+            for(auto& shard : m_shards)
+            {
+                shard->frames = std::make_unique<FrameRing>(m_options.frameCount, m_options.datagramSize);
+            }
+        }
+        for(size_t i = 0; i < m_shards.size(); ++i)
+        {
+            m_shards[i]->worker = std::thread([this, i, onDatagram]()
+            {
+                if(m_options.pinToCpus)
+                {
+                    pinToCpu(i);
+                }
+                receive(i, onDatagram);
+            });
+        }
+        return true;
+    }
+
+    void receive(size_t index, const ShardCallback& onDatagram)
+    {
+        auto& shard = *m_shards[index];
+        std::vector<uint8_t> storage(m_options.batchSize * m_options.datagramSize);
+        std::vector<UDPDatagram> datagrams(m_options.batchSize);
+        for(size_t i = 0; i < datagrams.size(); ++i)
+        {
+            datagrams[i] = { storage.data() + i * m_options.datagramSize, m_options.datagramSize };
+        }
+        while(m_running)
+        {
+            auto batchResult = shard.socket->readBatch(datagrams);
+            if(!batchResult)
+            {
+                if(!batchResult.timedOut)
+                {
+                    // the last error is on the shard, the back-off has a floor so a timeoutMs of 0 doesn't spin on it
+                    std::this_thread::sleep_for(std::chrono::milliseconds(std::max(m_options.timeoutMs, ErrorBackOffMs)));
+                }
+                continue;
+            }
+            shard.datagrams.fetch_add(batchResult.datagrams, std::memory_order_relaxed);
+            for(size_t i = 0; i < batchResult.datagrams; ++i)
+            {
+                if(onDatagram)
+                {
+                    onDatagram(index, datagrams[i]);
+                    continue;
+                }
+                auto frame = shard.frames->acquire();
+                if(frame.empty())
+                {
+                    shard.frames->dropped();
+                    continue;
+                }
+                std::memcpy(frame.data(), datagrams[i].data, datagrams[i].bytes);
+                shard.frames->commit(datagrams[i].bytes);
+            }
+        }
+    }
+
+    static void pinToCpu(size_t shard)
+    {
+    #ifdef __linux__
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(shard % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+        ::pthread_setaffinity_np(::pthread_self(), sizeof(cpus), &cpus);
+    #endif
+    }
+
+    std::string m_address;
+    uint16_t m_port;
+    UDPShardOptions m_options;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    std::atomic_bool m_running = false;
+};
@@ -0,0 +1,761 @@
+//
+//          Created by Riki Lowe on 17/09/2024.
+//
+//              Copyright Riki Lowe 2024
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+//
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "catch/catch.hpp"
+
+#include <future>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "../include/UDPSocket.h"
+#include "../include/TCPSocket.h"
+#include "../include/BasicSocket.h"
+#include "../include/SocketBatch.h"
+#include "../include/SerialPort.h"
+#include "../include/PseudoTerminal.h"
+
+#define UDP_BENCH_PORT 10025
+#define TCP_BENCH_PORT 10026
+#define UDP_ECHO_PORT 10027
+#define TCP_ECHO_PORT 10028
+
+// Resident set size in bytes, 0 where /proc isn't available
+size_t ResidentBytes()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line))
+    {
+        if(line.rfind("VmRSS:", 0) == 0)
+        {
+            return std::stoull(line.substr(6)) * 1024;
+        }
+    }
+    return 0;
+}
+
+std::string BenchData = "Hello World!";
+
+TEST_CASE("Per-operation dispatch overhead", "[benchmark]")
+{
+    auto operation = []()
+    {
+        return SocketResult { 0, true };
+    };
+
+    // What ISocket::readData/writeData used to do for every call
+    BENCHMARK("std::async per operation")
+    {
+        return std::async(std::launch::async, operation).share().get();
+    };
+
+    BENCHMARK("SocketExecutor post per operation")
+    {
+        auto task = std::make_shared<std::packaged_task<SocketResult()>>(operation);
+        auto result = task->get_future().share();
+        SocketExecutor::instance().post([task]()
+        {
+            (*task)();
+        });
+        return result.get();
+    };
+}
+
+TEST_CASE("Socket metrics overhead", "[benchmark]")
+{
+    SocketMetrics metrics;
+    SocketResult result { 64, true };
+    auto latency = std::chrono::nanoseconds(1500);
+
+    // What every operation adds when metrics are on, the two clock reads are most of it
+    BENCHMARK("SocketMetrics record")
+    {
+        metrics.write.record(result.success, result.timedOut, result.bytes, result.bytes, latency);
+        return metrics.write.bytes.load(std::memory_order_relaxed);
+    };
+
+    BENCHMARK("steady_clock::now")
+    {
+        return std::chrono::steady_clock::now();
+    };
+
+    UDPServer readPort(SocketType::Blocking, "", UDP_BENCH_PORT);
+    UDPClient writePort(SocketType::Blocking, "", UDP_BENCH_PORT);
+    REQUIRE(readPort.open());
+    REQUIRE(writePort.open());
+    writePort.enableMetrics();
+
+    BENCHMARK("UDPClient::writeData (Blocking) with metrics")
+    {
+        return writePort.writeData((unsigned char*)BenchData.data(), BenchData.length()).get();
+    };
+
+    writePort.setMetricsEnabled(false);
+    BENCHMARK("UDPClient::writeData (Blocking) without metrics")
+    {
+        return writePort.writeData((unsigned char*)BenchData.data(), BenchData.length()).get();
+    };
+}
+
+// No kernel underneath, so all that is measured is the front end
+struct NullTransport
+{
+    boost::system::error_code open() { m_open = true; return {}; }
+    void close() { m_open = false; }
+    bool isOpen() const { return m_open; }
+    void cancel() {}
+    std::string getName() const { return "null"; }
+
+    template<typename Buffers>
+    size_t read(const Buffers& buffers, boost::system::error_code&) { return boost::asio::buffer_size(buffers); }
+    template<typename Buffers>
+    size_t write(const Buffers& buffers, boost::system::error_code&) { return boost::asio::buffer_size(buffers); }
+    template<typename Buffers>
+    boost::asio::awaitable<size_t> asyncRead(Buffers buffers, boost::system::error_code&) { co_return boost::asio::buffer_size(buffers); }
+    template<typename Buffers>
+    boost::asio::awaitable<size_t> asyncWrite(Buffers buffers, boost::system::error_code&) { co_return boost::asio::buffer_size(buffers); }
+
+    bool m_open = false;
+};
+
+TEST_CASE("Compile-time vs virtual socket dispatch", "[benchmark]")
+{
+    auto data = std::span((const uint8_t*)BenchData.data(), BenchData.length());
+
+    BasicSocket<NullTransport, NoEvents, IgnoreErrors> bareSocket;
+    REQUIRE(bareSocket.open());
+    BENCHMARK("BasicSocket<NoEvents, IgnoreErrors>::writeData")
+    {
+        return bareSocket.writeData(data);
+    };
+
+    size_t callbacks = 0;
+    BasicSocket<NullTransport, CallbackEvents, LastErrorPolicy> callbackSocket;
+    callbackSocket.getEvents().write.postCallback = [&callbacks](uint8_t*, SocketResult&) { ++callbacks; };
+    REQUIRE(callbackSocket.open());
+    BENCHMARK("BasicSocket<CallbackEvents, LastErrorPolicy>::writeData")
+    {
+        return callbackSocket.writeData(data);
+    };
+
+    SocketAdapter<NullTransport> adapter(SocketType::Blocking, SocketMode::Write);
+    REQUIRE(adapter.open());
+    ISocket& socket = adapter;
+    socket.enableMetrics();
+    BENCHMARK("ISocket::writeData (Blocking) with metrics")
+    {
+        return socket.writeData((unsigned char*)BenchData.data(), BenchData.length()).get();
+    };
+
+    socket.setMetricsEnabled(false);
+    BENCHMARK("ISocket::writeData (Blocking) without metrics")
+    {
+        return socket.writeData((unsigned char*)BenchData.data(), BenchData.length()).get();
+    };
+
+    // And with a real send underneath, the transport has none of the UDPClient's locks, metrics or error bookkeeping
+    UDPServer readPort(SocketType::Blocking, "", UDP_BENCH_PORT);
+    UDPClient writePort(SocketType::Blocking, "", UDP_BENCH_PORT);
+    BasicSocket<UDPClientTransport, NoEvents, IgnoreErrors> udpSocket("localhost", UDP_BENCH_PORT);
+    REQUIRE(readPort.open());
+    REQUIRE(writePort.open());
+    REQUIRE(udpSocket.open());
+    BENCHMARK("BasicSocket<UDPClientTransport, NoEvents, IgnoreErrors>::writeData")
+    {
+        return udpSocket.writeData(data);
+    };
+
+    BENCHMARK("UDPClient::writeData (Blocking) without metrics")
+    {
+        return writePort.writeData((unsigned char*)BenchData.data(), BenchData.length()).get();
+    };
+}
+
+TEST_CASE("Failed operation overhead", "[benchmark]")
+{
+    UDPClient writePort(SocketType::Blocking, "", UDP_BENCH_PORT);
+    UDPClient closedPort(SocketType::Blocking, "", UDP_BENCH_PORT);
+    REQUIRE(writePort.open());
+    std::vector<unsigned char> oversized(70000);
+    std::array<UDPDatagram, 1> datagrams {{ { oversized.data(), oversized.size() } }};
+
+    // An error storm, every send is rejected by the kernel or before it
+    BENCHMARK("writeBatch rejected by the kernel (EMSGSIZE)")
+    {
+        return writePort.writeBatch(datagrams);
+    };
+
+    BENCHMARK("writeBatch on a port that isn't open")
+    {
+        return closedPort.writeBatch(datagrams);
+    };
+
+    // Only paid by whoever asks
+    BENCHMARK("getLastErrorMessage")
+    {
+        writePort.writeBatch(datagrams);
+        return writePort.getLastErrorMessage();
+    };
+}
+
+TEST_CASE("UDP segmentation offload", "[benchmark]")
+{
+    static constexpr size_t SegmentSize = 1400;
+    static constexpr size_t SegmentCount = UDPClient::MaxSegmentedBytes / SegmentSize;
+    std::vector<uint8_t> payload(SegmentSize * SegmentCount, 'x');
+    std::vector<UDPDatagram> datagrams(SegmentCount);
+    for(size_t i = 0; i < SegmentCount; ++i)
+    {
+        datagrams[i] = { payload.data() + i * SegmentSize, SegmentSize };
+    }
+
+    UDPServer readPort(SocketType::Blocking, "", UDP_BENCH_PORT, 0);
+    UDPClient writePort(SocketType::Blocking, "", UDP_BENCH_PORT);
+    readPort.setReceiveOffload(true);
+    REQUIRE(readPort.open());
+    REQUIRE(writePort.open());
+    std::cout << "UDP_SEGMENT: " << (writePort.isSegmentationOffloadEnabled() ? "on" : "off")
+              << ", UDP_GRO: " << (readPort.isReceiveOffloadEnabled() ? "on" : "off") << std::endl;
+
+    // Keeps the receive queue drained so sends never find it full
+    std::atomic_bool reading = true;
+    std::atomic<uint64_t> receives = 0;
+    std::atomic<uint64_t> segments = 0;
+    std::thread reader([&]()
+    {
+        std::vector<uint8_t> buffer(UDPServer::MaxSegmentedBytes);
+        std::vector<UDPDatagram> received(UDPClient::MaxSegments);
+        while(reading)
+        {
+            auto readResult = readPort.readSegmented(buffer, received);
+            receives += readResult.datagrams > 0;
+            segments += readResult.datagrams;
+        }
+    });
+
+    BENCHMARK("writeSegmented " + std::to_string(SegmentCount) + "x" + std::to_string(SegmentSize) + "B (UDP_SEGMENT)")
+    {
+        return writePort.writeSegmented(payload, SegmentSize);
+    };
+
+    writePort.setSegmentationOffload(false);
+    BENCHMARK("writeSegmented " + std::to_string(SegmentCount) + "x" + std::to_string(SegmentSize) + "B (sendmmsg)")
+    {
+        return writePort.writeSegmented(payload, SegmentSize);
+    };
+
+    BENCHMARK("writeData x" + std::to_string(SegmentCount) + " " + std::to_string(SegmentSize) + "B")
+    {
+        for(auto& datagram : datagrams)
+        {
+            writePort.writeData(datagram.data, datagram.bufferSize);
+        }
+        return datagrams.size();
+    };
+
+    reading = false;
+    readPort.close();
+    reader.join();
+    std::cout << "segments per receive: " << (receives ? static_cast<double>(segments) / receives : 0.0) << std::endl;
+}
+
+TEST_CASE("Non-blocking UDP write overhead", "[benchmark]")
+{
+    UDPServer readPort(SocketType::NonBlocking, "", UDP_BENCH_PORT);
+    UDPClient writePort(SocketType::NonBlocking, "", UDP_BENCH_PORT);
+    UDPClient blockingWritePort(SocketType::Blocking, "", UDP_BENCH_PORT);
+    REQUIRE(readPort.open());
+    REQUIRE(writePort.open());
+    REQUIRE(blockingWritePort.open());
+
+    BENCHMARK("UDPClient::writeData (NonBlocking)")
+    {
+        return writePort.writeData((unsigned char*)BenchData.data(), BenchData.length()).get();
+    };
+
+    // Blocking writes run inline, so wrapping one in std::async is the old non-blocking path
+    BENCHMARK("std::async + UDPClient::writeData (Blocking)")
+    {
+        return std::async(std::launch::async, [&blockingWritePort]()
+        {
+            return blockingWritePort.writeData((unsigned char*)BenchData.data(), BenchData.length()).get();
+        }).get();
+    };
+}
+
+TEST_CASE("UDP loopback single datagram vs batched", "[benchmark]")
+{
+    static constexpr size_t BurstSize = 32;
+    UDPServer readPort(SocketType::Blocking, "", UDP_BENCH_PORT);
+    UDPClient writePort(SocketType::Blocking, "", UDP_BENCH_PORT);
+    REQUIRE(readPort.open());
+    REQUIRE(writePort.open());
+
+    std::vector<std::array<unsigned char, 64>> readBuffers(BurstSize);
+    std::vector<UDPDatagram> readDatagrams(BurstSize);
+    std::vector<UDPDatagram> writeDatagrams(BurstSize);
+    for(size_t i = 0; i < BurstSize; ++i)
+    {
+        readDatagrams[i].data = readBuffers[i].data();
+        readDatagrams[i].bufferSize = readBuffers[i].size();
+        writeDatagrams[i].data = (unsigned char*)BenchData.data();
+        writeDatagrams[i].bufferSize = BenchData.length();
+    }
+
+    BENCHMARK("writeData/readData x" + std::to_string(BurstSize))
+    {
+        size_t datagramsRead = 0;
+        for(size_t i = 0; i < BurstSize; ++i)
+        {
+            writePort.writeData((unsigned char*)BenchData.data(), BenchData.length());
+        }
+        for(size_t i = 0; i < BurstSize; ++i)
+        {
+            datagramsRead += readPort.readData(readBuffers[i].data(), readBuffers[i].size()).get() ? 1 : 0;
+        }
+        return datagramsRead;
+    };
+
+    BENCHMARK("writeBatch/readBatch x" + std::to_string(BurstSize))
+    {
+        size_t datagramsRead = 0;
+        writePort.writeBatch(writeDatagrams);
+        while(datagramsRead < BurstSize)
+        {
+            datagramsRead += readPort.readBatch(std::span(readDatagrams).subspan(datagramsRead)).datagrams;
+        }
+        return datagramsRead;
+    };
+}
+
+TEST_CASE("UDP loopback epoll vs io_uring", "[benchmark]")
+{
+    static constexpr size_t BurstSize = 32;
+    std::vector<std::array<unsigned char, 64>> readBuffers(BurstSize);
+    UDPServer readPort(SocketType::Blocking, "", UDP_BENCH_PORT);
+    UDPClient writePort(SocketType::Blocking, "", UDP_BENCH_PORT);
+    REQUIRE(readPort.open());
+    REQUIRE(writePort.open());
+
+    for(auto backend : { IOBackend::Reactor, IOBackend::IoUring })
+    {
+        const std::string name = backend == IOBackend::Reactor ? "epoll" : "io_uring";
+        if(!readPort.setIOBackend(backend) || !writePort.setIOBackend(backend))
+        {
+            std::cout << name << " isn't supported here" << std::endl;
+            continue;
+        }
+        BENCHMARK(name + " writeData/readData x" + std::to_string(BurstSize))
+        {
+            size_t datagramsRead = 0;
+            for(size_t i = 0; i < BurstSize; ++i)
+            {
+                writePort.writeData((unsigned char*)BenchData.data(), BenchData.length());
+            }
+            for(size_t i = 0; i < BurstSize; ++i)
+            {
+                datagramsRead += readPort.readData(readBuffers[i].data(), readBuffers[i].size()).get() ? 1 : 0;
+            }
+            return datagramsRead;
+        };
+    }
+
+    // Every write then every read in one io_uring_enter each, or one after another on the reactor without io_uring
+    SocketBatch writes;
+    SocketBatch reads;
+    for(size_t i = 0; i < BurstSize; ++i)
+    {
+        writes.write(writePort, std::span((const uint8_t*)BenchData.data(), BenchData.length()));
+        reads.read(readPort, readBuffers[i]);
+    }
+    BENCHMARK("SocketBatch write x" + std::to_string(BurstSize) + " read x" + std::to_string(BurstSize))
+    {
+        writes.submit();
+        size_t datagramsRead = 0;
+        for(auto& result : reads.submit())
+        {
+            datagramsRead += result ? 1 : 0;
+        }
+        return datagramsRead;
+    };
+}
+
+TEST_CASE("UDP kernel receive timestamps", "[benchmark]")
+{
+    static constexpr size_t BurstSize = 32;
+    std::vector<std::array<unsigned char, 64>> readBuffers(BurstSize);
+    std::vector<UDPDatagram> readDatagrams(BurstSize);
+    std::vector<UDPDatagram> writeDatagrams(BurstSize);
+    for(size_t i = 0; i < BurstSize; ++i)
+    {
+        readDatagrams[i].data = readBuffers[i].data();
+        readDatagrams[i].bufferSize = readBuffers[i].size();
+        writeDatagrams[i].data = (unsigned char*)BenchData.data();
+        writeDatagrams[i].bufferSize = BenchData.length();
+    }
+
+    for(bool timestamps : { false, true })
+    {
+        UDPServer readPort(SocketType::Blocking, "", UDP_BENCH_PORT);
+        UDPClient writePort(SocketType::Blocking, "", UDP_BENCH_PORT);
+        readPort.setReceiveTimestamps(timestamps);
+        readPort.enableMetrics();
+        REQUIRE(readPort.open());
+        REQUIRE(writePort.open());
+
+        BENCHMARK(std::string("writeBatch/readBatch x") + std::to_string(BurstSize) + (timestamps ? " SO_TIMESTAMPNS" : ""))
+        {
+            size_t datagramsRead = 0;
+            writePort.writeBatch(writeDatagrams);
+            while(datagramsRead < BurstSize)
+            {
+                datagramsRead += readPort.readBatch(std::span(readDatagrams).subspan(datagramsRead)).datagrams;
+            }
+            return datagramsRead;
+        };
+
+        // How long a datagram sat in the socket before a read took it, the last in a burst waits for the others
+        if(timestamps)
+        {
+            const auto receiveDelay = readPort.getMetrics().receiveDelay;
+            std::cout << "kernel to application p50: " << receiveDelay.getPercentile(0.5).count()
+                      << "ns p99: " << receiveDelay.getPercentile(0.99).count() << "ns" << std::endl;
+        }
+        readPort.close();
+        writePort.close();
+    }
+}
+
+TEST_CASE("Sharded UDP server throughput", "[benchmark]")
+{
+    static constexpr size_t SenderCount = 8;
+    static constexpr size_t BurstSize = 32;
+    static constexpr auto Duration = std::chrono::milliseconds(500);
+    const size_t maxShards = std::max<size_t>(4, std::thread::hardware_concurrency());
+    std::vector<unsigned char> payload(64, 'x');
+    std::vector<UDPDatagram> burst(BurstSize, UDPDatagram { payload.data(), payload.size() });
+
+    // The same offered load each time, only the number of receiving shards changes
+    for(size_t shardCount = 1; shardCount <= maxShards; shardCount *= 2)
+    {
+        UDPShardOptions options;
+        options.shardCount = shardCount;
+        options.pinToCpus = true;
+        ShardedUDPServer server("", UDP_BENCH_PORT, options);
+        REQUIRE(server.open());
+        std::atomic<uint64_t> received = 0;
+        REQUIRE(server.start([&received](size_t, const UDPDatagram&)
+        {
+            received.fetch_add(1, std::memory_order_relaxed);
+        }));
+        std::atomic_bool sending = true;
+        std::vector<std::thread> senders;
+        for(size_t i = 0; i < SenderCount; ++i)
+        {
+            senders.emplace_back([&sending, burst]() mutable
+            {
+                UDPClient client(SocketType::Blocking, "", UDP_BENCH_PORT);
+                client.open();
+                while(sending)
+                {
+                    client.writeBatch(burst);
+                }
+            });
+        }
+        std::this_thread::sleep_for(Duration / 5); // let the sockets fill up first
+        const uint64_t receivedBefore = received;
+        const auto start = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(Duration);
+        const uint64_t datagrams = received - receivedBefore;
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        sending = false;
+        for(auto& sender : senders)
+        {
+            sender.join();
+        }
+        server.close();
+        std::cout << "shards: " << shardCount
+                  << ", datagrams/s: " << static_cast<uint64_t>(datagrams / seconds)
+                  << ", MB/s: " << std::fixed << std::setprecision(1) << datagrams * payload.size() / seconds / 1e6 << std::endl;
+        REQUIRE(datagrams > 0);
+    }
+}
+
+TEST_CASE("TCP server idle connection scaling", "[benchmark]")
+{
+    size_t connectionCount = 10000;
+#ifndef _WIN32
+    // Both ends of every connection live in this process
+    rlimit fileLimit {};
+    getrlimit(RLIMIT_NOFILE, &fileLimit);
+    fileLimit.rlim_cur = fileLimit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &fileLimit);
+    connectionCount = std::min<size_t>(connectionCount, (fileLimit.rlim_cur - 256) / 2);
+#endif
+    TCPServer server(SocketType::NonBlocking, "", TCP_BENCH_PORT, connectionCount);
+    REQUIRE(server.open());
+    std::vector<std::unique_ptr<TCPClient>> clients;
+    clients.reserve(connectionCount);
+    const size_t residentBefore = ResidentBytes();
+    const auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < connectionCount; ++i)
+    {
+        clients.push_back(std::make_unique<TCPClient>(SocketType::NonBlocking, "", TCP_BENCH_PORT));
+        REQUIRE(clients.back()->open());
+    }
+    while(server.getConnectionCount() < connectionCount)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    const size_t residentAfter = ResidentBytes();
+    // Includes the client side of every connection as well
+    std::cout << "idle connections: " << connectionCount
+              << ", established in " << elapsed.count() << "ms"
+              << ", resident bytes per connection pair: " << (residentAfter - residentBefore) / connectionCount << std::endl;
+    REQUIRE(server.getConnectionCount() == connectionCount);
+}
+
+// Round trip latency and throughput
+// Each configuration is timed one round trip at a time for the percentiles, then again under BENCHMARK for Catch's own statistics
+// Set SIMPLENETWORKING_BENCH_OUTPUT to a file to append one JSON object per configuration, so results can be compared between releases
+// SIMPLENETWORKING_BENCH_ROUND_TRIPS overrides how many round trips the percentiles are taken over
+
+struct RoundTripReport
+{
+    std::string transport;
+    SocketType socketType;
+    size_t payloadBytes;
+    size_t roundTrips;
+    double messagesPerSecond;
+    std::chrono::nanoseconds p50;
+    std::chrono::nanoseconds p99;
+    std::chrono::nanoseconds p999;
+};
+
+std::string SocketTypeName(SocketType socketType)
+{
+    switch(socketType)
+    {
+        case SocketType::Blocking: return "Blocking";
+        case SocketType::NonBlocking: return "NonBlocking";
+        case SocketType::BusyPoll: return "BusyPoll";
+    }
+    return "Unknown";
+}
+
+size_t RoundTripCount()
+{
+    const char* roundTrips = std::getenv("SIMPLENETWORKING_BENCH_ROUND_TRIPS");
+    return roundTrips ? std::max<size_t>(std::stoull(roundTrips), 1) : 10000;
+}
+
+std::chrono::nanoseconds Percentile(const std::vector<std::chrono::nanoseconds>& sortedSamples, double percentile)
+{
+    const size_t rank = static_cast<size_t>(std::ceil(percentile * sortedSamples.size()));
+    return sortedSamples[std::clamp<size_t>(rank, 1, sortedSamples.size()) - 1];
+}
+
+void WriteReport(const RoundTripReport& report)
+{
+    std::cout << std::left << std::setw(8) << report.transport << std::setw(12) << SocketTypeName(report.socketType)
+              << std::right << std::setw(7) << report.payloadBytes << " B "
+              << std::setw(10) << static_cast<uint64_t>(report.messagesPerSecond) << " msg/s"
+              << "  p50 " << std::setw(8) << report.p50.count() / 1000.0 << "us"
+              << "  p99 " << std::setw(8) << report.p99.count() / 1000.0 << "us"
+              << "  p999 " << std::setw(8) << report.p999.count() / 1000.0 << "us" << std::endl;
+    const char* outputPath = std::getenv("SIMPLENETWORKING_BENCH_OUTPUT");
+    if(!outputPath)
+    {
+        return;
+    }
+    std::ofstream output(outputPath, std::ios::app);
+    output << "{\"transport\":\"" << report.transport << "\""
+           << ",\"socketType\":\"" << SocketTypeName(report.socketType) << "\""
+           << ",\"payloadBytes\":" << report.payloadBytes
+           << ",\"roundTrips\":" << report.roundTrips
+           << ",\"messagesPerSecond\":" << report.messagesPerSecond
+           << ",\"p50Ns\":" << report.p50.count()
+           << ",\"p99Ns\":" << report.p99.count()
+           << ",\"p999Ns\":" << report.p999.count() << "}\n";
+}
+
+// roundTrip() sends payloadBytes and returns once they have all come back
+template<typename RoundTrip>
+void MeasureRoundTrips(const std::string& transport, SocketType socketType, size_t payloadBytes, RoundTrip&& roundTrip)
+{
+    using Clock = std::chrono::steady_clock;
+    const size_t roundTrips = RoundTripCount();
+    for(size_t i = 0; i < std::min<size_t>(roundTrips / 10, 1000); ++i)
+    {
+        REQUIRE(roundTrip());
+    }
+    std::vector<std::chrono::nanoseconds> samples(roundTrips);
+    const auto start = Clock::now();
+    for(auto& sample : samples)
+    {
+        const auto sent = Clock::now();
+        REQUIRE(roundTrip());
+        sample = Clock::now() - sent;
+    }
+    const std::chrono::duration<double> elapsed = Clock::now() - start;
+    std::sort(samples.begin(), samples.end());
+    WriteReport({ transport, socketType, payloadBytes, roundTrips, roundTrips / elapsed.count(), Percentile(samples, 0.5), Percentile(samples, 0.99), Percentile(samples, 0.999) });
+
+    BENCHMARK(transport + " " + SocketTypeName(socketType) + " round trip " + std::to_string(payloadBytes) + "B")
+    {
+        return roundTrip();
+    };
+}
+
+const std::vector<size_t> PayloadSizes = { 16, 256, 1024, 8192 };
+const std::vector<SocketType> SocketTypes = { SocketType::Blocking, SocketType::NonBlocking, SocketType::BusyPoll };
+
+TEST_CASE("UDP loopback round trip", "[benchmark][latency]")
+{
+    // Echoes every datagram back to whoever sent it
+    UDPServer echoPort(SocketType::Blocking, SocketMode::ReadWrite, "", UDP_ECHO_PORT, 0);
+    REQUIRE(echoPort.open());
+    std::atomic_bool echoing = true;
+    std::thread echoThread([&echoPort, &echoing]()
+    {
+        std::vector<unsigned char> echoBuffer(PayloadSizes.back());
+        while(echoing)
+        {
+            auto result = echoPort.readData(echoBuffer.data(), echoBuffer.size()).get();
+            if(result)
+            {
+                echoPort.writeData(echoBuffer.data(), result.bytes);
+            }
+        }
+    });
+    for(auto socketType : SocketTypes)
+    {
+        UDPClient client(socketType, SocketMode::ReadWrite, "", UDP_ECHO_PORT, 1000);
+        REQUIRE(client.open());
+        for(size_t payloadBytes : PayloadSizes)
+        {
+            std::vector<unsigned char> payload(payloadBytes, 'x');
+            std::vector<unsigned char> readBuffer(payloadBytes);
+            MeasureRoundTrips("udp", socketType, payloadBytes, [&]()
+            {
+                return client.writeData(payload.data(), payload.size()).get() && client.readData(readBuffer.data(), readBuffer.size()).get().bytes == payloadBytes;
+            });
+        }
+    }
+    echoing = false;
+    echoPort.close();
+    echoThread.join();
+}
+
+TEST_CASE("TCP loopback round trip", "[benchmark][latency]")
+{
+    TCPServer server(SocketType::Blocking, "", TCP_ECHO_PORT);
+    server.getServerCallbacks().acceptedCallback = [](const std::shared_ptr<TCPConnection>& connection)
+    {
+        std::weak_ptr<TCPConnection> weakConnection = connection;
+        connection->getSocketEventCallbacks().read.postCallback = [weakConnection](uint8_t* data, SocketResult& result)
+        {
+            auto connection = weakConnection.lock();
+            if(result && connection)
+            {
+                connection->writeData(data, result.bytes);
+            }
+        };
+    };
+    REQUIRE(server.open());
+    for(auto socketType : SocketTypes)
+    {
+        TCPClient client(socketType, SocketMode::ReadWrite, "", TCP_ECHO_PORT, 1000);
+        REQUIRE(client.open());
+        for(size_t payloadBytes : PayloadSizes)
+        {
+            std::vector<unsigned char> payload(payloadBytes, 'x');
+            std::vector<unsigned char> readBuffer(payloadBytes);
+            MeasureRoundTrips("tcp", socketType, payloadBytes, [&]()
+            {
+                if(!client.writeData(payload.data(), payload.size()).get())
+                {
+                    return false;
+                }
+                // the echo comes back in however many segments it likes
+                for(size_t received = 0; received < payloadBytes;)
+                {
+                    auto result = client.readData(readBuffer.data() + received, readBuffer.size() - received).get();
+                    if(!result)
+                    {
+                        return false;
+                    }
+                    received += result.bytes;
+                }
+                return true;
+            });
+        }
+        client.close();
+    }
+    server.close();
+}
+
+#ifndef _WIN32
+TEST_CASE("Pseudo-terminal serial round trip", "[benchmark][latency]")
+{
+    PseudoTerminal terminal;
+    REQUIRE(terminal.isOpen());
+    // The master end stands in for a device that echoes every byte straight back
+    std::atomic_bool echoing = true;
+    std::thread echoThread([&terminal, &echoing]()
+    {
+        std::array<uint8_t, 4096> echoBuffer {};
+        while(echoing)
+        {
+            const size_t bytes = terminal.read(echoBuffer, 10);
+            terminal.write(std::span(echoBuffer.data(), bytes));
+        }
+    });
+    for(auto socketType : SocketTypes)
+    {
+        SerialPort port(socketType, SocketMode::ReadWrite, terminal.getDeviceName());
+        REQUIRE(port.open());
+        // Reading continuously, since a one-off read flushes whatever has already been echoed
+        REQUIRE(port.startReadingContinuously());
+        auto& frames = *port.getReceivedFrames();
+        for(size_t payloadBytes : { size_t(16), size_t(256), size_t(1024) })
+        {
+            std::vector<unsigned char> payload(payloadBytes, 'x');
+            MeasureRoundTrips("serial", socketType, payloadBytes, [&]()
+            {
+                if(!port.writeData(payload.data(), payload.size()).get())
+                {
+                    return false;
+                }
+                size_t received = 0;
+                while(received < payloadBytes)
+                {
+                    if(frames.drain([&received](std::span<const uint8_t> frame) { received += frame.size(); }) == 0)
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+                return received == payloadBytes;
+            });
+        }
+        port.close();
+    }
+    echoing = false;
+    echoThread.join();
+}
+#endif
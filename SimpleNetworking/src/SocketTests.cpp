@@ -14,9 +14,23 @@
 #include <thread>
 #include <chrono>
 #include <iostream>
+#include <set>
+#include <random>
+#include <deque>
+#include <numeric>
+#include <fstream>
+#include <filesystem>
 
 #include "../include/SerialPort.h"
 #include "../include/UDPSocket.h"
+#include "../include/TCPSocket.h"
+#include "../include/MessageFramer.h"
+#include "../include/BasicSocket.h"
+#include "../include/SocketBatch.h"
+#include "../include/PseudoTerminal.h"
+#include "../include/Serialization.h"
+#include "../include/SocketGroup.h"
+#include "../include/ReliableUDP.h"
 
 #define SERIAL_PORT_RUNNING 1
 
@@ -24,11 +38,55 @@
 #define SERIAL_PORT_WRITE 2
 
 #define UDP_PORT 10015
+#define TCP_PORT 10016
+
+// Counts heap allocations made on each thread, for checking paths that shouldn't make any
+thread_local size_t ThreadAllocations = 0;
+
+void* operator new(size_t size)
+{
+    ++ThreadAllocations;
+    if(void* allocation = std::malloc(size ? size : 1))
+    {
+        return allocation;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* allocation) noexcept
+{
+    std::free(allocation);
+}
+
+void operator delete(void* allocation, size_t) noexcept
+{
+    std::free(allocation);
+}
+
+#ifdef _WIN32
+std::shared_ptr<SerialPort> MakeSerialPort(SocketType type, SocketMode mode, uint16_t port)
+{
+    return std::make_shared<SerialPort>(type, mode, port);
+}
+#else
+// No hardware needed, port 1 and port 2 are the two ends of a pseudo-terminal null modem
+NullModem& GetNullModem()
+{
+    static NullModem nullModem;
+    return nullModem;
+}
+
+std::shared_ptr<SerialPort> MakeSerialPort(SocketType type, SocketMode mode, uint16_t port)
+{
+    REQUIRE(GetNullModem().isOpen());
+    return std::make_shared<SerialPort>(type, mode, GetNullModem().getDeviceName(port - 1));
+}
+#endif
 
 void PrepareReadWriteSerialPorts(std::shared_ptr<SerialPort>& readPort, std::shared_ptr<SerialPort>& writePort, SocketType type)
 {
-    readPort = std::make_shared<SerialPort>(type, SocketMode::Read, SERIAL_PORT_READ);
-    writePort = std::make_shared<SerialPort>(type, SocketMode::Write, SERIAL_PORT_WRITE);
+    readPort = MakeSerialPort(type, SocketMode::Read, SERIAL_PORT_READ);
+    writePort = MakeSerialPort(type, SocketMode::Write, SERIAL_PORT_WRITE);
     REQUIRE_FALSE(readPort->isOpen());
     REQUIRE_FALSE(writePort->isOpen());
     REQUIRE(readPort->open());
@@ -48,10 +106,11 @@ void StopReadWritePorts(const std::shared_ptr<PortType>& readPort, const std::sh
     REQUIRE_FALSE(writePort->isOpen());
 }
 
-void PrepareReadWriteUDPPorts(std::shared_ptr<UDPServer>& readPort, std::shared_ptr<UDPClient>& writePort, SocketType type)
+// Readers wait indefinitely by default since the tests sleep between reading and writing
+void PrepareReadWriteUDPPorts(std::shared_ptr<UDPServer>& readPort, std::shared_ptr<UDPClient>& writePort, SocketType type, uint32_t timeoutMs = 0)
 {
-    readPort = std::make_shared<UDPServer>(type, "", UDP_PORT);
-    writePort = std::make_shared<UDPClient>(type, "", UDP_PORT);
+    readPort = std::make_shared<UDPServer>(type, "", UDP_PORT, timeoutMs);
+    writePort = std::make_shared<UDPClient>(type, "", UDP_PORT, timeoutMs);
     REQUIRE_FALSE(readPort->isOpen());
     REQUIRE(readPort->open());
     REQUIRE_FALSE(writePort->isOpen());
@@ -72,6 +131,55 @@ auto postReadFailedCallback = [](uint8_t* data, SocketResult& result)
     REQUIRE_FALSE(result.success);
 };
 
+#ifdef __linux__
+// Threads in the process, from /proc/self/status
+size_t CountThreads()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line))
+    {
+        if(line.rfind("Threads:", 0) == 0)
+        {
+            return std::stoul(line.substr(8));
+        }
+    }
+    return 0;
+}
+#endif
+
+#ifdef HAS_IO_URING
+// The process's io_uring handles, from /proc/self/fd
+std::set<int> IoUringHandles()
+{
+    std::set<int> handles;
+    std::error_code err;
+    for(const auto& entry : std::filesystem::directory_iterator("/proc/self/fd", err))
+    {
+        if(std::filesystem::read_symlink(entry.path(), err).string() == "anon_inode:[io_uring]")
+        {
+            handles.insert(std::stoi(entry.path().filename().string()));
+        }
+    }
+    return handles;
+}
+#endif
+
+template<typename Predicate>
+bool WaitUntil(Predicate&& predicate, std::chrono::milliseconds timeout = std::chrono::seconds(5))
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while(!predicate())
+    {
+        if(std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
 #if SERIAL_PORT_RUNNING
 
 TEST_CASE("Do blocking serial ports work?", "[sockets]")
@@ -146,8 +254,8 @@ TEST_CASE("Can we write on Read Serial Ports and vice versa?", "[sockets]")
 
 TEST_CASE("Can we use uninitialised Serial ports?", "[sockets]")
 {
-    auto readPort = std::make_shared<SerialPort>(SocketType::Blocking, SocketMode::Read, SERIAL_PORT_READ);
-    auto writePort = std::make_shared<SerialPort>(SocketType::Blocking, SocketMode::Write, SERIAL_PORT_WRITE);
+    auto readPort = MakeSerialPort(SocketType::Blocking, SocketMode::Read, SERIAL_PORT_READ);
+    auto writePort = MakeSerialPort(SocketType::Blocking, SocketMode::Write, SERIAL_PORT_WRITE);
     // Don't open the ports and don't provide buffers
     REQUIRE_FALSE(readPort->readData(nullptr, 0).get());
     REQUIRE_FALSE(writePort->writeData(nullptr, 0).get());
@@ -158,6 +266,178 @@ TEST_CASE("Can we use uninitialised Serial ports?", "[sockets]")
     REQUIRE_FALSE(writePort->writeData(nullptr, 0).get());
 }
 
+#ifndef _WIN32
+
+TEST_CASE("Can we close a serial port with an idle reader?", "[sockets]")
+{
+    using namespace std::chrono;
+    for(auto type : { SocketType::Blocking, SocketType::NonBlocking })
+    {
+        std::shared_ptr<SerialPort> readPort, writePort;
+        PrepareReadWriteSerialPorts(readPort, writePort, type);
+        // A blocking read waits on this thread, so give it one of its own
+        auto readPortFuture = std::async(std::launch::async, [readPort]()
+        {
+            return readPort->readData().get();
+        });
+        std::this_thread::sleep_for(100ms);
+        REQUIRE(readPortFuture.wait_for(0s) == std::future_status::timeout);
+        readPort->close();
+        REQUIRE(readPortFuture.wait_for(2s) == std::future_status::ready);
+        const auto result = readPortFuture.get();
+        REQUIRE_FALSE(result);
+        REQUIRE_FALSE(result.timedOut);
+        REQUIRE_FALSE(readPort->isOpen());
+        writePort->close();
+    }
+}
+
+TEST_CASE("Do serial ports flush stale bytes and wake on VMIN?", "[sockets]")
+{
+    PseudoTerminal terminal;
+    REQUIRE(terminal.isOpen());
+    auto port = std::make_shared<SerialPort>(SocketType::Blocking, SocketMode::ReadWrite, terminal.getDeviceName());
+    REQUIRE(port->getSocketName() == terminal.getDeviceName());
+    REQUIRE(SerialPort(SocketType::Blocking, SocketMode::Read, 1).getSocketName() == "/dev/ttyS0");
+    REQUIRE(port->open());
+
+    // Whatever arrived before a read started is flushed
+    const std::string stale = "stale";
+    terminal.write(std::span((const uint8_t*)stale.data(), stale.length()));
+    using namespace std::chrono;
+    std::this_thread::sleep_for(50ms);
+    auto writer = std::async(std::launch::async, [&terminal]()
+    {
+        std::this_thread::sleep_for(100ms);
+        terminal.write(std::span((const uint8_t*)Data.data(), Data.length()));
+    });
+    std::array<unsigned char, 64> readBuffer {};
+    auto result = port->readData(readBuffer.data(), readBuffer.size()).get();
+    writer.get();
+    REQUIRE(result);
+    REQUIRE(std::string((char*)readBuffer.data(), result.bytes) == Data);
+
+    // With VMIN at 4 the reader sleeps through the first two bytes
+    REQUIRE(port->setLatencyOptions({ 4, 0, true }));
+    writer = std::async(std::launch::async, [&terminal]()
+    {
+        std::this_thread::sleep_for(50ms);
+        terminal.write(std::span((const uint8_t*)Data.data(), 2));
+        std::this_thread::sleep_for(50ms);
+        terminal.write(std::span((const uint8_t*)Data.data() + 2, 2));
+    });
+    result = port->readData(readBuffer.data(), readBuffer.size()).get();
+    writer.get();
+    REQUIRE(result);
+    REQUIRE(result.bytes == 4);
+
+    // And the other way
+    REQUIRE(port->writeData((unsigned char*)Data.data(), Data.length()).get());
+    std::string received;
+    while(received.length() < Data.length())
+    {
+        const size_t bytes = terminal.read(std::span(readBuffer.data(), readBuffer.size()), 1000);
+        REQUIRE(bytes > 0);
+        received.append((char*)readBuffer.data(), bytes);
+    }
+    REQUIRE(received == Data);
+    REQUIRE(port->getLastErrorMessage().empty());
+    port->close();
+}
+
+TEST_CASE("Do serial ports split frames on inter-byte gaps?", "[sockets]")
+{
+    using namespace std::chrono;
+    static constexpr auto FrameGap = 20ms;
+    static constexpr size_t FrameCount = 10;
+    PseudoTerminal terminal;
+    REQUIRE(terminal.isOpen());
+    SerialPort port(SocketType::NonBlocking, SocketMode::Read, terminal.getDeviceName());
+    REQUIRE(port.open());
+    REQUIRE(port.getCharacterTime() == nanoseconds(10 * 1000000000ull / port.getBaudRate()));
+    std::mutex framesMutex;
+    std::vector<std::string> frames;
+    REQUIRE(port.startReadingFrames([&framesMutex, &frames](std::span<const uint8_t> frame)
+    {
+        std::lock_guard lock(framesMutex);
+        frames.emplace_back((const char*)frame.data(), frame.size());
+    }, FrameGap));
+    REQUIRE_FALSE(port.startReadingFrames([](std::span<const uint8_t>) {}));
+    REQUIRE_FALSE(port.getLastErrorMessage().empty());
+
+    // Each frame trickles out a few bytes at a time, well inside the gap, then the line goes quiet
+    std::vector<std::string> expected;
+    for(size_t i = 0; i < FrameCount; ++i)
+    {
+        expected.push_back(Data + std::to_string(i));
+        for(size_t offset = 0; offset < expected.back().length(); offset += 4)
+        {
+            terminal.write(std::span((const uint8_t*)expected.back().data() + offset, std::min<size_t>(4, expected.back().length() - offset)));
+            std::this_thread::sleep_for(1ms);
+        }
+        std::this_thread::sleep_for(FrameGap * 3);
+    }
+    REQUIRE(WaitUntil([&]()
+    {
+        std::lock_guard lock(framesMutex);
+        return frames.size() == FrameCount;
+    }));
+    {
+        std::lock_guard lock(framesMutex);
+        REQUIRE(frames == expected);
+    }
+    auto statistics = port.getFrameStatistics();
+    REQUIRE(statistics.frames == FrameCount);
+    REQUIRE(statistics.overflows == 0);
+    REQUIRE(statistics.minLatency >= FrameGap);
+    REQUIRE(statistics.minLatency <= statistics.meanLatency);
+    REQUIRE(statistics.meanLatency <= statistics.maxLatency);
+
+    // Anything longer than the frame buffer is handed over as soon as it fills it
+    port.stopReadingContinuously();
+    REQUIRE_FALSE(port.isReadingContinuously());
+    frames.clear();
+    REQUIRE(port.startReadingFrames([&framesMutex, &frames](std::span<const uint8_t> frame)
+    {
+        std::lock_guard lock(framesMutex);
+        frames.emplace_back((const char*)frame.data(), frame.size());
+    }, FrameGap, 4));
+    terminal.write(std::span((const uint8_t*)Data.data(), 6));
+    REQUIRE(WaitUntil([&]()
+    {
+        std::lock_guard lock(framesMutex);
+        return frames.size() == 2;
+    }));
+    REQUIRE(frames[0] == Data.substr(0, 4));
+    REQUIRE(frames[1] == Data.substr(4, 2));
+    REQUIRE(port.getFrameStatistics().overflows == 1);
+
+    // The frame callback can stop the reading it is part of, or close the port, without waiting on itself
+    port.stopReadingContinuously();
+    std::atomic_bool stoppedFromFrame = false;
+    REQUIRE(port.startReadingFrames([&port, &stoppedFromFrame](std::span<const uint8_t>)
+    {
+        port.stopReadingContinuously();
+        stoppedFromFrame = true;
+    }, FrameGap));
+    terminal.write(std::span((const uint8_t*)Data.data(), Data.length()));
+    REQUIRE(WaitUntil([&stoppedFromFrame]() { return stoppedFromFrame.load(); }));
+    REQUIRE_FALSE(port.isReadingContinuously());
+    std::atomic_bool closedFromFrame = false;
+    REQUIRE(port.startReadingFrames([&port, &closedFromFrame](std::span<const uint8_t>)
+    {
+        port.close();
+        closedFromFrame = true;
+    }, FrameGap));
+    terminal.write(std::span((const uint8_t*)Data.data(), Data.length()));
+    REQUIRE(WaitUntil([&closedFromFrame]() { return closedFromFrame.load(); }));
+    REQUIRE_FALSE(port.isOpen());
+    REQUIRE_FALSE(port.isReadingContinuously());
+    REQUIRE(port.getLastErrorMessage().empty());
+}
+
+#endif
+
 #endif
 
 TEST_CASE("Do blocking UDP ports work?", "[sockets]")
@@ -245,6 +525,2065 @@ TEST_CASE("Can we use uninitialised UDP ports?", "[sockets]")
     REQUIRE(writePort->open());
     REQUIRE_FALSE(readPort->readData(nullptr, 0).get());
     REQUIRE_FALSE(writePort->writeData(nullptr, 0).get());
+    readPort->getLastErrorMessage();
+    writePort->getLastErrorMessage();
+    // An address that doesn't parse fails to open rather than binding every interface
+    UDPServer badServer(SocketType::Blocking, "127.0.0.300", 0);
+    UDPClient badClient(SocketType::Blocking, "not an address", UDP_PORT);
+    REQUIRE_FALSE(badServer.open());
+    REQUIRE_FALSE(badServer.isOpen());
+    REQUIRE(badServer.getLastError().reason == SocketErrorReason::System);
+    REQUIRE_FALSE(badClient.open());
+    REQUIRE_FALSE(badClient.isOpen());
+    REQUIRE(badClient.getLastError().reason == SocketErrorReason::System);
+}
+
+TEST_CASE("Do non-blocking operations share the executor pool?", "[sockets]")
+{
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::NonBlocking);
+    std::mutex threadIdMutex;
+    std::set<std::thread::id> threadIds;
+    auto& writeSocketEvents = writePort->getSocketEventCallbacks();
+    writeSocketEvents.write.preCallback = [&threadIdMutex, &threadIds]()
+    {
+        std::lock_guard lock(threadIdMutex);
+        threadIds.insert(std::this_thread::get_id());
+    };
+    std::vector<ISocket::AsyncSocketResult> writePortFutures;
+    for(int i = 0; i < 100; ++i)
+    {
+        writePortFutures.push_back(writePort->writeData((unsigned char*)Data.data(), Data.length()));
+    }
+    for(auto& writePortFuture : writePortFutures)
+    {
+        REQUIRE(writePortFuture.get());
+    }
+    // No thread per operation, and nothing ran on the calling thread
+    REQUIRE(threadIds.size() <= SocketExecutor::instance().getThreadCount());
+    REQUIRE(threadIds.count(std::this_thread::get_id()) == 0);
+    StopReadWritePorts(readPort, writePort);
+}
+
+TEST_CASE("Do coroutine UDP ports work?", "[sockets]")
+{
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::NonBlocking);
+    auto& context = SocketExecutor::instance().getContext();
+    auto readPortFuture = boost::asio::co_spawn(context, readPort->asyncRead(), boost::asio::use_future);
+    auto writePortFuture = boost::asio::co_spawn(context, writePort->asyncWrite(std::span((uint8_t*)Data.data(), Data.length())), boost::asio::use_future);
+    REQUIRE(writePortFuture.get());
+    auto readResult = readPortFuture.get();
+    REQUIRE(readResult);
+    REQUIRE(std::string((char*)readPort->getRecvBuffer().data(), readResult.bytes) == Data);
+    // Wrong direction should fail without reaching the socket
+    REQUIRE_FALSE(boost::asio::co_spawn(context, readPort->asyncWrite(), boost::asio::use_future).get());
+    REQUIRE_FALSE(readPort->getLastErrorMessage().empty());
+    StopReadWritePorts(readPort, writePort);
+}
+
+TEST_CASE("Can coroutines keep many UDP reads outstanding?", "[sockets]")
+{
+    static constexpr size_t OutstandingReads = 100;
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::NonBlocking);
+    auto& context = SocketExecutor::instance().getContext();
+    std::vector<std::array<uint8_t, 32>> readBuffers(OutstandingReads);
+    std::vector<std::future<SocketResult>> readPortFutures;
+    for(auto& readBuffer : readBuffers)
+    {
+        readPortFutures.push_back(boost::asio::co_spawn(context, readPort->asyncRead(readBuffer), boost::asio::use_future));
+    }
+    // One coroutine writes everything, each datagram completes exactly one of the pending reads
+    auto writePortFuture = boost::asio::co_spawn(context, [writePort]() -> boost::asio::awaitable<size_t>
+    {
+        size_t written = 0;
+        for(size_t i = 0; i < OutstandingReads; ++i)
+        {
+            auto result = co_await writePort->asyncWrite(std::span((uint8_t*)Data.data(), Data.length()));
+            written += result ? 1 : 0;
+        }
+        co_return written;
+    }, boost::asio::use_future);
+    REQUIRE(writePortFuture.get() == OutstandingReads);
+    for(auto& readPortFuture : readPortFutures)
+    {
+        using namespace std::chrono;
+        REQUIRE(readPortFuture.wait_for(5s) == std::future_status::ready);
+        REQUIRE(readPortFuture.get().bytes == Data.length());
+    }
+    StopReadWritePorts(readPort, writePort);
+}
+
+TEST_CASE("Can UDP ports read and write in batches?", "[sockets]")
+{
+    static constexpr size_t BatchSize = 16;
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::Blocking);
+    std::vector<UDPDatagram> writeDatagrams(BatchSize);
+    for(size_t i = 0; i < BatchSize; ++i)
+    {
+        writeDatagrams[i].data = (unsigned char*)Data.data();
+        writeDatagrams[i].bufferSize = i % Data.length() + 1; // varying length per datagram
+    }
+    auto writeResult = writePort->writeBatch(writeDatagrams);
+    REQUIRE(writeResult);
+    REQUIRE(writeResult.datagrams == BatchSize);
+
+    std::vector<std::array<unsigned char, 32>> readBuffers(BatchSize);
+    std::vector<UDPDatagram> readDatagrams(BatchSize);
+    for(size_t i = 0; i < BatchSize; ++i)
+    {
+        readDatagrams[i].data = readBuffers[i].data();
+        readDatagrams[i].bufferSize = readBuffers[i].size();
+    }
+    size_t datagramsRead = 0;
+    while(datagramsRead < BatchSize)
+    {
+        auto readResult = readPort->readBatch(std::span(readDatagrams).subspan(datagramsRead));
+        REQUIRE(readResult);
+        REQUIRE(readResult.datagrams > 0);
+        datagramsRead += readResult.datagrams;
+    }
+    auto writeEndPoint = writePort->getLocalEndPoint();
+    for(size_t i = 0; i < BatchSize; ++i)
+    {
+        REQUIRE(readDatagrams[i].bytes == i % Data.length() + 1);
+        REQUIRE(std::string((char*)readDatagrams[i].data, readDatagrams[i].bytes) == Data.substr(0, readDatagrams[i].bytes));
+        REQUIRE(readDatagrams[i].endPoint.port() == writeEndPoint.port());
+    }
+    // Batches follow the same mode rules as readData/writeData
+    REQUIRE_FALSE(writePort->writeBatch({}));
+    REQUIRE_FALSE(writePort->getLastErrorMessage().empty());
+    StopReadWritePorts(readPort, writePort);
+}
+
+TEST_CASE("Do idle UDP reads time out?", "[sockets]")
+{
+    using namespace std::chrono;
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::Blocking, 50);
+    const auto start = steady_clock::now();
+    auto readResult = readPort->readData().get();
+    const auto elapsed = steady_clock::now() - start;
+    REQUIRE_FALSE(readResult);
+    REQUIRE(readResult.timedOut);
+    REQUIRE(elapsed >= 50ms);
+    REQUIRE(elapsed < 2s);
+    REQUIRE_FALSE(readPort->getLastErrorMessage().empty());
+    // The socket must still deliver the next datagram after a read timed out
+    REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+    readResult = readPort->readData().get();
+    REQUIRE(readResult);
+    REQUIRE(readResult.bytes == Data.length());
+    StopReadWritePorts(readPort, writePort);
+}
+
+TEST_CASE("Can we close a UDP port with an idle reader?", "[sockets]")
+{
+    using namespace std::chrono;
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::NonBlocking);
+    auto readPortFuture = readPort->readData();
+    std::this_thread::sleep_for(100ms);
+    REQUIRE(readPortFuture.wait_for(0s) == std::future_status::timeout);
+    readPort->close();
+    REQUIRE(readPortFuture.wait_for(2s) == std::future_status::ready);
+    REQUIRE_FALSE(readPortFuture.get());
+    REQUIRE_FALSE(readPortFuture.get().timedOut);
+    REQUIRE_FALSE(readPort->isOpen());
+    writePort->close();
+}
+
+TEST_CASE("Can pending reads outnumber the executor's threads?", "[sockets]")
+{
+    using namespace std::chrono;
+    static constexpr size_t ThreadCount = 2;
+    static constexpr size_t ReaderCount = 4;
+    auto& executor = SocketExecutor::instance();
+    const size_t threadCount = executor.getThreadCount();
+    executor.setThreadCount(ThreadCount);
+    std::vector<std::unique_ptr<UDPServer>> servers;
+    std::vector<std::unique_ptr<UDPClient>> clients;
+    std::vector<ISocket::AsyncSocketResult> readFutures;
+    for(size_t i = 0; i < ReaderCount; ++i)
+    {
+        servers.push_back(std::make_unique<UDPServer>(SocketType::NonBlocking, "127.0.0.1", 0, 0));
+        REQUIRE(servers.back()->open());
+        clients.push_back(std::make_unique<UDPClient>(SocketType::Blocking, "127.0.0.1", servers.back()->getLocalEndPoint().port()));
+        REQUIRE(clients.back()->open());
+    }
+#ifdef __linux__
+    const size_t threadsBeforeReading = CountThreads();
+#endif
+    for(auto& server : servers)
+    {
+        readFutures.push_back(server->readData());
+    }
+    // The idle readers wait on the event loop rather than on a thread, so the pool is still free for another socket's write
+    std::this_thread::sleep_for(50ms);
+#ifdef __linux__
+    REQUIRE(CountThreads() == threadsBeforeReading);
+#endif
+    UDPServer otherServer(SocketType::Blocking, "127.0.0.1", 0);
+    REQUIRE(otherServer.open());
+    UDPClient otherClient(SocketType::NonBlocking, "127.0.0.1", otherServer.getLocalEndPoint().port());
+    REQUIRE(otherClient.open());
+    auto otherWrite = otherClient.writeData((unsigned char*)Data.data(), Data.length());
+    REQUIRE(otherWrite.wait_for(1s) == std::future_status::ready);
+    REQUIRE(otherWrite.get());
+    std::promise<void> posted;
+    executor.post([&posted]()
+    {
+        posted.set_value();
+    });
+    REQUIRE(posted.get_future().wait_for(1s) == std::future_status::ready);
+    for(auto& readFuture : readFutures)
+    {
+        REQUIRE(readFuture.wait_for(0s) == std::future_status::timeout);
+    }
+    // Stopping doesn't wait for the pending reads, they carry on once the pool starts again
+    executor.stop();
+    REQUIRE(executor.getThreadCount() == 0);
+    executor.start(ThreadCount);
+    for(auto& client : clients)
+    {
+        REQUIRE(client->writeData((unsigned char*)Data.data(), Data.length()).get());
+    }
+    for(auto& readFuture : readFutures)
+    {
+        REQUIRE(readFuture.wait_for(2s) == std::future_status::ready);
+        REQUIRE(readFuture.get());
+        REQUIRE(readFuture.get().bytes == Data.length());
+    }
+    for(size_t i = 0; i < ReaderCount; ++i)
+    {
+        servers[i]->close();
+        clients[i]->close();
+    }
+    otherServer.close();
+    otherClient.close();
+    executor.setThreadCount(threadCount);
+}
+
+TEST_CASE("Do UDP socket timeouts end blocked reads?", "[sockets]")
+{
+    using namespace std::chrono;
+    for(auto type : { SocketType::Blocking, SocketType::NonBlocking })
+    {
+        std::shared_ptr<UDPServer> readPort;
+        std::shared_ptr<UDPClient> writePort;
+        PrepareReadWriteUDPPorts(readPort, writePort, type, 50);
+        // Nothing is left to the kernel, its own timeouts would be ignored on the non-blocking descriptor anyway
+    #ifndef _WIN32
+        timeval timeOut {};
+        socklen_t timeOutSize = sizeof(timeOut);
+        REQUIRE(::getsockopt(readPort->getNativeHandle(), SOL_SOCKET, SO_RCVTIMEO, &timeOut, &timeOutSize) == 0);
+        REQUIRE(timeOut.tv_sec == 0);
+        REQUIRE(timeOut.tv_usec == 0);
+    #endif
+        std::array<UDPDatagram, 4> datagrams {};
+        std::array<std::array<unsigned char, 64>, 4> buffers {};
+        for(size_t i = 0; i < datagrams.size(); ++i)
+        {
+            datagrams[i].data = buffers[i].data();
+            datagrams[i].bufferSize = buffers[i].size();
+        }
+        auto start = steady_clock::now();
+        auto readResult = readPort->readData().get();
+        REQUIRE(readResult.timedOut);
+        REQUIRE(steady_clock::now() - start >= 50ms);
+        start = steady_clock::now();
+        auto batchResult = readPort->readBatch(datagrams);
+        REQUIRE_FALSE(batchResult);
+        REQUIRE(batchResult.timedOut);
+        REQUIRE(steady_clock::now() - start >= 50ms);
+        REQUIRE(steady_clock::now() - start < 2s);
+        readPort->getLastErrorMessage();
+
+        REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+        readResult = readPort->readData().get();
+        REQUIRE(readResult);
+        REQUIRE(readResult.bytes == Data.length());
+        StopReadWritePorts(readPort, writePort);
+    }
+}
+
+TEST_CASE("Do UDP reads and writes honour deadlines?", "[sockets]")
+{
+    using namespace std::chrono;
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::NonBlocking);
+    auto& recvBuffer = readPort->getRecvBuffer();
+    // Nobody is writing, so this can only finish by the deadline
+    const auto start = steady_clock::now();
+    auto readResult = readPort->readData(recvBuffer.data(), recvBuffer.size(), steady_clock::now() + 50ms).get();
+    REQUIRE(steady_clock::now() - start >= 50ms);
+    REQUIRE_FALSE(readResult);
+    REQUIRE(readResult.timedOut);
+    REQUIRE_FALSE(readPort->getLastErrorMessage().empty());
+
+    auto readPortFuture = readPort->readData(recvBuffer.data(), recvBuffer.size(), steady_clock::now() + 5s);
+    REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length(), steady_clock::now() + 5s).get());
+    readResult = readPortFuture.get();
+    REQUIRE(readResult);
+    REQUIRE_FALSE(readResult.timedOut);
+    REQUIRE(readResult.bytes == Data.length());
+
+    // An expired deadline ends only its own operation, a coroutine reading alongside it still gets the next datagram
+    auto coroutineRead = boost::asio::co_spawn(readPort->getEventLoop(), readPort->asyncRead(), boost::asio::use_future);
+    readResult = readPort->readData(recvBuffer.data(), recvBuffer.size(), steady_clock::now() + 50ms).get();
+    REQUIRE(readResult.timedOut);
+    REQUIRE_FALSE(readPort->getLastErrorMessage().empty());
+    REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+    REQUIRE(coroutineRead.wait_for(2s) == std::future_status::ready);
+    readResult = coroutineRead.get();
+    REQUIRE(readResult);
+    REQUIRE(readResult.bytes == Data.length());
+    StopReadWritePorts(readPort, writePort);
+}
+
+TEST_CASE("Can ReadWrite UDP ports read and write at the same time?", "[sockets]")
+{
+    using namespace std::chrono;
+    static constexpr size_t DatagramCount = 500;
+    auto serverPort = std::make_shared<UDPServer>(SocketType::Blocking, SocketMode::ReadWrite, "", UDP_PORT, 2000);
+    auto clientPort = std::make_shared<UDPClient>(SocketType::Blocking, SocketMode::ReadWrite, "", UDP_PORT, 2000);
+    REQUIRE(serverPort->open());
+    REQUIRE(clientPort->open());
+
+    // A read parked with nothing to receive must not hold up writes on the same socket
+    auto countReads = [](const std::shared_ptr<UDPSocket>& port)
+    {
+        std::array<unsigned char, 32> readBuffer {};
+        size_t datagramsRead = 0;
+        while(datagramsRead < DatagramCount && port->readData(readBuffer.data(), readBuffer.size()).get())
+        {
+            ++datagramsRead;
+        }
+        return datagramsRead;
+    };
+    auto countWrites = [](const std::shared_ptr<UDPSocket>& port)
+    {
+        using namespace std::chrono;
+        size_t datagramsWritten = 0;
+        for(size_t i = 0; i < DatagramCount; ++i)
+        {
+            datagramsWritten += port->writeData((unsigned char*)Data.data(), Data.length()).get() ? 1 : 0;
+            if(i % 64 == 63)
+            {
+                // UDP has no flow control, give the reader a chance before the kernel buffer overflows
+                std::this_thread::sleep_for(1ms);
+            }
+        }
+        return datagramsWritten;
+    };
+    auto clientReads = std::async(std::launch::async, countReads, clientPort);
+    std::this_thread::sleep_for(100ms); // let the client reader park
+    const auto start = steady_clock::now();
+    REQUIRE(clientPort->writeData((unsigned char*)Data.data(), Data.length()).get());
+    REQUIRE(steady_clock::now() - start < 1s);
+    // The server now knows who to send to
+    std::array<unsigned char, 32> readBuffer {};
+    REQUIRE(serverPort->readData(readBuffer.data(), readBuffer.size()).get());
+
+    // Saturate both directions of both sockets at once
+    auto serverReads = std::async(std::launch::async, countReads, serverPort);
+    auto serverWrites = std::async(std::launch::async, countWrites, serverPort);
+    auto clientWrites = std::async(std::launch::async, countWrites, clientPort);
+    REQUIRE(clientWrites.get() == DatagramCount);
+    REQUIRE(serverWrites.get() == DatagramCount);
+    REQUIRE(serverReads.get() == DatagramCount);
+    REQUIRE(clientReads.get() == DatagramCount);
+    StopReadWritePorts(serverPort, clientPort);
+}
+
+TEST_CASE("Does a TCP server serve many clients at once?", "[sockets]")
+{
+    static constexpr size_t ClientCount = 20;
+    TCPServer server(SocketType::Blocking, "", TCP_PORT);
+    // Echo everything back on the connection it arrived on
+    server.getServerCallbacks().acceptedCallback = [](const std::shared_ptr<TCPConnection>& connection)
+    {
+        std::weak_ptr<TCPConnection> weakConnection = connection;
+        connection->getSocketEventCallbacks().read.postCallback = [weakConnection](uint8_t* data, SocketResult& result)
+        {
+            auto connection = weakConnection.lock();
+            if(result && connection)
+            {
+                connection->writeData(data, result.bytes);
+            }
+        };
+    };
+    std::atomic_size_t closedConnections = 0;
+    server.getServerCallbacks().closedCallback = [&closedConnections](const std::shared_ptr<TCPConnection>&)
+    {
+        ++closedConnections;
+    };
+    REQUIRE(server.open());
+    REQUIRE(server.isOpen());
+
+    std::vector<std::shared_ptr<TCPClient>> clients;
+    for(size_t i = 0; i < ClientCount; ++i)
+    {
+        clients.push_back(std::make_shared<TCPClient>(SocketType::Blocking, SocketMode::ReadWrite, "", TCP_PORT, 2000));
+        REQUIRE(clients.back()->open());
+    }
+    REQUIRE(WaitUntil([&server]() { return server.getConnectionCount() == ClientCount; }));
+    for(auto& client : clients)
+    {
+        REQUIRE(client->writeData((unsigned char*)Data.data(), Data.length()).get());
+    }
+    for(auto& client : clients)
+    {
+        std::string echoed;
+        std::array<unsigned char, 32> readBuffer {};
+        while(echoed.length() < Data.length())
+        {
+            auto result = client->readData(readBuffer.data(), readBuffer.size()).get();
+            REQUIRE(result);
+            echoed.append((char*)readBuffer.data(), result.bytes);
+        }
+        REQUIRE(echoed == Data);
+        REQUIRE(client->getLastErrorMessage().empty());
+    }
+    // Closing a client ends its connection on the server
+    clients.front()->close();
+    REQUIRE(WaitUntil([&server]() { return server.getConnectionCount() == ClientCount - 1; }));
+    server.close();
+    REQUIRE_FALSE(server.isOpen());
+    REQUIRE(WaitUntil([&server]() { return server.getConnectionCount() == 0; }));
+    REQUIRE(closedConnections == ClientCount);
+}
+
+TEST_CASE("Can a TCP server hold many idle connections?", "[sockets]")
+{
+    static constexpr size_t ClientCount = 1000;
+    static constexpr size_t MaxConnections = ClientCount - 10;
+    TCPServer server(SocketType::NonBlocking, "", TCP_PORT, MaxConnections);
+    REQUIRE(server.open());
+    std::vector<std::unique_ptr<TCPClient>> clients;
+    for(size_t i = 0; i < ClientCount; ++i)
+    {
+        clients.push_back(std::make_unique<TCPClient>(SocketType::NonBlocking, "", TCP_PORT));
+        REQUIRE(clients.back()->open());
+    }
+    // Anything past the limit is accepted and dropped straight away
+    REQUIRE(WaitUntil([&server]() { return server.getConnectionCount() == MaxConnections; }));
+    using namespace std::chrono;
+    std::this_thread::sleep_for(100ms);
+    REQUIRE(server.getConnectionCount() == MaxConnections);
+    clients.clear();
+    REQUIRE(WaitUntil([&server]() { return server.getConnectionCount() == 0; }));
+}
+
+TEST_CASE("Does a TCP client stop connecting at its timeout?", "[sockets]")
+{
+    using namespace std::chrono;
+    static constexpr uint32_t TimeoutMs = 100;
+    // A listener that never accepts and has no backlog, so the kernel soon stops answering handshakes
+    io_context context;
+    boost::asio::ip::tcp::acceptor listener(context);
+    listener.open(boost::asio::ip::tcp::v4());
+    listener.bind({ boost::asio::ip::address_v4::loopback(), 0 });
+    listener.listen(0);
+    const auto port = listener.local_endpoint().port();
+    std::vector<std::unique_ptr<TCPClient>> clients;
+    bool timedOut = false;
+    while(!timedOut && clients.size() < 8)
+    {
+        clients.push_back(std::make_unique<TCPClient>(SocketType::Blocking, SocketMode::ReadWrite, "127.0.0.1", port, TimeoutMs));
+        const auto started = steady_clock::now();
+        if(!clients.back()->open())
+        {
+            REQUIRE(steady_clock::now() - started < milliseconds(TimeoutMs * 5));
+            REQUIRE(clients.back()->getLastError().code == boost::asio::error::timed_out);
+            REQUIRE_FALSE(clients.back()->isOpen());
+            timedOut = true;
+        }
+    }
+    REQUIRE(timedOut);
+}
+
+TEST_CASE("Can a TCP server be closed from its own callbacks?", "[sockets]")
+{
+    // A single loop thread, a close() that waited on the loop would never return
+    SocketGroup group(1);
+    TCPServer server(SocketType::Blocking, "", TCP_PORT);
+    auto serverHandle = group.add(server);
+    REQUIRE(serverHandle);
+    std::atomic_bool closedFromAccept = false;
+    server.getServerCallbacks().acceptedCallback = [&server, &closedFromAccept](const std::shared_ptr<TCPConnection>&)
+    {
+        server.close();
+        closedFromAccept = true;
+    };
+    REQUIRE(server.open());
+    TCPClient client(SocketType::Blocking, SocketMode::ReadWrite, "", TCP_PORT);
+    REQUIRE(client.open());
+    REQUIRE(WaitUntil([&closedFromAccept]() { return closedFromAccept.load(); }));
+    REQUIRE_FALSE(server.isOpen());
+    client.close();
+
+    // A connection's callbacks run on the loop but not on the accept loop's strand
+    std::atomic_bool closedFromRead = false;
+    server.getServerCallbacks().acceptedCallback = [&server, &closedFromRead](const std::shared_ptr<TCPConnection>& connection)
+    {
+        connection->getSocketEventCallbacks().read.postCallback = [&server, &closedFromRead](uint8_t*, SocketResult&)
+        {
+            server.close();
+            closedFromRead = true;
+        };
+    };
+    REQUIRE(server.open());
+    REQUIRE(client.open());
+    REQUIRE(client.writeData((unsigned char*)Data.data(), Data.length()).get());
+    REQUIRE(WaitUntil([&closedFromRead]() { return closedFromRead.load(); }));
+    REQUIRE(WaitUntil([&server]() { return !server.isOpen(); }));
+    client.close();
+
+    // Reopening from there has to wait for the posted close, from the accept loop's own callbacks it doesn't
+    std::atomic_bool refusedFromRead = false;
+    server.getServerCallbacks().acceptedCallback = [&server, &refusedFromRead](const std::shared_ptr<TCPConnection>& connection)
+    {
+        connection->getSocketEventCallbacks().read.postCallback = [&server, &refusedFromRead](uint8_t*, SocketResult&)
+        {
+            server.close();
+            refusedFromRead = !server.open() && server.getLastError().reason == SocketErrorReason::StillClosing;
+        };
+    };
+    REQUIRE(server.open());
+    REQUIRE(client.open());
+    REQUIRE(client.writeData((unsigned char*)Data.data(), Data.length()).get());
+    REQUIRE(WaitUntil([&refusedFromRead]() { return refusedFromRead.load(); }));
+    REQUIRE(WaitUntil([&server]() { return !server.isOpen(); }));
+    client.close();
+    std::atomic_bool reopenedFromAccept = false;
+    server.getServerCallbacks().acceptedCallback = [&server, &reopenedFromAccept](const std::shared_ptr<TCPConnection>&)
+    {
+        if(!reopenedFromAccept)
+        {
+            server.close();
+            reopenedFromAccept = server.open();
+        }
+    };
+    REQUIRE(server.open());
+    REQUIRE(client.open());
+    REQUIRE(WaitUntil([&reopenedFromAccept]() { return reopenedFromAccept.load(); }));
+    REQUIRE(server.isOpen());
+    TCPClient secondClient(SocketType::Blocking, SocketMode::ReadWrite, "", TCP_PORT);
+    REQUIRE(secondClient.open());
+    REQUIRE(WaitUntil([&server]() { return server.getConnectionCount() == 1; }));
+    secondClient.close();
+    client.close();
+    server.close();
+    REQUIRE(group.remove(serverHandle));
+
+    // Nor may it need the server once it does, a server destroyed from its callbacks is gone by then
+    auto doomedServer = std::make_unique<TCPServer>(SocketType::Blocking, "", TCP_PORT);
+    REQUIRE(group.add(*doomedServer));
+    std::atomic_bool destroyedFromRead = false;
+    doomedServer->getServerCallbacks().acceptedCallback = [&doomedServer, &destroyedFromRead](const std::shared_ptr<TCPConnection>& connection)
+    {
+        connection->getSocketEventCallbacks().read.postCallback = [&doomedServer, &destroyedFromRead](uint8_t*, SocketResult&)
+        {
+            doomedServer.reset();
+            destroyedFromRead = true;
+        };
+    };
+    REQUIRE(doomedServer->open());
+    REQUIRE(client.open());
+    REQUIRE(client.writeData((unsigned char*)Data.data(), Data.length()).get());
+    REQUIRE(WaitUntil([&destroyedFromRead]() { return destroyedFromRead.load(); }));
+    client.close();
+}
+
+TEST_CASE("Does the frame ring hand frames between threads in order?", "[sockets]")
+{
+    static constexpr uint32_t FrameCount = 100000;
+    FrameRing frames(64, sizeof(uint32_t));
+    auto producer = std::async(std::launch::async, [&frames]()
+    {
+        for(uint32_t i = 0; i < FrameCount;)
+        {
+            auto frame = frames.acquire();
+            if(frame.data())
+            {
+                std::memcpy(frame.data(), &i, sizeof(i));
+                frames.commit(sizeof(i));
+                ++i;
+            }
+            else
+            {
+                // full, let the consumer run, on one CPU spinning only burns the rest of the time slice
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint32_t expected = 0;
+    bool inOrder = true;
+    while(expected < FrameCount)
+    {
+        const size_t drained = frames.drain([&expected, &inOrder](std::span<const uint8_t> frame)
+        {
+            uint32_t value = 0;
+            std::memcpy(&value, frame.data(), sizeof(value));
+            inOrder = inOrder && frame.size() == sizeof(value) && value == expected;
+            ++expected;
+        });
+        if(drained == 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+    producer.get();
+    REQUIRE(inOrder);
+    REQUIRE(frames.empty());
+    REQUIRE(frames.getDroppedFrames() == 0);
+}
+
+TEST_CASE("Can UDP servers read continuously?", "[sockets]")
+{
+    static constexpr size_t DatagramCount = 100;
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::NonBlocking);
+    REQUIRE_FALSE(writePort->startReadingContinuously());
+    REQUIRE_FALSE(writePort->getLastErrorMessage().empty());
+    REQUIRE(readPort->startReadingContinuously());
+    REQUIRE(readPort->isReadingContinuously());
+    REQUIRE_FALSE(readPort->startReadingContinuously());
+    REQUIRE_FALSE(readPort->getLastErrorMessage().empty());
+    auto* frames = readPort->getReceivedFrames();
+    REQUIRE(frames);
+    size_t framesRead = 0;
+    bool framesMatch = true;
+    for(size_t i = 0; i < DatagramCount; ++i)
+    {
+        REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+        framesRead += frames->drain([&framesMatch](std::span<const uint8_t> frame)
+        {
+            framesMatch = framesMatch && std::string((const char*)frame.data(), frame.size()) == Data;
+        });
+    }
+    REQUIRE(WaitUntil([&]()
+    {
+        framesRead += frames->drain([](std::span<const uint8_t>) {});
+        return framesRead == DatagramCount;
+    }));
+    REQUIRE(framesMatch);
+    REQUIRE(frames->getDroppedFrames() == 0);
+    readPort->stopReadingContinuously();
+    REQUIRE_FALSE(readPort->isReadingContinuously());
+    // Ordinary reads work again once stopped
+    REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+    REQUIRE(readPort->readData().get());
+    StopReadWritePorts(readPort, writePort);
+}
+
+TEST_CASE("Can the executor pool be resized under a continuous reader?", "[sockets]")
+{
+    using namespace std::chrono;
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::NonBlocking);
+    REQUIRE(readPort->startReadingContinuously());
+    auto* frames = readPort->getReceivedFrames();
+    size_t framesRead = 0;
+    auto drained = [&frames, &framesRead](size_t expected)
+    {
+        return WaitUntil([&]()
+        {
+            framesRead += frames->drain([](std::span<const uint8_t>) {});
+            return framesRead == expected;
+        });
+    };
+    REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+    REQUIRE(drained(1));
+
+    // The reader's pending read has to survive the old threads going, and be picked up by the new ones
+    auto& executor = SocketExecutor::instance();
+    const size_t threadCount = executor.getThreadCount();
+    auto resized = std::async(std::launch::async, [&executor, threadCount]()
+    {
+        executor.setThreadCount(threadCount + 1);
+    });
+    REQUIRE(resized.wait_for(5s) == std::future_status::ready);
+    REQUIRE(executor.getThreadCount() == threadCount + 1);
+    REQUIRE(readPort->isReadingContinuously());
+    REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+    REQUIRE(drained(2));
+
+    executor.setThreadCount(threadCount);
+    REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+    REQUIRE(drained(3));
+    readPort->stopReadingContinuously();
+    StopReadWritePorts(readPort, writePort);
+}
+
+TEST_CASE("Does a full continuous read ring drop frames?", "[sockets]")
+{
+    static constexpr size_t RingSize = 4;
+    static constexpr size_t DatagramCount = 10;
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::NonBlocking);
+    REQUIRE(readPort->startReadingContinuously(RingSize));
+    auto* frames = readPort->getReceivedFrames();
+    for(size_t i = 0; i < DatagramCount; ++i)
+    {
+        REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+    }
+    REQUIRE(WaitUntil([frames]() { return frames->getDroppedFrames() == DatagramCount - RingSize; }));
+    REQUIRE(frames->size() == RingSize);
+    // Closing stops the loop as well
+    readPort->close();
+    REQUIRE_FALSE(readPort->isReadingContinuously());
+    writePort->close();
+}
+
+TEST_CASE("Do pooled packets return to their pool?", "[sockets]")
+{
+    static constexpr size_t PacketsPerSlab = 8;
+    static constexpr size_t MaxSlabs = 2;
+    PacketPool pool(64, PacketsPerSlab, MaxSlabs);
+    REQUIRE(pool.getStats().capacity == PacketsPerSlab);
+    {
+        std::vector<PacketBuffer> packets;
+        for(size_t i = 0; i < PacketsPerSlab * MaxSlabs; ++i)
+        {
+            packets.push_back(pool.allocate());
+            REQUIRE(packets.back());
+            REQUIRE(packets.back().capacity() == 64);
+        }
+        // Grown to its limit and then refuses
+        REQUIRE_FALSE(pool.allocate());
+        auto stats = pool.getStats();
+        REQUIRE(stats.slabs == MaxSlabs);
+        REQUIRE(stats.inUse == PacketsPerSlab * MaxSlabs);
+        REQUIRE(stats.failedAllocations == 1);
+        // Copies share the packet, it only goes back once every copy has gone
+        PacketBuffer shared = packets.front();
+        REQUIRE(shared.useCount() == 2);
+        packets.clear();
+        REQUIRE(pool.getStats().inUse == 1);
+        REQUIRE(shared.data());
+    }
+    auto stats = pool.getStats();
+    REQUIRE(stats.inUse == 0);
+    REQUIRE(stats.highWaterMark == PacketsPerSlab * MaxSlabs);
+    REQUIRE(stats.allocations == PacketsPerSlab * MaxSlabs);
+
+    // Copies that don't fit are refused rather than spill into the next packet
+    std::vector<uint8_t> payload(65, 0xAB);
+    REQUIRE_FALSE(pool.allocate(payload));
+    auto copied = pool.allocate(std::span(payload).first(64));
+    REQUIRE(copied);
+    REQUIRE(copied.size() == 64);
+    REQUIRE(copied.data()[63] == 0xAB);
+    copied.reset();
+    REQUIRE(pool.getStats().inUse == 0);
+
+    // Allocated and released from several threads at once
+    std::atomic_size_t allocated = 0;
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 4; ++i)
+    {
+        threads.emplace_back([&pool, &allocated]()
+        {
+            for(size_t j = 0; j < 10000; ++j)
+            {
+                auto packet = pool.allocate();
+                PacketBuffer copy = packet;
+                packet.reset();
+                allocated += copy ? 1 : 0;
+            }
+        });
+    }
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+    REQUIRE(allocated > 0);
+    REQUIRE(pool.getStats().inUse == 0);
+    REQUIRE(pool.getStats().slabs == MaxSlabs);
+}
+
+TEST_CASE("Can UDP ports read into pooled packets?", "[sockets]")
+{
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::Blocking);
+    PacketPool pool(BUFSIZ);
+    REQUIRE(writePort->writeData(pool.allocate(std::span((const uint8_t*)Data.data(), Data.length()))).get());
+    auto packet = pool.allocate();
+    REQUIRE(readPort->readData(packet).get());
+    REQUIRE(packet.size() == Data.length());
+    // Hand it to another thread, the bytes are the ones the socket wrote
+    auto received = std::async(std::launch::async, [packet]()
+    {
+        return std::string((const char*)packet.data(), packet.size());
+    });
+    packet.reset();
+    REQUIRE(received.get() == Data);
+    REQUIRE(pool.getStats().inUse == 0);
+    // An exhausted pool hands out empty packets, which fail like a missing buffer
+    PacketBuffer empty;
+    REQUIRE_FALSE(readPort->readData(empty).get());
+    REQUIRE_FALSE(readPort->getLastErrorMessage().empty());
+    StopReadWritePorts(readPort, writePort);
+}
+
+TEST_CASE("Can UDP ports gather writes and scatter reads?", "[sockets]")
+{
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::Blocking);
+    const uint32_t header = static_cast<uint32_t>(Data.length());
+    std::array<boost::asio::const_buffer, 2> writeBuffers { boost::asio::buffer(&header, sizeof(header)), boost::asio::buffer(Data) };
+    auto writeResult = writePort->writeData(writeBuffers).get();
+    REQUIRE(writeResult);
+    REQUIRE(writeResult.bytes == sizeof(header) + Data.length());
+
+    // One datagram, split back into its header and payload
+    uint32_t readHeader = 0;
+    std::array<char, 64> payload {};
+    std::array<boost::asio::mutable_buffer, 2> readBuffers { boost::asio::buffer(&readHeader, sizeof(readHeader)), boost::asio::buffer(payload) };
+    auto readResult = readPort->readData(readBuffers).get();
+    REQUIRE(readResult);
+    REQUIRE(readResult.bytes == sizeof(header) + Data.length());
+    REQUIRE(readHeader == header);
+    REQUIRE(std::string(payload.data(), readHeader) == Data);
+
+    // More buffers than fit in one iovec array are refused rather than truncated
+    std::vector<boost::asio::const_buffer> tooMany(ISocket::MaxBufferCount + 1, boost::asio::buffer(Data));
+    REQUIRE_FALSE(writePort->writeData(tooMany).get());
+    REQUIRE_FALSE(writePort->getLastErrorMessage().empty());
+    StopReadWritePorts(readPort, writePort);
+}
+
+TEST_CASE("Can TCP clients gather writes?", "[sockets]")
+{
+    static constexpr size_t BufferCount = 16;
+    TCPServer server(SocketType::Blocking, "", TCP_PORT);
+    std::mutex receivedMutex;
+    std::string received;
+    server.getServerCallbacks().connection.read.postCallback = [&receivedMutex, &received](uint8_t* data, SocketResult& result)
+    {
+        if(result)
+        {
+            std::lock_guard lock(receivedMutex);
+            received.append((char*)data, result.bytes);
+        }
+    };
+    REQUIRE(server.open());
+    TCPClient client(SocketType::NonBlocking, "", TCP_PORT);
+    REQUIRE(client.open());
+    std::vector<boost::asio::const_buffer> buffers(BufferCount, boost::asio::buffer(Data));
+    auto result = client.writeData(buffers).get();
+    REQUIRE(result);
+    REQUIRE(result.bytes == BufferCount * Data.length());
+    REQUIRE(WaitUntil([&]()
+    {
+        std::lock_guard lock(receivedMutex);
+        return received.length() == BufferCount * Data.length();
+    }));
+    for(size_t i = 0; i < BufferCount; ++i)
+    {
+        REQUIRE(received.substr(i * Data.length(), Data.length()) == Data);
+    }
+    REQUIRE(client.getLastErrorMessage().empty());
+    client.close();
+    server.close();
+}
+
+// Feeds bytes into the framer a few at a time, the way a stream transport fragments them
+size_t FeedFramer(MessageFramer& framer, const std::string& stream, size_t fragmentSize, std::vector<std::string>& messages)
+{
+    size_t messageCount = 0;
+    for(size_t offset = 0, bytes = 0; offset < stream.length(); offset += bytes)
+    {
+        auto space = framer.prepare();
+        bytes = std::min({ fragmentSize, stream.length() - offset, space.size() });
+        std::memcpy(space.data(), stream.data() + offset, bytes);
+        messageCount += framer.commit(bytes, [&messages](std::span<const uint8_t> message)
+        {
+            messages.emplace_back((const char*)message.data(), message.size());
+        });
+    }
+    return messageCount;
+}
+
+TEST_CASE("Does the message framer reassemble fragmented messages?", "[sockets]")
+{
+    static constexpr size_t MessageCount = 200;
+    std::string lengthPrefixedStream;
+    std::string delimitedStream;
+    std::vector<std::string> expected;
+    for(size_t i = 0; i < MessageCount; ++i)
+    {
+        expected.push_back(Data.substr(0, i % (Data.length() + 1)) + std::to_string(i));
+        const uint16_t length = static_cast<uint16_t>(expected.back().length());
+        lengthPrefixedStream += static_cast<char>(length >> 8);
+        lengthPrefixedStream += static_cast<char>(length & 0xFF);
+        lengthPrefixedStream += expected.back();
+        delimitedStream += expected.back() + "\r\n";
+    }
+    // Every fragment size from a byte at a time up to everything in one read
+    for(size_t fragmentSize : { size_t(1), size_t(2), size_t(3), size_t(7), size_t(64), size_t(1000), lengthPrefixedStream.length() })
+    {
+        MessageFramer lengthPrefixed(LengthPrefix::UInt16, 256);
+        std::vector<std::string> messages;
+        REQUIRE(FeedFramer(lengthPrefixed, lengthPrefixedStream, fragmentSize, messages) == MessageCount);
+        REQUIRE(messages == expected);
+        REQUIRE(lengthPrefixed.getPendingBytes() == 0);
+
+        MessageFramer delimited("\r\n", 256);
+        messages.clear();
+        REQUIRE(FeedFramer(delimited, delimitedStream, fragmentSize, messages) == MessageCount);
+        REQUIRE(messages == expected);
+        REQUIRE(delimited.getLastErrorMessage().empty());
+    }
+
+    // A message that can never fit is dropped and reported
+    MessageFramer small(LengthPrefix::UInt16, 16);
+    std::vector<std::string> messages;
+    std::string oversized = { 0, 32 };
+    oversized += std::string(32, 'x');
+    FeedFramer(small, oversized, 8, messages);
+    REQUIRE(messages.empty());
+    REQUIRE_FALSE(small.getLastErrorMessage().empty());
+}
+
+TEST_CASE("Can framed messages be sent over TCP?", "[sockets]")
+{
+    static constexpr size_t MessageCount = 1000;
+    TCPServer server(SocketType::Blocking, "", TCP_PORT);
+    server.getServerCallbacks().acceptedCallback = [](const std::shared_ptr<TCPConnection>& connection)
+    {
+        std::weak_ptr<TCPConnection> weakConnection = connection;
+        connection->getSocketEventCallbacks().read.postCallback = [weakConnection](uint8_t* data, SocketResult& result)
+        {
+            auto connection = weakConnection.lock();
+            if(result && connection)
+            {
+                connection->writeData(data, result.bytes);
+            }
+        };
+    };
+    REQUIRE(server.open());
+    TCPClient client(SocketType::Blocking, SocketMode::ReadWrite, "", TCP_PORT, 2000);
+    REQUIRE(client.open());
+    MessageFramer framer(LengthPrefix::UInt32);
+    for(size_t i = 0; i < MessageCount; ++i)
+    {
+        const std::string message = std::to_string(i);
+        REQUIRE(framer.writeMessage(client, std::span((const uint8_t*)message.data(), message.length())));
+    }
+    // The echo comes back in whatever pieces TCP likes, many messages per read
+    size_t received = 0;
+    size_t reads = 0;
+    while(received < MessageCount)
+    {
+        REQUIRE(framer.receive(client, [&received](std::span<const uint8_t> message)
+        {
+            REQUIRE(std::string((const char*)message.data(), message.size()) == std::to_string(received));
+            ++received;
+        }));
+        ++reads;
+    }
+    REQUIRE(reads < MessageCount);
+    REQUIRE(client.getLastErrorMessage().empty());
+    REQUIRE(framer.getLastErrorMessage().empty());
+    client.close();
+    server.close();
+}
+
+TEST_CASE("Do latency histogram buckets hold their values?", "[sockets]")
+{
+    for(uint64_t value = 0; value < LatencyHistogram::MaxValue; value = value * 5 / 4 + 1)
+    {
+        const size_t index = LatencyHistogram::bucketIndex(value);
+        REQUIRE(index < LatencyHistogram::BucketCount);
+        REQUIRE(LatencyHistogram::bucketLowerBound(index) <= value);
+        REQUIRE(LatencyHistogram::bucketUpperBound(index) >= value);
+        // within 1/SubBucketCount of the value
+        REQUIRE(LatencyHistogram::bucketUpperBound(index) - LatencyHistogram::bucketLowerBound(index) <= value / LatencyHistogram::SubBucketCount);
+    }
+    REQUIRE(LatencyHistogram::bucketIndex(UINT64_MAX) == LatencyHistogram::BucketCount - 1);
+
+    LatencyHistogram histogram;
+    for(int i = 1; i <= 1000; ++i)
+    {
+        histogram.record(std::chrono::microseconds(i));
+    }
+    auto snapshot = histogram.snapshot();
+    REQUIRE(snapshot.count == 1000);
+    using namespace std::chrono;
+    REQUIRE(snapshot.getPercentile(0.5) >= 500us);
+    REQUIRE(snapshot.getPercentile(0.5) <= 500us * 9 / 8);
+    REQUIRE(snapshot.getPercentile(0.999) >= 999us);
+    REQUIRE(snapshot.getPercentile(1.0) <= 1000us * 9 / 8);
+}
+
+TEST_CASE("Do sockets keep metrics?", "[sockets]")
+{
+    static constexpr size_t WriteCount = 1000;
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::Blocking, 20);
+    // Off until asked for, nothing is allocated or counted
+    REQUIRE_FALSE(writePort->isMetricsEnabled());
+    REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+    REQUIRE(writePort->getMetrics().write.operations == 0);
+    REQUIRE(writePort->getMetrics().write.latency.count == 0);
+    writePort->resetMetrics(); // nothing to reset yet
+    std::array<unsigned char, 64> drain;
+    REQUIRE(readPort->readData(drain.data(), drain.size()).get());
+    readPort->enableMetrics();
+    writePort->enableMetrics();
+    REQUIRE(writePort->isMetricsEnabled());
+    // Snapshots are taken while other threads read and write
+    std::atomic_bool writing = true;
+    auto writer = std::async(std::launch::async, [&]()
+    {
+        for(size_t i = 0; i < WriteCount; ++i)
+        {
+            writePort->writeData((unsigned char*)Data.data(), Data.length());
+            if(i % 64 == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        writing = false;
+    });
+    auto reader = std::async(std::launch::async, [&]()
+    {
+        std::array<unsigned char, 64> readBuffer {};
+        size_t datagramsRead = 0;
+        while(readPort->readData(readBuffer.data(), readBuffer.size()).get())
+        {
+            ++datagramsRead;
+        }
+        return datagramsRead;
+    });
+    uint64_t lastOperations = 0;
+    while(writing)
+    {
+        auto metrics = writePort->getMetrics();
+        REQUIRE(metrics.write.operations >= lastOperations);
+        lastOperations = metrics.write.operations;
+    }
+    writer.get();
+    REQUIRE(reader.get() == WriteCount);
+    std::array<unsigned char, 64> readBuffer {};
+
+    auto writeMetrics = writePort->getMetrics().write;
+    REQUIRE(writeMetrics.operations == WriteCount);
+    REQUIRE(writeMetrics.bytes == WriteCount * Data.length());
+    REQUIRE(writeMetrics.errors == 0);
+    REQUIRE(writeMetrics.partialWrites == 0);
+    REQUIRE(writeMetrics.latency.count == WriteCount);
+    REQUIRE(writeMetrics.latency.getPercentile(0.5) > std::chrono::nanoseconds::zero());
+    // the last read waited out the 20ms timeout
+    auto readMetrics = readPort->getMetrics().read;
+    REQUIRE(readMetrics.operations == WriteCount + 1);
+    REQUIRE(readMetrics.bytes == WriteCount * Data.length());
+    REQUIRE(readMetrics.timeouts == 1);
+    REQUIRE(readMetrics.latency.getPercentile(1.0) >= std::chrono::milliseconds(20));
+    readPort->getLastErrorMessage();
+
+    // Deadlines count as timeouts too, and switching metrics off stops the counting
+    REQUIRE(readPort->readData(readBuffer.data(), readBuffer.size(), std::chrono::steady_clock::now() + std::chrono::milliseconds(5)).get().timedOut);
+    REQUIRE(readPort->getMetrics().read.timeouts == 2);
+    readPort->getLastErrorMessage();
+    writePort->setMetricsEnabled(false);
+    REQUIRE_FALSE(writePort->isMetricsEnabled());
+    REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+    REQUIRE(writePort->getMetrics().write.operations == WriteCount);
+    writePort->resetMetrics();
+    REQUIRE(writePort->getMetrics().write.operations == 0);
+    REQUIRE(writePort->getMetrics().write.latency.count == 0);
+    StopReadWritePorts(readPort, writePort);
+}
+
+TEST_CASE("Do compile-time sockets and their adapter work?", "[sockets]")
+{
+    // Events are counted by an inlined hook, no std::function involved
+    struct CountingEvents : NoEvents
+    {
+        size_t writes = 0;
+        void postWrite(uint8_t*, SocketResult& result) { writes += result.success; }
+    };
+    BasicSocket<UDPServerTransport> server("localhost", UDP_PORT, 100);
+    BasicSocket<UDPClientTransport, CountingEvents, IgnoreErrors> client("localhost", UDP_PORT);
+    // A closed transport can move onto a socket group's loop, which then runs its coroutines
+    SocketGroup group(1);
+    REQUIRE(server.getTransport().setEventLoop(group.getLoop(0)));
+    REQUIRE(&server.getTransport().getEventLoop() == &group.getLoop(0));
+    REQUIRE(server.open());
+    REQUIRE(client.open());
+    static_assert(sizeof(BasicSocket<UDPClientTransport, NoEvents, IgnoreErrors>) == sizeof(UDPClientTransport)); // empty policies take no room
+
+    std::array<uint8_t, 64> readBuffer {};
+    REQUIRE(client.writeData(std::span((const uint8_t*)Data.data(), Data.length())));
+    auto readResult = server.readData(readBuffer);
+    REQUIRE(readResult);
+    REQUIRE(std::string((char*)readBuffer.data(), readResult.bytes) == Data);
+    REQUIRE(client.getEvents().writes == 1);
+    // more buffers than the socket takes at once are refused, not cut short
+    std::vector<boost::asio::const_buffer> tooManyBuffers(ISocket::MaxBufferCount + 1, boost::asio::buffer(Data.data(), 1));
+    boost::system::error_code transportError;
+    REQUIRE(client.getTransport().write(tooManyBuffers, transportError) == 0);
+    REQUIRE(transportError == boost::asio::error::message_size);
+    // servers answer whoever wrote last
+    REQUIRE(server.writeData(std::span((const uint8_t*)Data.data(), 4)));
+    REQUIRE(client.readData(readBuffer).bytes == 4);
+    REQUIRE(server.readData(readBuffer).timedOut);
+    REQUIRE(server.getErrors().getLastError() == boost::asio::error::timed_out);
+    REQUIRE_FALSE(server.getErrors().getLastError());
+    client.close();
+    REQUIRE_FALSE(client.writeData(std::span((const uint8_t*)Data.data(), Data.length())));
+    server.close();
+    REQUIRE(server.getTransport().setEventLoop(SocketExecutor::instance().getContext()));
+
+    // The same transport behind ISocket
+    SocketAdapter<UDPServerTransport> readPort(SocketType::Blocking, SocketMode::Read, "localhost", UDP_PORT, 100);
+    SocketAdapter<UDPClientTransport> writePort(SocketType::NonBlocking, SocketMode::Write, "localhost", UDP_PORT);
+    auto readPortHandle = group.add(readPort);
+    REQUIRE(readPortHandle);
+    readPort.enableMetrics();
+    REQUIRE(readPort.open());
+    REQUIRE(writePort.open());
+    ISocket& writer = writePort;
+    REQUIRE(writer.writeData((unsigned char*)Data.data(), Data.length()).get());
+    readResult = readPort.readData(readBuffer.data(), readBuffer.size()).get();
+    REQUIRE(readResult);
+    REQUIRE(std::string((char*)readBuffer.data(), readResult.bytes) == Data);
+    REQUIRE(readPort.getMetrics().read.operations == 1);
+    REQUIRE(readPort.readData(readBuffer.data(), readBuffer.size()).get().timedOut);
+    REQUIRE_FALSE(readPort.getLastErrorMessage().empty());
+    REQUIRE_FALSE(readPort.writeData((unsigned char*)Data.data(), Data.length()).get());
+    writePort.close();
+    readPort.close();
+    REQUIRE_FALSE(readPort.isOpen());
+    REQUIRE(group.remove(readPortHandle));
+#ifndef _WIN32
+
+    // And a serial device, on a pseudo-terminal
+    PseudoTerminal terminal;
+    REQUIRE(terminal.isOpen());
+    BasicSocket<SerialTransport> serialPort(terminal.getDeviceName(), 57600, 100);
+    REQUIRE(serialPort.open());
+    REQUIRE(serialPort.readData(readBuffer).timedOut);
+    terminal.write(std::span((const uint8_t*)Data.data(), Data.length()));
+    readResult = serialPort.readData(readBuffer);
+    REQUIRE(readResult);
+    REQUIRE(std::string((char*)readBuffer.data(), readResult.bytes) == Data);
+    REQUIRE(serialPort.writeData(std::span((const uint8_t*)Data.data(), Data.length())));
+    REQUIRE(terminal.read(readBuffer, 1000) == Data.length());
+    serialPort.close();
+    REQUIRE_FALSE(serialPort.isOpen());
+#endif
+}
+
+TEST_CASE("Do failed operations report why without allocating?", "[sockets]")
+{
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::Blocking, 20);
+    std::vector<unsigned char> oversized(70000);
+    std::array<UDPDatagram, 1> datagrams {{ { oversized.data(), oversized.size() } }};
+    UDPClient closedPort(SocketType::Blocking, "", UDP_PORT);
+
+    // Failing and recording why stays off the heap, the message is only built when somebody asks for it
+    const size_t allocations = ThreadAllocations;
+    auto notOpen = closedPort.writeBatch(datagrams);
+    auto tooLarge = writePort->writeBatch(datagrams);
+    REQUIRE(ThreadAllocations == allocations);
+    REQUIRE(notOpen.reason == SocketErrorReason::NotInitialised);
+    REQUIRE(closedPort.getLastErrorMessage() == "Port was not initialised");
+    REQUIRE_FALSE(tooLarge);
+    REQUIRE(tooLarge.reason == SocketErrorReason::System);
+    REQUIRE(tooLarge.error == boost::asio::error::message_size);
+    REQUIRE(writePort->getLastError().code == boost::asio::error::message_size);
+    REQUIRE(writePort->getLastErrorMessage().empty());
+
+    // Timeouts and validation failures come back in the result as well
+    auto timedOut = readPort->readBatch(datagrams);
+    REQUIRE(timedOut.timedOut);
+    REQUIRE(timedOut.error == boost::asio::error::timed_out);
+    REQUIRE(readPort->getLastError().code == boost::asio::error::timed_out);
+    auto wrongMode = writePort->readData(oversized.data(), oversized.size()).get();
+    REQUIRE(wrongMode.reason == SocketErrorReason::WrongMode);
+    REQUIRE(wrongMode.errorMessage() == "Operation does not match the port's mode");
+    REQUIRE(writePort->getLastErrorMessage() == "Cannot Read data on a Write port");
+    StopReadWritePorts(readPort, writePort);
+}
+
+TEST_CASE("Does a sharded UDP server spread flows across its shards?", "[sockets]")
+{
+    static constexpr size_t ClientCount = 16;
+    static constexpr size_t WritesPerClient = 20;
+    UDPShardOptions options;
+    options.shardCount = 4;
+    options.pinToCpus = true;
+    ShardedUDPServer server("", UDP_PORT, options);
+    REQUIRE(server.open());
+    for(size_t i = 0; i < server.getShardCount(); ++i)
+    {
+        server.getShard(i).enableMetrics();
+    }
+    std::vector<std::unique_ptr<UDPClient>> clients;
+    for(size_t i = 0; i < ClientCount; ++i)
+    {
+        clients.push_back(std::make_unique<UDPClient>(SocketType::Blocking, "", UDP_PORT));
+        REQUIRE(clients.back()->open());
+    }
+
+    // Per-shard callbacks, each client's source port is its own flow and always lands on the same shard
+    std::mutex shardsMutex;
+    std::map<uint16_t, std::set<size_t>> shardsPerClient;
+    std::atomic<size_t> received = 0;
+    std::atomic<size_t> corrupted = 0; // Catch can't assert from several threads at once
+    REQUIRE(server.start([&](size_t shard, const UDPDatagram& datagram)
+    {
+        corrupted += std::string((char*)datagram.data, datagram.bytes) != Data;
+        std::lock_guard lock(shardsMutex);
+        shardsPerClient[datagram.endPoint.port()].insert(shard);
+        ++received;
+    }));
+    REQUIRE_FALSE(server.start());
+    for(size_t i = 0; i < WritesPerClient; ++i)
+    {
+        for(auto& client : clients)
+        {
+            REQUIRE(client->writeData((unsigned char*)Data.data(), Data.length()).get());
+        }
+    }
+    REQUIRE(WaitUntil([&]() { return received == ClientCount * WritesPerClient; }));
+    server.stop();
+    REQUIRE(corrupted == 0);
+    std::set<size_t> shardsUsed;
+    for(auto& [port, shards] : shardsPerClient)
+    {
+        REQUIRE(shards.size() == 1);
+        shardsUsed.insert(*shards.begin());
+    }
+    REQUIRE(shardsPerClient.size() == ClientCount);
+    REQUIRE(shardsUsed.size() > 1);
+    size_t shardDatagrams = 0;
+    for(size_t i = 0; i < server.getShardCount(); ++i)
+    {
+        shardDatagrams += server.getShardDatagrams(i);
+        REQUIRE(server.getShard(i).getMetrics().read.bytes == server.getShardDatagrams(i) * Data.length());
+    }
+    REQUIRE(shardDatagrams == received);
+
+    // Merged, one consumer drains every shard, and starting again leaves the running workers' rings alone
+    REQUIRE(server.start());
+    REQUIRE_FALSE(server.start());
+    for(auto& client : clients)
+    {
+        REQUIRE(client->writeData((unsigned char*)Data.data(), Data.length()).get());
+    }
+    size_t drained = 0;
+    REQUIRE(WaitUntil([&]()
+    {
+        drained += server.drain([](size_t, std::span<const uint8_t> payload)
+        {
+            REQUIRE(std::string((const char*)payload.data(), payload.size()) == Data);
+        });
+        return drained == ClientCount;
+    }));
+    REQUIRE(server.getDroppedFrames() == 0);
+    server.close();
+    REQUIRE_FALSE(server.isOpen());
+
+    // Without SO_REUSEPORT on both, the port can only be bound once
+    UDPServer plainServer(SocketType::Blocking, "", UDP_PORT);
+    REQUIRE(plainServer.open());
+    REQUIRE_FALSE(server.open());
+    REQUIRE_FALSE(server.getLastErrorMessage().empty());
+    for(auto& client : clients)
+    {
+        client->close();
+    }
+}
+
+TEST_CASE("Can UDP ports offload segmentation?", "[sockets]")
+{
+    static constexpr size_t SegmentSize = 1000;
+    std::vector<uint8_t> payload(3500);
+    for(size_t i = 0; i < payload.size(); ++i)
+    {
+        payload[i] = static_cast<uint8_t>(i / SegmentSize + i);
+    }
+    std::vector<uint8_t> buffer(UDPServer::MaxSegmentedBytes);
+    std::vector<UDPDatagram> datagrams(UDPClient::MaxSegments);
+
+    // Whatever the kernel supports, the reader sees the same four datagrams, the last one short
+    auto receiveAll = [&](UDPServer& readPort)
+    {
+        std::vector<uint8_t> received;
+        std::vector<size_t> sizes;
+        while(sizes.size() < 4)
+        {
+            auto readResult = readPort.readSegmented(buffer, datagrams);
+            REQUIRE(readResult);
+            for(size_t i = 0; i < readResult.datagrams; ++i)
+            {
+                received.insert(received.end(), datagrams[i].data, datagrams[i].data + datagrams[i].bytes);
+                sizes.push_back(datagrams[i].bytes);
+            }
+        }
+        REQUIRE(sizes == std::vector<size_t> { 1000, 1000, 1000, 500 });
+        REQUIRE(received == payload);
+    };
+
+    for(bool offload : { true, false })
+    {
+        UDPServer readPort(SocketType::Blocking, "", UDP_PORT, 1000);
+        UDPClient writePort(SocketType::Blocking, "", UDP_PORT);
+        readPort.setReceiveOffload(offload);
+        writePort.enableMetrics();
+        REQUIRE(readPort.open());
+        REQUIRE(writePort.open());
+        if(!offload)
+        {
+            REQUIRE_FALSE(writePort.setSegmentationOffload(false));
+            REQUIRE_FALSE(readPort.isReceiveOffloadEnabled());
+        }
+        auto writeResult = writePort.writeSegmented(payload, SegmentSize);
+        REQUIRE(writeResult);
+        REQUIRE(writeResult.datagrams == 4);
+        REQUIRE(writeResult.bytes == payload.size());
+        receiveAll(readPort);
+        REQUIRE(writePort.getMetrics().write.operations == 1);
+
+        // Plain datagrams come through readSegmented too
+        REQUIRE(writePort.writeData(payload.data(), 10).get());
+        auto readResult = readPort.readSegmented(buffer, datagrams);
+        REQUIRE(readResult.datagrams == 1);
+        REQUIRE(datagrams[0].bytes == 10);
+        REQUIRE_FALSE(writePort.writeSegmented(payload, 0));
+        writePort.getLastErrorMessage();
+        readPort.close();
+        writePort.close();
+    }
+}
+
+TEST_CASE("Do UDP ports report kernel timestamps?", "[sockets]")
+{
+    UDPServer readPort(SocketType::Blocking, "", UDP_PORT, 1000);
+    UDPClient writePort(SocketType::Blocking, "", UDP_PORT);
+    readPort.setReceiveTimestamps(true);
+    writePort.setTransmitTimestamps(true);
+    readPort.enableMetrics();
+    REQUIRE(readPort.open());
+    REQUIRE(writePort.open());
+    REQUIRE(readPort.isReceiveTimestampsEnabled());
+    REQUIRE(writePort.isTransmitTimestampsEnabled());
+
+    std::array<unsigned char, 64> data {};
+    const auto sent = std::chrono::system_clock::now();
+    REQUIRE(writePort.writeData(data.data(), 16).get());
+    auto readResult = readPort.readData(data.data(), data.size()).get();
+    REQUIRE(readResult);
+    REQUIRE(readResult.bytes == 16);
+    REQUIRE(readResult.timestamp >= sent - std::chrono::milliseconds(10)); // system_clock can step, allow it a little
+    REQUIRE(readResult.timestamp <= std::chrono::system_clock::now());
+
+    // Batches stamp every datagram
+    REQUIRE(writePort.writeData(data.data(), 8).get());
+    REQUIRE(writePort.writeData(data.data(), 8).get());
+    std::array<unsigned char, 64> batchData {};
+    std::array<UDPDatagram, 2> datagrams {{ { batchData.data(), 32 }, { batchData.data() + 32, 32 } }};
+    size_t stamped = 0;
+    for(size_t read = 0; read < datagrams.size();)
+    {
+        auto batchResult = readPort.readBatch(std::span(datagrams).subspan(read));
+        REQUIRE(batchResult);
+        for(size_t i = read; i < read + batchResult.datagrams; ++i)
+        {
+            stamped += datagrams[i].timestamp != std::chrono::system_clock::time_point {} ? 1 : 0;
+        }
+        read += batchResult.datagrams;
+    }
+    REQUIRE(stamped == 2);
+    REQUIRE(readPort.getMetrics().receiveDelay.count == 3);
+
+    // One transmit timestamp per datagram, the ids count them
+    std::array<UDPTransmitTimestamp, 8> transmitted {};
+    size_t count = 0;
+    for(int attempt = 0; attempt < 100 && count < 3; ++attempt)
+    {
+        count += writePort.readTransmitTimestamps(std::span(transmitted).subspan(count));
+        if(count < 3)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    REQUIRE(count == 3);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        REQUIRE(transmitted[i].id == i);
+        REQUIRE(transmitted[i].timestamp != std::chrono::system_clock::time_point {});
+    }
+
+    // Switched off the reads go back to receive_from and carry no timestamp
+    REQUIRE_FALSE(readPort.setReceiveTimestamps(false));
+    REQUIRE(writePort.writeData(data.data(), 4).get());
+    readResult = readPort.readData(data.data(), data.size()).get();
+    REQUIRE(readResult.bytes == 4);
+    REQUIRE(readResult.timestamp == std::chrono::system_clock::time_point {});
+    readPort.close();
+    writePort.close();
+}
+
+TEST_CASE("Can sockets run on io_uring?", "[sockets]")
+{
+    using namespace std::chrono;
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::Blocking, 200);
+    readPort->enableMetrics();
+    writePort->enableMetrics();
+    REQUIRE(readPort->setIOBackend(IOBackend::Reactor));
+#ifdef HAS_IO_URING
+    const bool supported = IoUring::isSupported();
+#else
+    const bool supported = false;
+#endif
+    // Where the kernel can't, the sockets stay on the reactor and everything below still works
+    REQUIRE(readPort->setIOBackend(IOBackend::IoUring) == supported);
+    REQUIRE(writePort->setIOBackend(IOBackend::IoUring) == supported);
+    REQUIRE(readPort->getIOBackend() == (supported ? IOBackend::IoUring : IOBackend::Reactor));
+
+    std::array<unsigned char, 64> buffer {};
+    REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+    auto readResult = readPort->readData(buffer.data(), buffer.size()).get();
+    REQUIRE(readResult);
+    REQUIRE(std::string((char*)buffer.data(), readResult.bytes) == Data);
+    REQUIRE(readPort->getMetrics().read.operations == 1);
+
+    // Scatter reads and the read timeout
+    REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+    std::array<boost::asio::mutable_buffer, 2> buffers { boost::asio::buffer(buffer.data(), 5), boost::asio::buffer(buffer.data() + 5, 32) };
+    readResult = readPort->readData(buffers).get();
+    REQUIRE(readResult.bytes == Data.length());
+    REQUIRE(std::string((char*)buffer.data(), readResult.bytes) == Data);
+    const auto started = steady_clock::now();
+    readResult = readPort->readData(buffer.data(), buffer.size()).get();
+    REQUIRE_FALSE(readResult);
+    REQUIRE(readResult.timedOut);
+    REQUIRE(steady_clock::now() - started >= 150ms);
+    readPort->getLastErrorMessage();
+
+    // One submit for writes and reads across both sockets, results come back in the order they were added
+    SocketBatch batch;
+    std::array<std::array<uint8_t, 16>, 3> reads {};
+    for(size_t i = 0; i < reads.size(); ++i)
+    {
+        batch.write(*writePort, std::span((const uint8_t*)Data.data(), i + 1));
+    }
+    for(auto& read : reads)
+    {
+        batch.read(*readPort, read);
+    }
+    batch.read(*writePort, reads[0]); // the client is write-only
+    auto results = batch.submit();
+    REQUIRE(results.size() == 7);
+    for(size_t i = 0; i < reads.size(); ++i)
+    {
+        REQUIRE(results[i]);
+        REQUIRE(results[i].bytes == i + 1);
+        REQUIRE(results[reads.size() + i]);
+    }
+    std::multiset<size_t> readSizes { results[3].bytes, results[4].bytes, results[5].bytes };
+    REQUIRE(readSizes == std::multiset<size_t> { 1, 2, 3 });
+    REQUIRE(results[6].reason == SocketErrorReason::WrongMode);
+    writePort->getLastErrorMessage();
+    REQUIRE(writePort->getMetrics().write.operations == 5);
+
+    // Closing the socket releases a ring read that has no timeout
+    auto idlePort = std::make_shared<UDPServer>(SocketType::NonBlocking, "", UDP_PORT + 1, 0);
+    REQUIRE(idlePort->open());
+    idlePort->setIOBackend(IOBackend::IoUring);
+    auto idleRead = idlePort->readData(buffer.data(), buffer.size());
+    std::this_thread::sleep_for(50ms);
+    REQUIRE(idleRead.wait_for(0s) == std::future_status::timeout);
+    idlePort->close();
+    REQUIRE(idleRead.wait_for(2s) == std::future_status::ready);
+    REQUIRE_FALSE(idleRead.get());
+    StopReadWritePorts(readPort, writePort);
+
+    // TCP writes go through sendmsg, serial ports through readv/writev on the tty
+    TCPServer server(SocketType::Blocking, "", TCP_PORT);
+    std::atomic<size_t> received = 0;
+    server.getServerCallbacks().connection.read.postCallback = [&received](uint8_t*, SocketResult& result)
+    {
+        received += result ? result.bytes : 0;
+    };
+    REQUIRE(server.open());
+    TCPClient client(SocketType::Blocking, "", TCP_PORT);
+    REQUIRE(client.open());
+    REQUIRE(client.setIOBackend(IOBackend::IoUring) == supported);
+    REQUIRE(client.writeData((unsigned char*)Data.data(), Data.length()).get().bytes == Data.length());
+    REQUIRE(WaitUntil([&]() { return received == Data.length(); }));
+    client.close();
+    server.close();
+
+#ifndef _WIN32
+    std::shared_ptr<SerialPort> serialRead, serialWrite;
+    PrepareReadWriteSerialPorts(serialRead, serialWrite, SocketType::Blocking);
+    REQUIRE(serialRead->setIOBackend(IOBackend::IoUring) == supported);
+    REQUIRE(serialWrite->setIOBackend(IOBackend::IoUring) == supported);
+    auto serialReadResult = std::async(std::launch::async, [&serialRead, &buffer]()
+    {
+        return serialRead->readData(buffer.data(), buffer.size()).get();
+    });
+    std::this_thread::sleep_for(200ms); // the read flushes whatever came before it
+    REQUIRE(serialWrite->writeData((unsigned char*)Data.data(), Data.length()).get());
+    REQUIRE(serialReadResult.wait_for(5s) == std::future_status::ready);
+    auto serialResult = serialReadResult.get();
+    REQUIRE(serialResult);
+    REQUIRE(std::string((char*)buffer.data(), serialResult.bytes) == Data);
+    StopReadWritePorts(serialRead, serialWrite);
+#endif
+
+#ifdef HAS_IO_URING
+    // A ring the kernel stops taking submissions on closes, so its callers go back to the reactor rather than wait on it
+    if(supported)
+    {
+        const auto handlesBefore = IoUringHandles();
+        IoUring ring(8);
+        REQUIRE(ring.isOpen());
+        std::vector<int> ringHandles;
+        std::ranges::set_difference(IoUringHandles(), handlesBefore, std::back_inserter(ringHandles));
+        REQUIRE(ringHandles.size() == 1);
+        const int notARing = ::open("/dev/null", O_RDWR);
+        REQUIRE(::dup2(notARing, ringHandles[0]) == ringHandles[0]);
+        IoUringOperation operation;
+        iovec target { buffer.data(), buffer.size() };
+        operation.message.msg_iov = &target;
+        operation.message.msg_iovlen = 1;
+        REQUIRE(ring.queue(true, notARing, operation, 0, 100));
+        REQUIRE(ring.submitAndWait([](uint64_t, int) {}) < 0);
+        REQUIRE_FALSE(ring.isOpen());
+        REQUIRE(ring.getFreeEntries() == 0);
+        REQUIRE_FALSE(ring.queue(true, notARing, operation, 0));
+        REQUIRE(ring.submitAndWait([](uint64_t, int) {}) == -EBADF);
+        ::close(notARing);
+    }
+#endif
+}
+
+TEST_CASE("Do busy-polling UDP ports work?", "[sockets]")
+{
+    using namespace std::chrono;
+    auto readPort = std::make_shared<UDPServer>(SocketType::BusyPoll, "", UDP_PORT, 200);
+    auto writePort = std::make_shared<UDPClient>(SocketType::BusyPoll, "", UDP_PORT, 200);
+    BusyPollOptions options;
+    options.spinBudget = 500us;
+    options.cpu = 0;
+    readPort->setBusyPollOptions(options);
+    REQUIRE(readPort->getBusyPollOptions().spinBudget == 500us);
+    REQUIRE(readPort->open());
+    REQUIRE(writePort->open());
+    readPort->isKernelBusyPollEnabled(); // down to the kernel and its permissions, either way the reads work
+
+    // Reads run on the calling thread, data that is already there or lands within the spin budget never waits on the reactor
+    std::array<unsigned char, 64> buffer {};
+    REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+    auto readResult = readPort->readData(buffer.data(), buffer.size()).get();
+    REQUIRE(readResult);
+    REQUIRE(std::string((char*)buffer.data(), readResult.bytes) == Data);
+    // Past the spin budget it falls back to blocking, and still times out
+    const auto started = steady_clock::now();
+    readResult = readPort->readData(buffer.data(), buffer.size()).get();
+    REQUIRE(readResult.timedOut);
+    REQUIRE(steady_clock::now() - started >= 150ms);
+    readPort->getLastErrorMessage();
+
+    // Continuous reads get a dedicated thread delivering straight into the ring
+    static constexpr size_t DatagramCount = 100;
+    REQUIRE(readPort->startReadingContinuously());
+    REQUIRE(readPort->isReadingContinuously());
+    auto* frames = readPort->getReceivedFrames();
+    size_t framesRead = 0;
+    std::atomic_bool framesMatch = true;
+    for(size_t i = 0; i < DatagramCount; ++i)
+    {
+        REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+    }
+    REQUIRE(WaitUntil([&]()
+    {
+        framesRead += frames->drain([&framesMatch](std::span<const uint8_t> frame)
+        {
+            framesMatch = framesMatch && std::string((const char*)frame.data(), frame.size()) == Data;
+        });
+        return framesRead == DatagramCount;
+    }));
+    REQUIRE(framesMatch);
+    readPort->stopReadingContinuously();
+    REQUIRE_FALSE(readPort->isReadingContinuously());
+    REQUIRE(writePort->writeData((unsigned char*)Data.data(), Data.length()).get());
+    REQUIRE(readPort->readData(buffer.data(), buffer.size()).get());
+    StopReadWritePorts(readPort, writePort);
+}
+
+namespace
+{
+    enum class Command : uint16_t
+    {
+        Start = 1,
+        Stop = 0x0203
+    };
+
+    struct Header
+    {
+        uint32_t sequence;
+        Command command;
+        double value;
+        static constexpr auto SerializedFields = std::make_tuple(&Header::sequence, &Header::command, &Header::value);
+    };
+
+    struct RawPoint
+    {
+        int16_t x;
+        int16_t y;
+    };
+}
+
+TEST_CASE("Can typed values be sent and received?", "[sockets]")
+{
+    // Field by field in the requested byte order, whatever the host's
+    std::array<uint8_t, 64> buffer {};
+    MessageWriter<std::endian::big> writer(buffer);
+    REQUIRE(writer.write(Header { 0x01020304, Command::Stop, 1.5 }, uint8_t(7)));
+    REQUIRE(writer.size() == 15);
+    REQUIRE(writer.size() == MessageWriter<std::endian::big>::encodedSize(Header {}, uint8_t(0)));
+    REQUIRE(std::vector<uint8_t>(buffer.begin(), buffer.begin() + 6) == std::vector<uint8_t> { 1, 2, 3, 4, 2, 3 });
+    MessageWriter<std::endian::little> littleWriter(buffer);
+    REQUIRE(littleWriter.write(uint32_t(0x01020304)));
+    REQUIRE(std::vector<uint8_t>(buffer.begin(), buffer.begin() + 4) == std::vector<uint8_t> { 4, 3, 2, 1 });
+
+    // Everything back out, strings and byte spans as views into the message
+    writer.clear();
+    const std::array<RawPoint, 2> points {{ { 1, -1 }, { 2, -2 } }};
+    const std::vector<uint32_t> values { 10, 20, 30 };
+    const uint8_t bytes[] = { 0xaa, 0xbb };
+    REQUIRE(writer.write(Header { 9, Command::Start, -0.25 }, points, std::string("name"), std::span<const uint32_t>(values), std::span<const uint8_t>(bytes), std::string_view("")));
+    Header header {};
+    std::array<RawPoint, 2> readPoints {};
+    std::string_view name;
+    std::array<uint32_t, 8> valueStorage {};
+    std::span<uint32_t> readValues(valueStorage);
+    std::span<const uint8_t> readBytes;
+    std::string empty = "not empty";
+    MessageReader<std::endian::big> reader(writer.written());
+    REQUIRE(reader.read(header, readPoints, name, readValues, readBytes, empty));
+    REQUIRE(reader.getRemainingBytes() == 0);
+    REQUIRE(header.sequence == 9);
+    REQUIRE(header.command == Command::Start);
+    REQUIRE(header.value == -0.25);
+    REQUIRE(readPoints[1].y == -2);
+    REQUIRE(name == "name");
+    REQUIRE((const uint8_t*)name.data() > buffer.data());
+    REQUIRE((const uint8_t*)name.data() < buffer.data() + writer.size());
+    REQUIRE(std::vector<uint32_t>(readValues.begin(), readValues.end()) == values);
+    REQUIRE(std::vector<uint8_t>(readBytes.begin(), readBytes.end()) == std::vector<uint8_t> { 0xaa, 0xbb });
+    REQUIRE(empty.empty());
+
+    // Running out of buffer or message stops the writer and reader
+    uint32_t tooFar = 0;
+    REQUIRE_FALSE(reader.read(tooFar));
+    REQUIRE(reader.getError() == SerializationError::BufferTooSmall);
+    std::array<uint8_t, 6> small {};
+    MessageWriter<std::endian::big> smallWriter(small);
+    REQUIRE_FALSE(smallWriter.write(uint32_t(1), uint32_t(2)));
+    REQUIRE(smallWriter.getRequiredBytes() == 8);
+    REQUIRE(smallWriter.size() == 4);
+    MessageWriter<std::endian::big, LengthPrefix::UInt8> shortPrefix(buffer);
+    REQUIRE_FALSE(shortPrefix.write(std::string(300, 'x')));
+    REQUIRE(shortPrefix.getError() == SerializationError::LengthPrefixOverflow);
+
+    // Any byte but 0 reads back as true
+    const std::array<uint8_t, 2> flags { 0, 2 };
+    bool cleared = true;
+    bool set = false;
+    REQUIRE(MessageReader<std::endian::big>(flags).read(cleared, set));
+    REQUIRE_FALSE(cleared);
+    REQUIRE(set);
+
+    // Straight out of and into the sockets' own buffers
+    std::shared_ptr<UDPServer> readPort;
+    std::shared_ptr<UDPClient> writePort;
+    PrepareReadWriteUDPPorts(readPort, writePort, SocketType::Blocking, 1000);
+    REQUIRE(writePort->send(Header { 3, Command::Stop, 2.0 }, std::string("payload")).get());
+    Header received {};
+    std::string_view payload;
+    REQUIRE(readPort->receive(received, payload));
+    REQUIRE(received.sequence == 3);
+    REQUIRE(received.command == Command::Stop);
+    REQUIRE(payload == "payload");
+    REQUIRE(payload.data() == (const char*)readPort->getRecvBuffer().data() + 16);
+
+    // Host order unless network order is asked for, and send<T>() still sends a T
+    REQUIRE(writePort->send<int16_t>(0x0102).get().bytes == 2);
+    int16_t hostOrder = 0;
+    REQUIRE(readPort->readData((unsigned char*)&hostOrder, sizeof(hostOrder)).get());
+    REQUIRE(hostOrder == 0x0102);
+    REQUIRE(writePort->send<std::endian::big>(uint16_t(0x0102)).get());
+    std::array<uint8_t, 2> networkOrder {};
+    REQUIRE(readPort->readData(networkOrder.data(), networkOrder.size()).get());
+    REQUIRE(networkOrder == std::array<uint8_t, 2> { 1, 2 });
+    uint16_t value = 0;
+    REQUIRE(writePort->send<std::endian::big>(uint16_t(0x0102)).get());
+    REQUIRE(readPort->receive<std::endian::big>(value));
+    REQUIRE(value == 0x0102);
+
+    // Several messages batched into one datagram
+    MessageWriter<std::endian::big> batch(writePort->getSendBuffer());
+    uint32_t messages = 0;
+    while(batch.writeMessage(Header { messages, Command::Start, 0.0 }, std::string("batched")))
+    {
+        ++messages;
+    }
+    REQUIRE(messages == writePort->getSendBuffer().size() / (2 + 14 + 2 + 7));
+    REQUIRE(writePort->writeData(batch.data(), batch.size()).get().bytes == batch.size());
+    auto readResult = readPort->readData().get();
+    REQUIRE(readResult.bytes == batch.size());
+    MessageReader<std::endian::big> batchReader(std::span<const uint8_t>(readPort->getRecvBuffer().data(), readResult.bytes));
+    uint32_t expected = 0;
+    bool messagesMatch = true;
+    REQUIRE(batchReader.readMessages([&](auto& message)
+    {
+        Header batched {};
+        std::string_view text;
+        messagesMatch = messagesMatch && message.read(batched, text) && batched.sequence == expected++ && text == "batched";
+    }) == messages);
+    REQUIRE(messagesMatch);
+
+    // Failures never reach the transport
+    REQUIRE(writePort->send(std::vector<uint8_t>(2048).size()).get()); // a size_t fits
+    REQUIRE(readPort->receive(tooFar));
+    auto sendResult = writePort->send(std::span<const uint8_t>(std::vector<uint8_t>(2048))).get();
+    REQUIRE(sendResult.reason == SocketErrorReason::SendBufferOverflow);
+    REQUIRE(writePort->getLastError().expected == 2050);
+    REQUIRE(writePort->send(uint16_t(1)).get());
+    auto shortResult = readPort->receive(tooFar);
+    REQUIRE_FALSE(shortResult);
+    REQUIRE(shortResult.reason == SocketErrorReason::MessageTooShort);
+    REQUIRE(readPort->getLastError().actual == 2);
+    StopReadWritePorts(readPort, writePort);
+}
+
+TEST_CASE("Can a socket group serve many sockets?", "[sockets]")
+{
+    static constexpr size_t SocketCount = 100;
+    SocketGroup group(2);
+    REQUIRE(group.getLoopCount() == 2);
+    std::vector<std::unique_ptr<UDPServer>> servers;
+    std::vector<std::unique_ptr<UDPClient>> clients;
+    std::vector<SocketGroup::Handle> handles;
+    for(size_t i = 0; i < SocketCount; ++i)
+    {
+        servers.push_back(std::make_unique<UDPServer>(SocketType::NonBlocking, "127.0.0.1", 0, 1000));
+        auto handle = group.add(*servers.back());
+        REQUIRE(handle);
+        handles.push_back(handle);
+        REQUIRE(servers.back()->open());
+        REQUIRE(&servers.back()->getEventLoop() == &group.getLoop(i % 2));
+        clients.push_back(std::make_unique<UDPClient>(SocketType::Blocking, "127.0.0.1", servers.back()->getLocalEndPoint().port()));
+        REQUIRE(clients.back()->open());
+    }
+    REQUIRE(group.getSocketCount() == SocketCount);
+    REQUIRE(group.getLoopSocketCount(0) == SocketCount / 2);
+    REQUIRE(group.getLoopSocketCount(1) == SocketCount / 2);
+
+    // Every server reads continuously on its loop, two threads between them
+    for(auto& server : servers)
+    {
+        REQUIRE(server->startReadingContinuously(8));
+    }
+    for(size_t i = 0; i < SocketCount; ++i)
+    {
+        REQUIRE(clients[i]->writeData((unsigned char*)Data.data(), Data.length()).get());
+    }
+    size_t framesRead = 0;
+    REQUIRE(WaitUntil([&]()
+    {
+        for(auto& server : servers)
+        {
+            framesRead += server->getReceivedFrames()->drain([](std::span<const uint8_t>) {});
+        }
+        return framesRead == SocketCount;
+    }));
+
+    // Deadline overloads work the same on a grouped socket, and its non-blocking operations run on its loop too
+    for(auto& server : servers)
+    {
+        server->stopReadingContinuously();
+    }
+    std::promise<std::thread::id> loopThread;
+    boost::asio::post(group.getLoop(0), [&loopThread]()
+    {
+        loopThread.set_value(std::this_thread::get_id());
+    });
+    std::thread::id readThread;
+    servers[0]->getSocketEventCallbacks().read.postCallback = [&readThread](uint8_t*, SocketResult&)
+    {
+        readThread = std::this_thread::get_id();
+    };
+    std::array<unsigned char, 64> buffer {};
+    REQUIRE(clients[0]->writeData((unsigned char*)Data.data(), Data.length()).get());
+    REQUIRE(servers[0]->readData(buffer.data(), buffer.size(), std::chrono::steady_clock::now() + std::chrono::milliseconds(500)).get());
+    REQUIRE(readThread == loopThread.get_future().get());
+    servers[0]->getSocketEventCallbacks().read.postCallback = nullptr;
+    REQUIRE(servers[0]->readData(buffer.data(), buffer.size(), std::chrono::steady_clock::now() + std::chrono::milliseconds(10)).get().timedOut);
+    servers[0]->getLastErrorMessage();
+
+    // Only closed sockets come and go
+    UDPServer openServer(SocketType::Blocking, "127.0.0.1", 0);
+    REQUIRE(openServer.open());
+    REQUIRE_FALSE(group.add(openServer));
+    REQUIRE_FALSE(group.remove(handles[0]));
+    servers[0]->close();
+    REQUIRE(group.remove(handles[0]));
+    REQUIRE_FALSE(group.remove(handles[0]));
+    REQUIRE(&servers[0]->getEventLoop() == &SocketExecutor::instance().getContext());
+    REQUIRE(group.getSocketCount() == SocketCount - 1);
+    openServer.close();
+    auto reused = group.add(openServer);
+    REQUIRE(reused.index == handles[0].index);
+    REQUIRE(reused.generation != handles[0].generation);
+    REQUIRE(group.remove(reused));
+
+    // A TCP server serves its connections on its loop
+    TCPServer tcpServer(SocketType::Blocking, "", TCP_PORT);
+    std::atomic<io_context*> connectionLoop = nullptr;
+    tcpServer.getServerCallbacks().acceptedCallback = [&connectionLoop](const std::shared_ptr<TCPConnection>& connection)
+    {
+        connectionLoop = &connection->getEventLoop();
+    };
+    auto serverHandle = group.add(tcpServer);
+    REQUIRE(serverHandle);
+    REQUIRE(tcpServer.open());
+    TCPClient tcpClient(SocketType::Blocking, "", TCP_PORT);
+    REQUIRE(tcpClient.open());
+    REQUIRE(WaitUntil([&]() { return connectionLoop != nullptr; }));
+    REQUIRE(connectionLoop == &tcpServer.getEventLoop());
+    tcpClient.close();
+    tcpServer.close();
+    REQUIRE(group.remove(serverHandle));
+
+    for(size_t i = 0; i < SocketCount; ++i)
+    {
+        servers[i]->close();
+        clients[i]->close();
+        if(i > 0)
+        {
+            REQUIRE(group.remove(handles[i]));
+        }
+    }
+    REQUIRE(group.getSocketCount() == 0);
+}
+
+namespace
+{
+    // Carries datagrams between two ends on a clock the test moves by hand, dropping some and delaying the rest by a random amount so they reorder
+    class LossyLink
+    {
+    public:
+        using Clock = ReliableSession::Clock;
+
+        LossyLink(double dropRate, Clock::duration delay, Clock::duration jitter, uint32_t seed = 1)
+            : m_dropRate(dropRate), m_delay(delay), m_jitter(jitter), m_random(seed)
+        {
+        }
+
+        void send(size_t towards, std::span<const uint8_t> datagram, Clock::time_point now)
+        {
+            if(std::uniform_real_distribution<double>(0, 1)(m_random) < m_dropRate)
+            {
+                ++m_dropped;
+                return;
+            }
+            const auto jitter = Clock::duration(std::uniform_int_distribution<Clock::rep>(0, m_jitter.count())(m_random));
+            m_inFlight.push_back({ now + m_delay + jitter, towards, std::vector<uint8_t>(datagram.begin(), datagram.end()) });
+        }
+
+        // Hands over every datagram due by now, earliest first
+        template<typename Deliver>
+        void deliver(Clock::time_point now, Deliver&& onDatagram)
+        {
+            std::stable_sort(m_inFlight.begin(), m_inFlight.end(), [](const Datagram& left, const Datagram& right)
+            {
+                return left.arrives < right.arrives;
+            });
+            while(!m_inFlight.empty() && m_inFlight.front().arrives <= now)
+            {
+                auto datagram = std::move(m_inFlight.front());
+                m_inFlight.pop_front();
+                onDatagram(datagram.towards, std::span<const uint8_t>(datagram.bytes));
+            }
+        }
+
+        void setDropRate(double dropRate)
+        {
+            m_dropRate = dropRate;
+        }
+
+        size_t getDropped() const
+        {
+            return m_dropped;
+        }
+
+    private:
+        struct Datagram
+        {
+            Clock::time_point arrives;
+            size_t towards;
+            std::vector<uint8_t> bytes;
+        };
+
+        double m_dropRate;
+        Clock::duration m_delay;
+        Clock::duration m_jitter;
+        std::mt19937 m_random;
+        std::deque<Datagram> m_inFlight;
+        size_t m_dropped = 0;
+    };
+}
+
+TEST_CASE("Does reliable UDP deliver everything over a lossy link?", "[sockets]")
+{
+    using namespace std::chrono;
+    using Clock = ReliableSession::Clock;
+    static constexpr uint32_t MessageCount = 2000;
+    auto now = Clock::time_point {} + 1s;
+    LossyLink link(0.1, 2ms, 3ms);
+    ReliableOptions options;
+    options.windowSize = 32;
+    std::array<ReliableSession, 2> ends
+    {
+        ReliableSession([&](std::span<const uint8_t> datagram) { link.send(1, datagram, now); }, options),
+        ReliableSession([&](std::span<const uint8_t> datagram) { link.send(0, datagram, now); }, options)
+    };
+    auto& sender = ends[0];
+    auto& receiver = ends[1];
+    receiver.setChannelOrdered(1, false);
+
+    // Channel 0 is ordered and channel 1 isn't, every message carries its index and when it was sent
+    std::array<std::vector<uint32_t>, 2> received;
+    std::vector<Clock::duration> latencies;
+    receiver.setReceiveCallback([&](uint8_t channel, std::span<const uint8_t> message)
+    {
+        uint32_t index = 0;
+        int64_t sentAt = 0;
+        MessageReader<std::endian::big>(message).read(index, sentAt);
+        received[channel].push_back(index);
+        latencies.push_back(now - Clock::time_point(Clock::duration(sentAt)));
+    });
+    uint32_t next = 0;
+    for(size_t step = 0; step < 1000000 && (next < MessageCount || !sender.isIdle()); ++step)
+    {
+        for(; next < MessageCount; ++next)
+        {
+            std::array<uint8_t, 12> message;
+            MessageWriter<std::endian::big>(message).write(next / 2, int64_t(now.time_since_epoch().count()));
+            if(!sender.send(next % 2, message, now))
+            {
+                REQUIRE(sender.getLastError().reason == SocketErrorReason::SendWindowFull);
+                break;
+            }
+        }
+        link.deliver(now, [&](size_t towards, std::span<const uint8_t> datagram)
+        {
+            ends[towards].receive(datagram, now);
+        });
+        sender.update(now);
+        now += 100us;
+    }
+    REQUIRE(sender.isIdle());
+    std::vector<uint32_t> expected(MessageCount / 2);
+    std::iota(expected.begin(), expected.end(), 0);
+    REQUIRE(received[0] == expected);
+    REQUIRE(received[1] != expected); // it would take some luck for the unordered channel to come out in order
+    std::sort(received[1].begin(), received[1].end());
+    REQUIRE(received[1] == expected);
+
+    // Losses were made up, mostly without waiting out a timeout
+    auto& stats = sender.getStats();
+    REQUIRE(link.getDropped() > 0);
+    REQUIRE(stats.sent == MessageCount);
+    REQUIRE(stats.retransmitted > 0);
+    REQUIRE(stats.fastRetransmits * 2 > stats.retransmitted);
+    REQUIRE(receiver.getStats().delivered == MessageCount);
+    REQUIRE(sender.getSmoothedRoundTrip() >= 4ms);
+    REQUIRE(sender.getSmoothedRoundTrip() <= 10ms);
+    std::sort(latencies.begin(), latencies.end());
+    REQUIRE(latencies[latencies.size() * 99 / 100] < 50ms);
+
+    // What can't be sent
+    std::array<uint8_t, 4> small {};
+    REQUIRE_FALSE(sender.send(options.channelCount, small, now));
+    REQUIRE(sender.getLastError().reason == SocketErrorReason::NoSuchChannel);
+    std::vector<uint8_t> large(options.maxPayload + 1);
+    REQUIRE_FALSE(sender.send(0, large, now));
+    REQUIRE(sender.getLastError().reason == SocketErrorReason::SendBufferOverflow);
+    link.setDropRate(1);
+    for(uint32_t i = 0; i < options.windowSize; ++i)
+    {
+        REQUIRE(sender.send(0, small, now));
+    }
+    REQUIRE_FALSE(sender.send(0, small, now));
+    REQUIRE(sender.getInFlight() == options.windowSize);
+    // Timeouts back off rather than flooding a dead link
+    const auto retransmitted = stats.retransmitted;
+    for(int i = 0; i < 1000; ++i)
+    {
+        now += 1ms;
+        sender.update(now);
+    }
+    REQUIRE(stats.retransmitted - retransmitted < options.windowSize * 10);
+
+    // And over real sockets, the server acknowledges to whoever sent to it
+    UDPServer serverSocket(SocketType::Blocking, SocketMode::ReadWrite, "", UDP_PORT, 5);
+    UDPClient clientSocket(SocketType::Blocking, SocketMode::ReadWrite, "", UDP_PORT, 5);
+    REQUIRE(serverSocket.open());
+    REQUIRE(clientSocket.open());
+    ReliableUDPSocket server(serverSocket);
+    ReliableUDPSocket client(clientSocket);
+    std::vector<std::string> messages;
+    server.getSession().setReceiveCallback([&messages](uint8_t, std::span<const uint8_t> message)
+    {
+        messages.emplace_back((const char*)message.data(), message.size());
+    });
+    for(int i = 0; i < 10; ++i)
+    {
+        REQUIRE(client.send(0, std::span((const uint8_t*)Data.data(), Data.length())));
+    }
+    for(int i = 0; i < 1000 && (messages.size() < 10 || !client.getSession().isIdle()); ++i)
+    {
+        server.poll();
+        client.poll();
+    }
+    REQUIRE(messages == std::vector<std::string>(10, Data));
+    REQUIRE(client.getSession().isIdle());
+    serverSocket.getLastErrorMessage();
+    clientSocket.getLastErrorMessage();
+    serverSocket.close();
+    clientSocket.close();
 }
 
 #pragma optimize("", on)
\ No newline at end of file